@@ -248,6 +248,8 @@ static struct device_t * fb_ssd1309_probe(struct driver_t * drv, struct dtnode_t
 	fb->create = fb_create;
 	fb->destroy = fb_destroy;
 	fb->present = fb_present;
+	fb->buffer = NULL;
+	fb->flip = NULL;
 	fb->priv = pdat;
 
 	if(pdat->rst >= 0)
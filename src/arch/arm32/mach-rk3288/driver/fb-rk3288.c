@@ -438,6 +438,8 @@ static struct device_t * fb_rk3288_probe(struct driver_t * drv, struct dtnode_t
 	fb->create = fb_create;
 	fb->destroy = fb_destroy;
 	fb->present = fb_present;
+	fb->buffer = NULL;
+	fb->flip = NULL;
 	fb->priv = pdat;
 
 	regulator_set_voltage(pdat->lcd_avdd_3v3, 3300000);
@@ -371,6 +371,8 @@ static struct device_t * fb_v3s_probe(struct driver_t * drv, struct dtnode_t * n
 	fb->create = fb_create;
 	fb->destroy = fb_destroy;
 	fb->present = fb_present;
+	fb->buffer = NULL;
+	fb->flip = NULL;
 	fb->priv = pdat;
 
 	clk_enable(pdat->clkde);
@@ -156,6 +156,18 @@ ssize_t sandbox_file_write(int fd, const void * buf, size_t count)
 	return (ret > 0) ? ret: 0;
 }
 
+ssize_t sandbox_file_pread(int fd, void * buf, size_t count, int64_t offset)
+{
+	ssize_t ret = pread(fd, buf, count, (off_t)offset);
+	return (ret > 0) ? ret: 0;
+}
+
+ssize_t sandbox_file_pwrite(int fd, const void * buf, size_t count, int64_t offset)
+{
+	ssize_t ret = pwrite(fd, buf, count, (off_t)offset);
+	return (ret > 0) ? ret: 0;
+}
+
 int64_t sandbox_file_seek(int fd, int64_t offset)
 {
 	int64_t len = (int64_t)lseek(fd, 0, SEEK_END);
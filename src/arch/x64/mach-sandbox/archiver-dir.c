@@ -183,6 +183,18 @@ static s64_t dir_write(void * f, void * buf, s64_t size)
 	return sandbox_file_write(fh->fd, buf, size);
 }
 
+static s64_t dir_pread(void * f, void * buf, s64_t size, s64_t offset)
+{
+	struct fhandle_dir_t * fh = (struct fhandle_dir_t *)f;
+	return sandbox_file_pread(fh->fd, buf, size, offset);
+}
+
+static s64_t dir_pwrite(void * f, void * buf, s64_t size, s64_t offset)
+{
+	struct fhandle_dir_t * fh = (struct fhandle_dir_t *)f;
+	return sandbox_file_pwrite(fh->fd, buf, size, offset);
+}
+
 static s64_t dir_seek(void * f, s64_t offset)
 {
 	struct fhandle_dir_t * fh = (struct fhandle_dir_t *)f;
@@ -220,6 +232,8 @@ static struct xfs_archiver_t archiver_dir = {
 	.open		= dir_open,
 	.read		= dir_read,
 	.write		= dir_write,
+	.pread		= dir_pread,
+	.pwrite		= dir_pwrite,
 	.seek		= dir_seek,
 	.tell		= dir_tell,
 	.length		= dir_length,
@@ -371,12 +371,21 @@ static s64_t tar_read(void * f, void * buf, s64_t size)
 	s64_t len;
 	if(size > fh->size - fh->offset)
 		size = fh->size - fh->offset;
-	sandbox_file_seek(fh->fd, fh->start + fh->offset);
-	len = sandbox_file_read(fh->fd, buf, size);
+	len = sandbox_file_pread(fh->fd, buf, size, fh->start + fh->offset);
 	fh->offset += len;
 	return len;
 }
 
+static s64_t tar_pread(void * f, void * buf, s64_t size, s64_t offset)
+{
+	struct fhandle_tar_t * fh = (struct fhandle_tar_t *)f;
+	if((offset < 0) || (offset >= fh->size))
+		return 0;
+	if(size > fh->size - offset)
+		size = fh->size - offset;
+	return sandbox_file_pread(fh->fd, buf, size, fh->start + offset);
+}
+
 static s64_t tar_write(void * f, void * buf, s64_t size)
 {
 	return 0;
@@ -391,7 +400,6 @@ static s64_t tar_seek(void * f, s64_t offset)
 		fh->offset = fh->size;
 	else
 		fh->offset = offset;
-	sandbox_file_seek(fh->fd, fh->start + fh->offset);
 	return fh->offset;
 }
 
@@ -425,6 +433,7 @@ static struct xfs_archiver_t archiver_tar = {
 	.open		= tar_open,
 	.read		= tar_read,
 	.write		= tar_write,
+	.pread		= tar_pread,
 	.seek		= tar_seek,
 	.tell		= tar_tell,
 	.length		= tar_length,
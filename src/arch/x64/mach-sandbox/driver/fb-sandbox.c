@@ -36,6 +36,7 @@ struct fb_sandbox_pdata_t
 	int height;
 	int pwidth;
 	int pheight;
+	struct surface_t * buffer[2];
 	void * priv;
 };
 
@@ -107,6 +108,62 @@ static void fb_present(struct framebuffer_t * fb, struct surface_t * s, struct r
 	sandbox_fb_surface_present(pdat->priv, s->priv, (struct sandbox_fb_region_list_t *)rl);
 }
 
+static struct surface_t * fb_buffer(struct framebuffer_t * fb, int index)
+{
+	struct fb_sandbox_pdata_t * pdat = (struct fb_sandbox_pdata_t *)fb->priv;
+	struct surface_t * s;
+	void * pixels;
+
+	if((index < 0) || (index >= ARRAY_SIZE(pdat->buffer)))
+		return NULL;
+	if(pdat->buffer[index])
+		return pdat->buffer[index];
+
+	pixels = sandbox_fb_get_buffer(pdat->priv, index);
+	if(!pixels)
+		return NULL;
+
+	s = malloc(sizeof(struct surface_t));
+	if(!s)
+		return NULL;
+
+	s->width = pdat->width;
+	s->height = pdat->height;
+	s->stride = pdat->width << 2;
+	s->pixlen = s->height * s->stride;
+	s->pixels = pixels;
+	s->r = search_render();
+	s->pctx = s->r->create(s);
+	s->priv = NULL;
+	pdat->buffer[index] = s;
+
+	return s;
+}
+
+static void fb_flip(struct framebuffer_t * fb, int index)
+{
+	struct fb_sandbox_pdata_t * pdat = (struct fb_sandbox_pdata_t *)fb->priv;
+	sandbox_fb_flip(pdat->priv, index);
+}
+
+static void fb_buffer_free(struct fb_sandbox_pdata_t * pdat)
+{
+	struct surface_t * s;
+	int i;
+
+	for(i = 0; i < ARRAY_SIZE(pdat->buffer); i++)
+	{
+		s = pdat->buffer[i];
+		if(s)
+		{
+			if(s->r)
+				s->r->destroy(s->pctx);
+			free(s);
+			pdat->buffer[i] = NULL;
+		}
+	}
+}
+
 static struct device_t * fb_sandbox_probe(struct driver_t * drv, struct dtnode_t * n)
 {
 	struct fb_sandbox_pdata_t * pdat;
@@ -134,6 +191,8 @@ static struct device_t * fb_sandbox_probe(struct driver_t * drv, struct dtnode_t
 	pdat->height = sandbox_fb_get_height(pdat->priv);
 	pdat->pwidth = dt_read_int(n, "physical-width", sandbox_fb_get_pwidth(pdat->priv));
 	pdat->pheight = dt_read_int(n, "physical-height", sandbox_fb_get_pheight(pdat->priv));
+	pdat->buffer[0] = NULL;
+	pdat->buffer[1] = NULL;
 
 	fb->name = alloc_device_name(dt_read_name(n), dt_read_id(n));
 	fb->width = pdat->width;
@@ -145,6 +204,8 @@ static struct device_t * fb_sandbox_probe(struct driver_t * drv, struct dtnode_t
 	fb->create = fb_create;
 	fb->destroy = fb_destroy;
 	fb->present = fb_present;
+	fb->buffer = (sandbox_fb_get_buffers(pdat->priv) >= 2) ? fb_buffer : NULL;
+	fb->flip = fb_flip;
 	fb->priv = pdat;
 
 	if(!(dev = register_framebuffer(fb, drv)))
@@ -166,6 +227,7 @@ static void fb_sandbox_remove(struct device_t * dev)
 	if(fb)
 	{
 		unregister_framebuffer(fb);
+		fb_buffer_free(pdat);
 		sandbox_fb_close(pdat->priv);
 		free_device_name(fb->name);
 		free(fb->priv);
@@ -48,13 +48,21 @@ void * sandbox_fb_open(const char * dev)
 	ctx->vi.transp.length = 8;
 	ctx->vi.bits_per_pixel = 32;
 	ctx->vi.nonstd = 0;
+	ctx->vi.xoffset = 0;
+	ctx->vi.yoffset = 0;
+	ctx->vi.yres_virtual = ctx->vi.yres * 2;
 
 	if(ioctl(ctx->fd, FBIOPUT_VSCREENINFO, &ctx->vi) != 0)
 	{
-		close(ctx->fd);
-		free(ctx);
-		return NULL;
+		ctx->vi.yres_virtual = ctx->vi.yres;
+		if(ioctl(ctx->fd, FBIOPUT_VSCREENINFO, &ctx->vi) != 0)
+		{
+			close(ctx->fd);
+			free(ctx);
+			return NULL;
+		}
 	}
+	ioctl(ctx->fd, FBIOGET_FSCREENINFO, &ctx->fi);
 
 	ctx->vramsz = ctx->vi.yres_virtual * ctx->fi.line_length;
 	ctx->vram = mmap(0, ctx->vramsz, PROT_READ | PROT_WRITE, MAP_SHARED, ctx->fd, 0);
@@ -120,8 +128,8 @@ int sandbox_fb_surface_create(void * context, struct sandbox_fb_surface_t * surf
 	surface->width = ctx->vi.xres;
 	surface->height = ctx->vi.yres;
 	surface->stride = ctx->fi.line_length;
-	surface->pixlen = ctx->vramsz;
-	surface->pixels = memalign(4, ctx->vramsz);
+	surface->pixlen = ctx->vi.yres * ctx->fi.line_length;
+	surface->pixels = memalign(4, surface->pixlen);
 	return 1;
 }
 
@@ -168,6 +176,37 @@ int sandbox_fb_surface_present(void * context, struct sandbox_fb_surface_t * sur
 	return 1;
 }
 
+int sandbox_fb_get_buffers(void * context)
+{
+	struct sandbox_fb_context_t * ctx = (struct sandbox_fb_context_t *)context;
+	if(ctx && (ctx->vi.yres > 0) && (ctx->fi.ypanstep > 0) && (ctx->fi.line_length == ctx->vi.xres * 4))
+		return ctx->vi.yres_virtual / ctx->vi.yres;
+	return 0;
+}
+
+void * sandbox_fb_get_buffer(void * context, int index)
+{
+	struct sandbox_fb_context_t * ctx = (struct sandbox_fb_context_t *)context;
+	if((index >= 0) && (index < sandbox_fb_get_buffers(ctx)))
+		return (unsigned char *)ctx->vram + index * ctx->vi.yres * ctx->fi.line_length;
+	return NULL;
+}
+
+int sandbox_fb_flip(void * context, int index)
+{
+	struct sandbox_fb_context_t * ctx = (struct sandbox_fb_context_t *)context;
+	int crtc = 0;
+
+	if((index < 0) || (index >= sandbox_fb_get_buffers(ctx)))
+		return 0;
+	ctx->vi.xoffset = 0;
+	ctx->vi.yoffset = index * ctx->vi.yres;
+	if(ioctl(ctx->fd, FBIOPAN_DISPLAY, &ctx->vi) != 0)
+		return 0;
+	ioctl(ctx->fd, FBIO_WAITFORVSYNC, &crtc);
+	return 1;
+}
+
 void sandbox_fb_set_backlight(void * context, int brightness)
 {
 }
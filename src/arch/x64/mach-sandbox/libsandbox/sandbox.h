@@ -122,6 +122,9 @@ int sandbox_fb_get_pheight(void * context);
 int sandbox_fb_surface_create(void * context, struct sandbox_fb_surface_t * surface);
 int sandbox_fb_surface_destroy(void * context, struct sandbox_fb_surface_t * surface);
 int sandbox_fb_surface_present(void * context, struct sandbox_fb_surface_t * surface, struct sandbox_fb_region_list_t * rl);
+int sandbox_fb_get_buffers(void * context);
+void * sandbox_fb_get_buffer(void * context, int index);
+int sandbox_fb_flip(void * context, int index);
 void sandbox_fb_set_backlight(void * context, int brightness);
 int sandbox_fb_get_backlight(void * context);
 
@@ -152,6 +155,8 @@ void sandbox_file_walk(const char * path, void (*cb)(const char * dir, const cha
 ssize_t sandbox_file_read(int fd, void * buf, size_t count);
 ssize_t sandbox_file_read_nonblock(int fd, void * buf, size_t count);
 ssize_t sandbox_file_write(int fd, const void * buf, size_t count);
+ssize_t sandbox_file_pread(int fd, void * buf, size_t count, int64_t offset);
+ssize_t sandbox_file_pwrite(int fd, const void * buf, size_t count, int64_t offset);
 int64_t sandbox_file_seek(int fd, int64_t offset);
 int64_t sandbox_file_tell(int fd);
 int64_t sandbox_file_length(int fd);
@@ -44,13 +44,14 @@ static u64_t blk_romdisk_read(struct block_t * blk, u8_t * buf, u64_t blkno, u64
 	return blkcnt;
 }
 
-static u64_t blk_romdisk_write(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t blkcnt)
+static void blk_romdisk_sync(struct block_t * blk)
 {
-	return 0;
 }
 
-static void blk_romdisk_sync(struct block_t * blk)
+static const void * blk_romdisk_mmap(struct block_t * blk, u64_t blkno, u64_t blkcnt)
 {
+	struct blk_romdisk_pdata_t * pdat = (struct blk_romdisk_pdata_t *)(blk->priv);
+	return (const void *)(pdat->addr + block_offset(blk, blkno));
 }
 
 static struct device_t * blk_romdisk_probe(struct driver_t * drv, struct dtnode_t * n)
@@ -84,8 +85,9 @@ static struct device_t * blk_romdisk_probe(struct driver_t * drv, struct dtnode_
 	blk->blksz	= blksz;
 	blk->blkcnt	= blkcnt;
 	blk->read = blk_romdisk_read;
-	blk->write = blk_romdisk_write;
+	blk->write = NULL;
 	blk->sync = blk_romdisk_sync;
+	blk->mmap = blk_romdisk_mmap;
 	blk->priv = pdat;
 
 	if(!(dev = register_block(blk, drv)))
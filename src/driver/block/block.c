@@ -73,6 +73,598 @@ static void sub_block_sync(struct block_t * blk)
 	pblk->sync(pblk);
 }
 
+static const void * sub_block_mmap(struct block_t * blk, u64_t blkno, u64_t blkcnt)
+{
+	struct sub_block_pdata_t * pdat = (struct sub_block_pdata_t *)(blk->priv);
+	struct block_t * pblk = pdat->pblk;
+	return pblk->mmap ? pblk->mmap(pblk, blkno + pdat->blkno, blkcnt) : NULL;
+}
+
+#define BLOCK_CACHE_STREAMS		(8)
+
+struct block_buffer_t
+{
+	struct hlist_node node;
+	struct list_head lru;
+	struct list_head wlist;
+	struct block_t * blk;
+	u64_t blkno;
+	u8_t * data;
+	int dirty;
+	int ref;
+};
+
+/*
+ * A sequential reader, each open file scanning through the device shows up
+ * as its own stream. The window is the read-ahead size in blocks, it starts
+ * on the second sequential miss and doubles on every following one.
+ */
+struct block_stream_t
+{
+	struct block_t * root;
+	u64_t next;
+	u64_t window;
+	u64_t stamp;
+};
+
+/*
+ * The lock of the root block device serializes everything done to its
+ * buffers, device io included. The cache lock only guards the hash, the
+ * lru and the accounting and is never held across device io, buffers used
+ * without it are pinned with ref so eviction leaves them alone.
+ */
+struct block_cache_t
+{
+	struct hlist_head hash[CONFIG_BLOCK_CACHE_HASH_SIZE];
+	struct list_head lru;
+	struct block_stream_t stream[BLOCK_CACHE_STREAMS];
+	u64_t stamp;
+	struct mutex_t lock;
+	u64_t size;
+	u64_t ndirty;
+};
+
+static struct block_cache_t __block_cache;
+
+/*
+ * Partitions share the buffers of the device they live on, so a block is
+ * only ever cached once whichever block device it was accessed through.
+ */
+static inline struct block_t * block_root(struct block_t * blk, u64_t * blkno)
+{
+	struct sub_block_pdata_t * pdat;
+
+	while(blk->read == sub_block_read)
+	{
+		pdat = (struct sub_block_pdata_t *)(blk->priv);
+		*blkno += pdat->blkno;
+		blk = pdat->pblk;
+	}
+	return blk;
+}
+
+static inline struct hlist_head * block_cache_hash(struct block_t * root, u64_t blkno)
+{
+	return &__block_cache.hash[(blkno ^ ((unsigned long)root >> 4)) % CONFIG_BLOCK_CACHE_HASH_SIZE];
+}
+
+static struct block_buffer_t * block_cache_lookup(struct block_t * root, u64_t blkno)
+{
+	struct block_buffer_t * b;
+	struct hlist_node * n;
+
+	hlist_for_each_entry_safe(b, n, block_cache_hash(root, blkno), node)
+	{
+		if((b->blk == root) && (b->blkno == blkno))
+		{
+			list_move(&b->lru, &__block_cache.lru);
+			return b;
+		}
+	}
+	return NULL;
+}
+
+static inline void block_cache_mark_dirty(struct block_buffer_t * b)
+{
+	if(!b->dirty)
+	{
+		b->dirty = 1;
+		__block_cache.ndirty++;
+	}
+}
+
+static inline void block_cache_mark_clean(struct block_buffer_t * b)
+{
+	if(b->dirty)
+	{
+		b->dirty = 0;
+		__block_cache.ndirty--;
+	}
+}
+
+static inline void block_cache_put(struct block_buffer_t * b)
+{
+	mutex_lock(&__block_cache.lock);
+	b->ref--;
+	mutex_unlock(&__block_cache.lock);
+}
+
+/*
+ * Write back one pinned buffer, called with the device lock held
+ */
+static int block_cache_writeback(struct block_buffer_t * b)
+{
+	if(b->blk->write(b->blk, b->data, b->blkno, 1) != 1)
+		return 0;
+	b->blk->stat.wblk++;
+	mutex_lock(&__block_cache.lock);
+	block_cache_mark_clean(b);
+	mutex_unlock(&__block_cache.lock);
+	return 1;
+}
+
+static int block_buffer_cmp(const void * a, const void * b)
+{
+	struct block_buffer_t * ba = *((struct block_buffer_t **)a);
+	struct block_buffer_t * bb = *((struct block_buffer_t **)b);
+
+	if(ba->blkno != bb->blkno)
+		return (ba->blkno < bb->blkno) ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Write back the dirty buffers of a root device in block order, runs of
+ * adjacent blocks are gathered into one multi-block write of up to the
+ * read-ahead size. Called with the device lock held, buffers whose write
+ * fails stay dirty.
+ */
+static void block_cache_flush(struct block_t * root)
+{
+	struct block_buffer_t ** v;
+	struct block_buffer_t * pos, * n;
+	struct list_head wlist;
+	u64_t blksz = block_size(root);
+	u64_t max = CONFIG_BLOCK_READAHEAD_SIZE / blksz;
+	u8_t * buf;
+	int count = 0, i, j, k;
+
+	init_list_head(&wlist);
+	mutex_lock(&__block_cache.lock);
+	list_for_each_entry(pos, &__block_cache.lru, lru)
+	{
+		if(pos->dirty && (pos->blk == root))
+		{
+			pos->ref++;
+			list_add_tail(&pos->wlist, &wlist);
+			count++;
+		}
+	}
+	mutex_unlock(&__block_cache.lock);
+	if(count == 0)
+		return;
+
+	v = malloc(sizeof(struct block_buffer_t *) * count);
+	if(!v)
+	{
+		list_for_each_entry(pos, &wlist, wlist)
+			block_cache_writeback(pos);
+	}
+	else
+	{
+		i = 0;
+		list_for_each_entry(pos, &wlist, wlist)
+			v[i++] = pos;
+		qsort(v, count, sizeof(struct block_buffer_t *), block_buffer_cmp);
+		for(i = 0; i < count; i = j)
+		{
+			for(j = i + 1; (j < count) && (j - i < max) && (v[j]->blkno == v[j - 1]->blkno + 1); j++);
+			buf = (j - i > 1) ? malloc((j - i) * blksz) : NULL;
+			if(!buf)
+			{
+				for(k = i; k < j; k++)
+					block_cache_writeback(v[k]);
+				continue;
+			}
+			for(k = i; k < j; k++)
+				memcpy(&buf[(k - i) * blksz], v[k]->data, blksz);
+			if(root->write(root, buf, v[i]->blkno, j - i) == j - i)
+			{
+				root->stat.wblk += j - i;
+				mutex_lock(&__block_cache.lock);
+				for(k = i; k < j; k++)
+					block_cache_mark_clean(v[k]);
+				mutex_unlock(&__block_cache.lock);
+			}
+			free(buf);
+		}
+		free(v);
+	}
+
+	mutex_lock(&__block_cache.lock);
+	list_for_each_entry_safe(pos, n, &wlist, wlist)
+	{
+		list_del_init(&pos->wlist);
+		pos->ref--;
+	}
+	mutex_unlock(&__block_cache.lock);
+}
+
+static void block_cache_free(struct block_buffer_t * b)
+{
+	block_cache_mark_clean(b);
+	hlist_del(&b->node);
+	list_del(&b->lru);
+	__block_cache.size -= block_size(b->blk);
+	free(b->data);
+	free(b);
+}
+
+/*
+ * Evict clean and unpinned buffers, dirty ones are left to the flush of
+ * their own device, so the size limit is soft while they are pending.
+ */
+static void block_cache_shrink(u64_t size)
+{
+	struct block_buffer_t * pos, * n;
+
+	list_for_each_entry_safe_reverse(pos, n, &__block_cache.lru, lru)
+	{
+		if(__block_cache.size + size <= CONFIG_BLOCK_CACHE_SIZE)
+			break;
+		if((pos->ref == 0) && !pos->dirty)
+			block_cache_free(pos);
+	}
+}
+
+static struct block_buffer_t * block_cache_insert(struct block_t * root, u64_t blkno)
+{
+	struct block_buffer_t * b;
+	u64_t blksz = block_size(root);
+
+	if(blksz > CONFIG_BLOCK_CACHE_SIZE)
+		return NULL;
+	block_cache_shrink(blksz);
+
+	b = malloc(sizeof(struct block_buffer_t));
+	if(!b)
+		return NULL;
+	b->data = malloc(blksz);
+	if(!b->data)
+	{
+		free(b);
+		return NULL;
+	}
+	b->blk = root;
+	b->blkno = blkno;
+	b->dirty = 0;
+	b->ref = 0;
+	init_list_head(&b->wlist);
+	hlist_add_head(&b->node, block_cache_hash(root, blkno));
+	list_add(&b->lru, &__block_cache.lru);
+	__block_cache.size += blksz;
+
+	return b;
+}
+
+/*
+ * Account an access of n blocks at blkno to the stream it continues, or
+ * start a new stream in place of the least recently used one. Returns how
+ * many blocks to read ahead after the access, only misses trigger it.
+ */
+static u64_t block_cache_stream(struct block_t * root, u64_t blkno, u64_t n, int miss)
+{
+	struct block_stream_t * s, * victim = &__block_cache.stream[0];
+	u64_t max = CONFIG_BLOCK_READAHEAD_SIZE / block_size(root);
+	int i;
+
+	for(i = 0; i < BLOCK_CACHE_STREAMS; i++)
+	{
+		s = &__block_cache.stream[i];
+		if((s->root == root) && (blkno <= s->next) && (blkno + n >= s->next))
+		{
+			s->next = blkno + n;
+			s->stamp = ++__block_cache.stamp;
+			if(!miss)
+				return 0;
+			s->window = s->window ? min(s->window * 2, max) : min((u64_t)4, max);
+			return s->window;
+		}
+		if(s->stamp < victim->stamp)
+			victim = s;
+	}
+	victim->root = root;
+	victim->next = blkno + n;
+	victim->window = 0;
+	victim->stamp = ++__block_cache.stamp;
+	return 0;
+}
+
+/*
+ * Pull the uncached run starting at blkno into the cache with a single
+ * multi-block read, stopping at the first block that is already cached.
+ * Called with the device lock held.
+ */
+static void block_cache_readahead(struct block_t * blk, struct block_t * root, u64_t blkno, u64_t blkcnt)
+{
+	struct block_buffer_t * b;
+	u64_t blksz = block_size(root);
+	u64_t i, n;
+	u8_t * buf;
+
+	blkcnt = block_available_count(root, blkno, min(blkcnt, (u64_t)(CONFIG_BLOCK_CACHE_SIZE / 4 / blksz)));
+	mutex_lock(&__block_cache.lock);
+	for(n = 0; (n < blkcnt) && !block_cache_lookup(root, blkno + n); n++);
+	mutex_unlock(&__block_cache.lock);
+	if(n == 0)
+		return;
+	buf = malloc(n * blksz);
+	if(!buf)
+		return;
+	if(root->read(root, buf, blkno, n) == n)
+	{
+		blk->stat.rblk += n;
+		mutex_lock(&__block_cache.lock);
+		for(i = 0; i < n; i++)
+		{
+			b = block_cache_insert(root, blkno + i);
+			if(!b)
+				break;
+			memcpy(b->data, &buf[i * blksz], blksz);
+		}
+		mutex_unlock(&__block_cache.lock);
+	}
+	free(buf);
+}
+
+/*
+ * Look a block up, on a miss allocate a buffer and fill it from the device
+ * unless the caller is about to overwrite all of it. Called with the device
+ * lock held, the buffer is returned pinned and statistics are charged to the
+ * block device used by the caller.
+ */
+static struct block_buffer_t * block_cache_get(struct block_t * blk, struct block_t * root, u64_t blkno, int fill)
+{
+	struct block_buffer_t * b;
+	u64_t ra = 0;
+
+	mutex_lock(&__block_cache.lock);
+	b = block_cache_lookup(root, blkno);
+	if(b)
+	{
+		blk->stat.hit++;
+		block_cache_stream(root, blkno, 1, 0);
+		b->ref++;
+		mutex_unlock(&__block_cache.lock);
+		return b;
+	}
+	blk->stat.miss++;
+	b = block_cache_insert(root, blkno);
+	if(b)
+	{
+		b->ref++;
+		if(fill)
+			ra = block_cache_stream(root, blkno, 1, 1);
+	}
+	mutex_unlock(&__block_cache.lock);
+
+	if(b && fill)
+	{
+		if(root->read(root, b->data, blkno, 1) != 1)
+		{
+			mutex_lock(&__block_cache.lock);
+			block_cache_free(b);
+			mutex_unlock(&__block_cache.lock);
+			return NULL;
+		}
+		blk->stat.rblk++;
+		if(ra > 0)
+			block_cache_readahead(blk, root, blkno + 1, ra);
+	}
+	return b;
+}
+
+/*
+ * Keep dirty data bounded, once half of the cache is waiting for the device
+ * write back everything of this device instead of letting it pile up.
+ */
+static inline void block_cache_balance_dirty(struct block_t * root)
+{
+	if(__block_cache.ndirty * block_size(root) > CONFIG_BLOCK_CACHE_SIZE / 2)
+		block_cache_flush(root);
+}
+
+static int block_cache_copy_out(struct block_t * blk, u64_t blkno, u64_t off, u8_t * buf, u64_t len)
+{
+	struct block_buffer_t * b;
+	struct block_t * root = block_root(blk, &blkno);
+
+	mutex_lock(&root->lock);
+	b = block_cache_get(blk, root, blkno, 1);
+	if(b)
+	{
+		memcpy(buf, &b->data[off], len);
+		block_cache_put(b);
+	}
+	mutex_unlock(&root->lock);
+
+	return b ? 1 : 0;
+}
+
+static int block_cache_copy_in(struct block_t * blk, u64_t blkno, u64_t off, u8_t * buf, u64_t len)
+{
+	struct block_buffer_t * b;
+	struct block_t * root = block_root(blk, &blkno);
+
+	mutex_lock(&root->lock);
+	b = block_cache_get(blk, root, blkno, (len < block_size(blk)) ? 1 : 0);
+	if(b)
+	{
+		memcpy(&b->data[off], buf, len);
+		mutex_lock(&__block_cache.lock);
+		block_cache_mark_dirty(b);
+		b->ref--;
+		mutex_unlock(&__block_cache.lock);
+		block_cache_balance_dirty(root);
+	}
+	mutex_unlock(&root->lock);
+
+	return b ? 1 : 0;
+}
+
+/*
+ * Whole block reads, cached blocks are copied out and the missing runs are
+ * read straight into the caller's buffer. Runs of a streaming sized request
+ * are not kept, so large file reads do not wipe out the metadata.
+ */
+static u64_t block_cache_read(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t blkcnt)
+{
+	struct block_buffer_t * b;
+	struct block_t * root = block_root(blk, &blkno);
+	u64_t blksz = block_size(blk);
+	u64_t i = 0, j, n, ra;
+	int stream = (blkcnt * blksz >= CONFIG_BLOCK_CACHE_STREAM_SIZE) ? 1 : 0;
+	int miss = 0;
+
+	mutex_lock(&root->lock);
+	mutex_lock(&__block_cache.lock);
+	while(i < blkcnt)
+	{
+		b = block_cache_lookup(root, blkno + i);
+		if(b)
+		{
+			blk->stat.hit++;
+			memcpy(&buf[i * blksz], b->data, blksz);
+			i++;
+			continue;
+		}
+		for(n = 1; (i + n < blkcnt) && !block_cache_lookup(root, blkno + i + n); n++);
+		blk->stat.miss += n;
+		miss = 1;
+		mutex_unlock(&__block_cache.lock);
+		j = root->read(root, &buf[i * blksz], blkno + i, n);
+		mutex_lock(&__block_cache.lock);
+		if(j != n)
+			break;
+		blk->stat.rblk += n;
+		if(!stream)
+		{
+			for(j = 0; j < n; j++)
+			{
+				b = block_cache_insert(root, blkno + i + j);
+				if(b)
+					memcpy(b->data, &buf[(i + j) * blksz], blksz);
+			}
+		}
+		i += n;
+	}
+	ra = block_cache_stream(root, blkno, i, miss && !stream);
+	mutex_unlock(&__block_cache.lock);
+	if(ra > 0)
+		block_cache_readahead(blk, root, blkno + i, ra);
+	mutex_unlock(&root->lock);
+
+	return i;
+}
+
+/*
+ * Whole block writes, small ones are absorbed by the cache and written back
+ * later, streaming sized ones go through to the device and only refresh the
+ * copies that happen to be cached. Copies are refreshed once the device has
+ * taken the blocks, those beyond a short write keep their old, maybe dirty,
+ * contents.
+ */
+static u64_t block_cache_write(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t blkcnt)
+{
+	struct block_buffer_t * b;
+	struct block_t * root;
+	u64_t blksz = block_size(blk);
+	u64_t i, n = 0;
+
+	if(blkcnt * blksz < CONFIG_BLOCK_CACHE_STREAM_SIZE)
+	{
+		for(i = 0; i < blkcnt; i++)
+		{
+			if(!block_cache_copy_in(blk, blkno + i, 0, &buf[i * blksz], blksz))
+			{
+				if(blk->write(blk, &buf[i * blksz], blkno + i, 1) != 1)
+					break;
+				blk->stat.wblk++;
+			}
+		}
+		return i;
+	}
+
+	root = block_root(blk, &blkno);
+	mutex_lock(&root->lock);
+	n = root->write(root, buf, blkno, blkcnt);
+	blk->stat.wblk += n;
+	mutex_lock(&__block_cache.lock);
+	for(i = 0; i < n; i++)
+	{
+		b = block_cache_lookup(root, blkno + i);
+		if(b)
+		{
+			memcpy(b->data, &buf[i * blksz], blksz);
+			block_cache_mark_clean(b);
+		}
+	}
+	mutex_unlock(&__block_cache.lock);
+	mutex_unlock(&root->lock);
+
+	return n;
+}
+
+static ssize_t block_read_cache(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct block_t * blk = (struct block_t *)kobj->priv;
+	struct block_stat_t * stat = &blk->stat;
+	u64_t total = stat->hit + stat->miss;
+	u64_t rate = total ? (stat->hit * 10000 / total) : 0;
+	char * p = buf;
+	int len = 0;
+
+	len += sprintf((char *)(p + len), " hit: %lld\r\n", stat->hit);
+	len += sprintf((char *)(p + len), " miss: %lld\r\n", stat->miss);
+	len += sprintf((char *)(p + len), " hit rate: %lld.%02lld%%\r\n", rate / 100, rate % 100);
+	len += sprintf((char *)(p + len), " read blocks: %lld\r\n", stat->rblk);
+	len += sprintf((char *)(p + len), " write blocks: %lld\r\n", stat->wblk);
+	return len;
+}
+
+static struct kobj_t * search_class_memory_kobj(void)
+{
+	struct kobj_t * kclass = kobj_search_directory_with_create(kobj_get_root(), "class");
+	return kobj_search_directory_with_create(kclass, "memory");
+}
+
+static ssize_t memory_read_bcacheinfo(struct kobj_t * kobj, void * buf, size_t size)
+{
+	char * p = buf;
+	int len = 0;
+
+	len += sprintf((char *)(p + len), " block cache size: %lld\r\n", (u64_t)CONFIG_BLOCK_CACHE_SIZE);
+	len += sprintf((char *)(p + len), " block cache used: %lld\r\n", __block_cache.size);
+	len += sprintf((char *)(p + len), " block cache dirty: %lld\r\n", __block_cache.ndirty);
+	return len;
+}
+
+static __init void block_cache_pure_init(void)
+{
+	int i;
+
+	for(i = 0; i < CONFIG_BLOCK_CACHE_HASH_SIZE; i++)
+		init_hlist_head(&__block_cache.hash[i]);
+	init_list_head(&__block_cache.lru);
+	memset(&__block_cache.stream[0], 0, sizeof(__block_cache.stream));
+	__block_cache.stamp = 0;
+	mutex_init(&__block_cache.lock);
+	__block_cache.size = 0;
+	__block_cache.ndirty = 0;
+	kobj_add_regular(search_class_memory_kobj(), "bcacheinfo", memory_read_bcacheinfo, NULL, NULL);
+}
+pure_initcall(block_cache_pure_init);
+
 struct block_t * search_block(const char * name)
 {
 	struct device_t * dev;
@@ -90,7 +682,7 @@ struct device_t * register_block(struct block_t * blk, struct driver_t * drv)
 	if(!blk || !blk->name)
 		return NULL;
 
-	if(!blk->read || !blk->write || !blk->sync)
+	if(!blk->read || !blk->sync)
 		return NULL;
 
 	dev = malloc(sizeof(struct device_t));
@@ -105,6 +697,9 @@ struct device_t * register_block(struct block_t * blk, struct driver_t * drv)
 	kobj_add_regular(dev->kobj, "size", block_read_size, NULL, blk);
 	kobj_add_regular(dev->kobj, "count", block_read_count, NULL, blk);
 	kobj_add_regular(dev->kobj, "capacity", block_read_capacity, NULL, blk);
+	kobj_add_regular(dev->kobj, "cache", block_read_cache, NULL, blk);
+	memset(&blk->stat, 0, sizeof(struct block_stat_t));
+	mutex_init(&blk->lock);
 
 	if(!register_device(dev))
 	{
@@ -118,10 +713,22 @@ struct device_t * register_block(struct block_t * blk, struct driver_t * drv)
 
 void unregister_block(struct block_t * blk)
 {
+	struct block_buffer_t * pos, * n;
 	struct device_t * dev;
 
 	if(blk && blk->name)
 	{
+		mutex_lock(&blk->lock);
+		block_cache_flush(blk);
+		mutex_lock(&__block_cache.lock);
+		list_for_each_entry_safe(pos, n, &__block_cache.lru, lru)
+		{
+			if(pos->blk == blk)
+				block_cache_free(pos);
+		}
+		mutex_unlock(&__block_cache.lock);
+		mutex_unlock(&blk->lock);
+
 		dev = search_device(blk->name, DEVICE_TYPE_BLOCK);
 		if(dev && unregister_device(dev))
 		{
@@ -173,8 +780,9 @@ struct device_t * register_sub_block(struct block_t * pblk, u64_t offset, u64_t
 	blk->blksz = blksz;
 	blk->blkcnt = blkcnt;
 	blk->read = sub_block_read;
-	blk->write = sub_block_write;
+	blk->write = pblk->write ? sub_block_write : NULL;
 	blk->sync = sub_block_sync;
+	blk->mmap = sub_block_mmap;
 	blk->priv = pdat;
 
 	if(!(dev = register_block(blk, NULL)))
@@ -213,12 +821,35 @@ void unregister_sub_block(struct block_t * pblk)
 	}
 }
 
+/*
+ * Direct pointer to a byte range of a memory backed device, the range
+ * must lie within the device, there is no cache in between
+ */
+const void * block_mmap(struct block_t * blk, u64_t offset, u64_t count)
+{
+	u64_t blksz, blkno, blkcnt;
+	const u8_t * p;
+
+	if(!blk || !blk->mmap || !count)
+		return NULL;
+
+	blksz = block_size(blk);
+	if(!blksz || (offset >= block_capacity(blk)) || (count > block_capacity(blk) - offset))
+		return NULL;
+
+	blkno = offset / blksz;
+	blkcnt = (offset + count + blksz - 1) / blksz - blkno;
+	p = blk->mmap(blk, blkno, blkcnt);
+	if(!p)
+		return NULL;
+	return p + (offset % blksz);
+}
+
 u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 {
 	u64_t blkno, blksz, blkcnt, capacity;
 	u64_t len, tmp;
 	u64_t ret = 0;
-	u8_t * p;
 
 	if(!blk || !buf || !count)
 		return 0;
@@ -236,10 +867,6 @@ u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 	if(count > tmp)
 		count = tmp;
 
-	p = malloc(blksz);
-	if(!p)
-		return 0;
-
 	blkno = offset / blksz;
 	tmp = offset % blksz;
 	if(tmp > 0)
@@ -248,13 +875,9 @@ u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 		if(count < len)
 			len = count;
 
-		if(blk->read(blk, p, blkno, 1) != 1)
-		{
-			free(p);
+		if(!block_cache_copy_out(blk, blkno, tmp, buf, len))
 			return ret;
-		}
 
-		memcpy((void *)buf, (const void *)(&p[tmp]), len);
 		buf += len;
 		count -= len;
 		ret += len;
@@ -266,11 +889,8 @@ u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 	{
 		len = tmp * blksz;
 
-		if(blk->read(blk, buf, blkno, tmp) != tmp)
-		{
-			free(p);
+		if(block_cache_read(blk, buf, blkno, tmp) != tmp)
 			return ret;
-		}
 
 		buf += len;
 		count -= len;
@@ -282,17 +902,12 @@ u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 	{
 		len = count;
 
-		if(blk->read(blk, p, blkno, 1) != 1)
-		{
-			free(p);
+		if(!block_cache_copy_out(blk, blkno, 0, buf, len))
 			return ret;
-		}
 
-		memcpy((void *)buf, (const void *)(&p[0]), len);
 		ret += len;
 	}
 
-	free(p);
 	return ret;
 }
 
@@ -301,9 +916,8 @@ u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 	u64_t blkno, blksz, blkcnt, capacity;
 	u64_t len, tmp;
 	u64_t ret = 0;
-	u8_t * p;
 
-	if(!blk || !buf || !count)
+	if(!blk || !blk->write || !buf || !count)
 		return 0;
 
 	blksz = block_size(blk);
@@ -319,10 +933,6 @@ u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 	if(count > tmp)
 		count = tmp;
 
-	p = malloc(blksz);
-	if(!p)
-		return 0;
-
 	blkno = offset / blksz;
 	tmp = offset % blksz;
 	if(tmp > 0)
@@ -331,19 +941,8 @@ u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 		if(count < len)
 			len = count;
 
-		if(blk->read(blk, p, blkno, 1) != 1)
-		{
-			free(p);
-			return ret;
-		}
-
-		memcpy((void *)(&p[tmp]), (const void *)buf, len);
-
-		if(blk->write(blk, p, blkno, 1) != 1)
-		{
-			free(p);
+		if(!block_cache_copy_in(blk, blkno, tmp, buf, len))
 			return ret;
-		}
 
 		buf += len;
 		count -= len;
@@ -356,11 +955,8 @@ u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 	{
 		len = tmp * blksz;
 
-		if(blk->write(blk, buf, blkno, tmp) != tmp)
-		{
-			free(p);
+		if(block_cache_write(blk, buf, blkno, tmp) != tmp)
 			return ret;
-		}
 
 		buf += len;
 		count -= len;
@@ -372,29 +968,27 @@ u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 	{
 		len = count;
 
-		if(blk->read(blk, p, blkno, 1) != 1)
-		{
-			free(p);
-			return ret;
-		}
-
-		memcpy((void *)(&p[0]), (const void *)buf, len);
-
-		if(blk->write(blk, p, blkno, 1) != 1)
-		{
-			free(p);
+		if(!block_cache_copy_in(blk, blkno, 0, buf, len))
 			return ret;
-		}
 
 		ret += len;
 	}
 
-	free(p);
 	return ret;
 }
 
 void block_sync(struct block_t * blk)
 {
-	if(blk && blk->sync)
-		blk->sync(blk);
+	struct block_t * root;
+	u64_t blkno = 0;
+
+	if(blk)
+	{
+		root = block_root(blk, &blkno);
+		mutex_lock(&root->lock);
+		block_cache_flush(root);
+		mutex_unlock(&root->lock);
+		if(blk->sync)
+			blk->sync(blk);
+	}
 }
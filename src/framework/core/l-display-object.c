@@ -386,6 +386,15 @@ function M:getTouchable()
 	return self._dobj:getTouchable()
 end
 
+function M:setCacheAsBitmap(enable)
+	self._dobj:setCacheAsBitmap(enable)
+	return self
+end
+
+function M:getCacheAsBitmap()
+	return self._dobj:getCacheAsBitmap()
+end
+
 function M:globalToLocal(x, y)
 	return self._dobj:globalToLocal(x, y)
 end
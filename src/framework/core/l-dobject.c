@@ -44,6 +44,7 @@ enum {
 	MFLAG_GLOBAL_MATRIX				= (0x1 << 6),
 	MFLAG_GLOBAL_BOUNDS				= (0x1 << 7),
 	MFLAG_DIRTY						= (0x1 << 8),
+	MFLAG_CACHE						= (0x1 << 9),
 };
 
 static inline struct matrix_t * dobject_local_matrix(struct ldobject_t * o)
@@ -170,6 +171,15 @@ static void dobject_mark_children(struct ldobject_t * o, int mark)
 	}
 }
 
+static inline void dobject_mark_cache(struct ldobject_t * o)
+{
+	for(; o; o = o->parent)
+	{
+		if(o->cache.enable)
+			o->mflag |= MFLAG_CACHE;
+	}
+}
+
 static inline void dobject_mark_dirty(struct ldobject_t * o)
 {
 	if(!(o->mflag & MFLAG_DIRTY))
@@ -177,6 +187,7 @@ static inline void dobject_mark_dirty(struct ldobject_t * o)
 		region_clone(&o->dirty_bounds, dobject_global_bounds(o));
 		o->mflag |= MFLAG_DIRTY;
 	}
+	dobject_mark_cache(o->parent);
 }
 
 enum layout_direction_t {
@@ -768,94 +779,93 @@ static void dobject_layout(struct ldobject_t * o)
 	}
 }
 
-static void dobject_draw_image(struct ldobject_t * o, struct window_t * w)
+static void dobject_draw_image(struct ldobject_t * o, struct surface_t * s, struct matrix_t * m, struct region_t * clip)
 {
 	struct limage_t * img = o->priv;
-	surface_blit(w->s, dobject_parent_global_bounds(o), dobject_global_matrix(o), img->s, RENDER_TYPE_GOOD);
+	surface_blit(s, clip, m, img->s, RENDER_TYPE_GOOD);
 }
 
-static void dobject_draw_ninepatch(struct ldobject_t * o, struct window_t * w)
+static void dobject_draw_ninepatch(struct ldobject_t * o, struct surface_t * s, struct matrix_t * m, struct region_t * clip)
 {
 	struct lninepatch_t * ninepatch = o->priv;
-	struct surface_t * s = w->s;
-	struct matrix_t m;
+	struct matrix_t t;
 	if(ninepatch->lt)
 	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, 0, 0);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->lt, RENDER_TYPE_FAST);
+		memcpy(&t, m, sizeof(struct matrix_t));
+		matrix_translate(&t, 0, 0);
+		surface_blit(s, clip, &t, ninepatch->lt, RENDER_TYPE_FAST);
 	}
 	if(ninepatch->mt)
 	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, ninepatch->left, 0);
-		matrix_scale(&m, ninepatch->__sx, 1);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->mt, RENDER_TYPE_FAST);
+		memcpy(&t, m, sizeof(struct matrix_t));
+		matrix_translate(&t, ninepatch->left, 0);
+		matrix_scale(&t, ninepatch->__sx, 1);
+		surface_blit(s, clip, &t, ninepatch->mt, RENDER_TYPE_FAST);
 	}
 	if(ninepatch->rt)
 	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, ninepatch->__w - ninepatch->right, 0);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->rt, RENDER_TYPE_FAST);
+		memcpy(&t, m, sizeof(struct matrix_t));
+		matrix_translate(&t, ninepatch->__w - ninepatch->right, 0);
+		surface_blit(s, clip, &t, ninepatch->rt, RENDER_TYPE_FAST);
 	}
 	if(ninepatch->lm)
 	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, 0, ninepatch->top);
-		matrix_scale(&m, 1, ninepatch->__sy);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->lm, RENDER_TYPE_FAST);
+		memcpy(&t, m, sizeof(struct matrix_t));
+		matrix_translate(&t, 0, ninepatch->top);
+		matrix_scale(&t, 1, ninepatch->__sy);
+		surface_blit(s, clip, &t, ninepatch->lm, RENDER_TYPE_FAST);
 	}
 	if(ninepatch->mm)
 	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, ninepatch->left, ninepatch->top);
-		matrix_scale(&m, ninepatch->__sx, ninepatch->__sy);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->mm, RENDER_TYPE_FAST);
+		memcpy(&t, m, sizeof(struct matrix_t));
+		matrix_translate(&t, ninepatch->left, ninepatch->top);
+		matrix_scale(&t, ninepatch->__sx, ninepatch->__sy);
+		surface_blit(s, clip, &t, ninepatch->mm, RENDER_TYPE_FAST);
 	}
 	if(ninepatch->rm)
 	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, ninepatch->__w - ninepatch->right, ninepatch->top);
-		matrix_scale(&m, 1, ninepatch->__sy);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->rm, RENDER_TYPE_FAST);
+		memcpy(&t, m, sizeof(struct matrix_t));
+		matrix_translate(&t, ninepatch->__w - ninepatch->right, ninepatch->top);
+		matrix_scale(&t, 1, ninepatch->__sy);
+		surface_blit(s, clip, &t, ninepatch->rm, RENDER_TYPE_FAST);
 	}
 	if(ninepatch->lb)
 	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, 0, ninepatch->__h - ninepatch->bottom);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->lb, RENDER_TYPE_FAST);
+		memcpy(&t, m, sizeof(struct matrix_t));
+		matrix_translate(&t, 0, ninepatch->__h - ninepatch->bottom);
+		surface_blit(s, clip, &t, ninepatch->lb, RENDER_TYPE_FAST);
 	}
 	if(ninepatch->mb)
 	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, ninepatch->left, ninepatch->__h - ninepatch->bottom);
-		matrix_scale(&m, ninepatch->__sx, 1);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->mb, RENDER_TYPE_FAST);
+		memcpy(&t, m, sizeof(struct matrix_t));
+		matrix_translate(&t, ninepatch->left, ninepatch->__h - ninepatch->bottom);
+		matrix_scale(&t, ninepatch->__sx, 1);
+		surface_blit(s, clip, &t, ninepatch->mb, RENDER_TYPE_FAST);
 	}
 	if(ninepatch->rb)
 	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, ninepatch->__w - ninepatch->right, ninepatch->__h - ninepatch->bottom);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->rb, RENDER_TYPE_FAST);
+		memcpy(&t, m, sizeof(struct matrix_t));
+		matrix_translate(&t, ninepatch->__w - ninepatch->right, ninepatch->__h - ninepatch->bottom);
+		surface_blit(s, clip, &t, ninepatch->rb, RENDER_TYPE_FAST);
 	}
 }
 
-static void dobject_draw_text(struct ldobject_t * o, struct window_t * w)
+static void dobject_draw_text(struct ldobject_t * o, struct surface_t * s, struct matrix_t * m, struct region_t * clip)
 {
 	struct ltext_t * text = o->priv;
-	surface_text(w->s, dobject_parent_global_bounds(o), dobject_global_matrix(o), text->txt);
+	surface_text(s, clip, m, text->txt);
 }
 
-static void dobject_draw_container(struct ldobject_t * o, struct window_t * w)
+static void dobject_draw_container(struct ldobject_t * o, struct surface_t * s, struct matrix_t * m, struct region_t * clip)
 {
 	if(o->bgcolor.a != 0)
-		surface_fill(w->s, dobject_parent_global_bounds(o), dobject_global_matrix(o), o->width, o->height, &o->bgcolor, RENDER_TYPE_GOOD);
+		surface_fill(s, clip, m, o->width, o->height, &o->bgcolor, RENDER_TYPE_GOOD);
 }
 
 static int l_dobject_new(lua_State * L)
 {
 	enum dobject_type_t dtype;
-	void (*draw)(struct ldobject_t *, struct window_t *);
+	void (*draw)(struct ldobject_t *, struct surface_t *, struct matrix_t *, struct region_t *);
 	void * userdata;
 	double width = luaL_optnumber(L, 1, 0);
 	double height = luaL_optnumber(L, 2, 0);
@@ -921,6 +931,13 @@ static int l_dobject_new(lua_State * L)
 	matrix_init_identity(&o->global_matrix);
 	region_init(&o->global_bounds, o->x, o->y, o->width, o->height);
 	region_init(&o->dirty_bounds, o->x, o->y, o->width, o->height);
+	region_init(&o->tree_bounds, o->x, o->y, o->width, o->height);
+	o->cache.enable = 0;
+	o->cache.s = NULL;
+	matrix_init_identity(&o->cache.m);
+	region_init(&o->cache.r, 0, 0, 0, 0);
+	o->cache.width = 0;
+	o->cache.height = 0;
 	o->dtype = dtype;
 	o->draw = draw;
 	o->priv = userdata;
@@ -946,6 +963,11 @@ static int m_dobject_gc(lua_State * L)
 			o->hit.polygon.length = 0;
 		}
 	}
+	if(o->cache.s)
+	{
+		surface_free(o->cache.s);
+		o->cache.s = NULL;
+	}
 	return 0;
 }
 
@@ -960,6 +982,7 @@ static int m_add_child(lua_State * L)
 			dobject_mark_dirty(c);
 			c->parent = o;
 			list_add_tail(&c->entry, &o->children);
+			dobject_mark_cache(o);
 		}
 		else
 		{
@@ -1385,6 +1408,7 @@ static int m_set_background_color(lua_State * L)
 	if((o->bgcolor.r != c->r) || (o->bgcolor.g != c->g) || (o->bgcolor.b != c->b) || (o->bgcolor.a != c->a))
 	{
 		dobject_mark_dirty(o);
+		dobject_mark_cache(o);
 		memcpy(&o->bgcolor, c, sizeof(struct color_t));
 	}
 	return 0;
@@ -1858,6 +1882,30 @@ static int m_get_touchable(lua_State * L)
 	return 1;
 }
 
+static int m_set_cache_as_bitmap(lua_State * L)
+{
+	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
+	int enable = lua_toboolean(L, 2);
+	if(o->cache.enable != enable)
+	{
+		o->cache.enable = enable;
+		o->mflag |= MFLAG_CACHE;
+		if(!enable && o->cache.s)
+		{
+			surface_free(o->cache.s);
+			o->cache.s = NULL;
+		}
+	}
+	return 0;
+}
+
+static int m_get_cache_as_bitmap(lua_State * L)
+{
+	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
+	lua_pushboolean(L, o->cache.enable);
+	return 1;
+}
+
 static int m_global_to_local(lua_State * L)
 {
 	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
@@ -2026,6 +2074,7 @@ static int m_mark_dirty(lua_State * L)
 {
 	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
 	dobject_mark_dirty(o);
+	dobject_mark_cache(o);
 	return 0;
 }
 
@@ -2050,27 +2099,197 @@ static void window_region_list_fill(struct window_t * w, struct ldobject_t * o)
 		window_region_list_add(w, dobject_dirty_bounds(o));
 		o->mflag &= ~MFLAG_DIRTY;
 	}
+	region_clone(&o->tree_bounds, dobject_global_bounds(o));
 
 	list_for_each_entry(pos, &o->children, entry)
 	{
 		window_region_list_fill(w, pos);
+		if(pos->visible)
+			region_union(&o->tree_bounds, &o->tree_bounds, &pos->tree_bounds);
 	}
 }
 
-static void display_draw(struct window_t * w, struct ldobject_t * o)
+/*
+ * The pixels a container is sure to cover, an opaque background under an axis
+ * aligned matrix, inset to whole pixels because of antialiased edges.
+ */
+static int dobject_opaque_bounds(struct ldobject_t * o, struct region_t * r)
+{
+	struct matrix_t * m;
+	struct region_t * p;
+	double x1, y1, x2, y2, t;
+
+	if(!o->visible || (o->dtype != DOBJECT_TYPE_CONTAINER) || (o->bgcolor.a != 255))
+		return 0;
+	m = dobject_global_matrix(o);
+	if((m->b != 0) || (m->c != 0))
+		return 0;
+	x1 = m->tx;
+	y1 = m->ty;
+	x2 = m->tx + m->a * o->width;
+	y2 = m->ty + m->d * o->height;
+	if(x1 > x2)
+	{
+		t = x1;
+		x1 = x2;
+		x2 = t;
+	}
+	if(y1 > y2)
+	{
+		t = y1;
+		y1 = y2;
+		y2 = t;
+	}
+	region_init(r, ceil(x1), ceil(y1), floor(x2) - ceil(x1), floor(y2) - ceil(y1));
+	if(region_isempty(r))
+		return 0;
+	p = dobject_parent_global_bounds(o);
+	if(p && (!region_intersect(r, r, p) || region_isempty(r)))
+		return 0;
+	return 1;
+}
+
+static int dobject_occluded(struct ldobject_t * o, struct region_t * r)
+{
+	struct ldobject_t * pos = o;
+	struct region_t region;
+
+	if(!o->parent)
+		return 0;
+	list_for_each_entry_continue(pos, &o->parent->children, entry)
+	{
+		if(dobject_opaque_bounds(pos, &region) && region_contains(&region, r))
+			return 1;
+	}
+	return 0;
+}
+
+static void dobject_draw_offscreen(struct ldobject_t * o, struct surface_t * s, struct region_t * clip, int ox, int oy)
 {
 	struct ldobject_t * pos;
+	struct region_t r, * p;
+	struct matrix_t m;
 
-	if(o->visible)
+	if(!o->visible)
+		return;
+	memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
+	m.tx -= ox;
+	m.ty -= oy;
+	p = dobject_parent_global_bounds(o);
+	region_init(&r, p->x - ox, p->y - oy, p->w, p->h);
+	if(region_intersect(&r, &r, clip) && !region_isempty(&r))
+		o->draw(o, s, &m, &r);
+	list_for_each_entry(pos, &o->children, entry)
 	{
-		o->draw(o, w);
-		list_for_each_entry(pos, &o->children, entry)
+		dobject_draw_offscreen(pos, s, clip, ox, oy);
+	}
+}
+
+/*
+ * The cached bitmap holds the whole subtree drawn at its tree bounds. It stays
+ * valid while nothing inside is marked dirty, the object keeps its own size
+ * and the global matrix only moves by whole pixels, the bitmap is then blitted
+ * at the shifted position.
+ */
+static struct surface_t * dobject_cache_update(struct ldobject_t * o, int * x, int * y)
+{
+	struct matrix_t * m = dobject_global_matrix(o);
+	struct region_t * r = &o->tree_bounds;
+	struct ldobject_t * pos;
+	struct region_t clip;
+	struct matrix_t t;
+	double dx = m->tx - o->cache.m.tx;
+	double dy = m->ty - o->cache.m.ty;
+
+	if(o->cache.s && !(o->mflag & MFLAG_CACHE) && (m->a == o->cache.m.a) && (m->b == o->cache.m.b) && (m->c == o->cache.m.c) && (m->d == o->cache.m.d)
+		&& (dx == (int)dx) && (dy == (int)dy) && (r->w == o->cache.r.w) && (r->h == o->cache.r.h) && (o->width == o->cache.width) && (o->height == o->cache.height))
+	{
+		*x = o->cache.r.x + (int)dx;
+		*y = o->cache.r.y + (int)dy;
+		return o->cache.s;
+	}
+	if(region_isempty(r))
+		return NULL;
+	if(!o->cache.s || (surface_get_width(o->cache.s) != r->w) || (surface_get_height(o->cache.s) != r->h))
+	{
+		if(o->cache.s)
+			surface_free(o->cache.s);
+		o->cache.s = surface_alloc(r->w, r->h, NULL);
+		if(!o->cache.s)
+			return NULL;
+	}
+	else
+	{
+		surface_clear(o->cache.s, NULL, 0, 0, 0, 0);
+	}
+	memcpy(&o->cache.m, m, sizeof(struct matrix_t));
+	region_clone(&o->cache.r, r);
+	o->cache.width = o->width;
+	o->cache.height = o->height;
+	region_init(&clip, 0, 0, r->w, r->h);
+	memcpy(&t, &o->cache.m, sizeof(struct matrix_t));
+	t.tx -= r->x;
+	t.ty -= r->y;
+	o->draw(o, o->cache.s, &t, &clip);
+	list_for_each_entry(pos, &o->children, entry)
+	{
+		dobject_draw_offscreen(pos, o->cache.s, &clip, r->x, r->y);
+	}
+	o->mflag &= ~MFLAG_CACHE;
+	*x = r->x;
+	*y = r->y;
+	return o->cache.s;
+}
+
+static void display_draw_tree(struct window_t * w, struct ldobject_t * o, struct region_t * clip)
+{
+	struct ldobject_t * pos;
+	struct surface_t * cs;
+	struct region_t r, * p;
+	struct matrix_t m;
+	int x, y;
+
+	if(!o->visible)
+		return;
+	if(!region_intersect(&r, &o->tree_bounds, clip) || region_isempty(&r))
+		return;
+	if(CONFIG_DOBJECT_OCCLUSION && dobject_occluded(o, &r))
+		return;
+	p = dobject_parent_global_bounds(o);
+	if(p && (!region_intersect(&r, p, clip) || region_isempty(&r)))
+		p = NULL;
+	else
+		p = p ? &r : clip;
+	if(o->cache.enable && (cs = dobject_cache_update(o, &x, &y)))
+	{
+		if(p)
 		{
-			display_draw(w, pos);
+			matrix_init_translate(&m, x, y);
+			surface_blit(w->s, p, &m, cs, RENDER_TYPE_FAST);
 		}
+		return;
+	}
+	if(p)
+		o->draw(o, w->s, dobject_global_matrix(o), p);
+	list_for_each_entry(pos, &o->children, entry)
+	{
+		display_draw_tree(w, pos, clip);
 	}
 }
 
+/*
+ * Draw the tree once for each dirty region, skipping the subtrees outside of
+ * it. The regions handed over by window_present never overlap.
+ */
+static void display_draw(struct window_t * w, struct ldobject_t * o)
+{
+	struct region_list_t * rl = w->rl;
+	int i;
+
+	for(i = 0; i < rl->count; i++)
+		display_draw_tree(w, o, &rl->region[i]);
+}
+
 static int m_render(lua_State * L)
 {
 	static struct color_t c = { .r = 255, .g = 255, .b = 255, .a = 255 };
@@ -2148,6 +2367,8 @@ static const luaL_Reg m_dobject[] = {
 	{"getVisible",			m_get_visible},
 	{"setTouchable",		m_set_touchable},
 	{"getTouchable",		m_get_touchable},
+	{"setCacheAsBitmap",	m_set_cache_as_bitmap},
+	{"getCacheAsBitmap",	m_get_cache_as_bitmap},
 	{"globalToLocal",		m_global_to_local},
 	{"localToGlobal",		m_local_to_global},
 	{"hitTestPoint",		m_hit_test_point},
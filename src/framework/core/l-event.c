@@ -55,10 +55,20 @@ static int l_event_new(lua_State * L)
 static int l_event_pump(lua_State * L)
 {
 	struct window_t * w = ((struct vmctx_t *)luahelper_vmctx(L))->w;
+	int64_t timeout = (int64_t)(luaL_optnumber(L, 1, 0) * 1000000000.0);
 	struct event_t e;
 
-	if(!window_is_active(w) || !window_pump_event(w, &e))
+	if(!window_is_active(w))
+	{
+		if(timeout > 0)
+			task_sleep(timeout);
 		return 0;
+	}
+	if(!window_pump_event(w, &e))
+	{
+		if((timeout <= 0) || !window_wait_event(w, timeout) || !window_is_active(w) || !window_pump_event(w, &e))
+			return 0;
+	}
 
 	switch(e.type)
 	{
@@ -89,6 +89,8 @@ function M:removeTimer(timer)
 end
 
 function M:schedTimer(dt)
+	local wait = 1
+
 	for i, v in ipairs(self._timerlist) do
 		if v._running then
 			v._runtime = v._runtime + dt
@@ -102,8 +104,14 @@ function M:schedTimer(dt)
 					self:removeTimer(v)
 				end
 			end
+
+			if v._delay - v._runtime < wait then
+				wait = v._delay - v._runtime
+			end
 		end
 	end
+
+	return wait
 end
 
 function M:getDotsPerInch()
@@ -140,8 +148,10 @@ function M:loop()
 		collectgarbage("step")
 	end))
 
+	local wait = 0
+
 	while not self._exiting do
-		local e = Event.pump()
+		local e = Event.pump(wait)
 		if e ~= nil then
 			self:dispatch(e)
 		end
@@ -149,7 +159,10 @@ function M:loop()
 		local elapsed = stopwatch:elapsed()
 		if elapsed > 0 then
 			stopwatch:reset()
-			self:schedTimer(elapsed)
+			wait = self:schedTimer(elapsed)
+		end
+		if e ~= nil then
+			wait = 0
 		end
 	end
 end
@@ -163,14 +163,25 @@ static int luaopen_boot(lua_State * L)
 struct reader_data_t
 {
 	struct xfs_file_t * file;
+	const char * map;
+	s64_t len;
 	char buffer[LUAL_BUFFERSIZE];
 };
 
 static const char * reader(lua_State * L, void * data, size_t * size)
 {
 	struct reader_data_t * rd = (struct reader_data_t *)data;
+	const char * p;
 	s64_t ret;
 
+	if(rd->map)
+	{
+		p = rd->map;
+		*size = (size_t)rd->len;
+		rd->map = NULL;
+		return p;
+	}
+
 	ret = xfs_read(rd->file, rd->buffer, LUAL_BUFFERSIZE);
 	if(ret < 0)
 	{
@@ -204,6 +215,10 @@ static int l_loadfile(lua_State * L)
 		lua_pushfstring(L, "cannot open %s", filename);
 		return 2;
 	}
+	rd->len = xfs_length(rd->file);
+	rd->map = (rd->len > 0) ? xfs_mmap(rd->file, 0, rd->len) : NULL;
+	if(rd->map)
+		xfs_seek(rd->file, rd->len);
 
 	if(lua_load(L, reader, rd, filename, NULL))
 	{
@@ -384,11 +399,20 @@ static int l_panic(lua_State *L)
 	return 0;
 }
 
+static void l_preempt(lua_State * L, lua_Debug * ar)
+{
+	task_preempt();
+}
+
 static lua_State * l_newstate(void * ud)
 {
 	lua_State * L = lua_newstate(l_alloc, ud);
 	if(L)
+	{
 		lua_atpanic(L, &l_panic);
+		if(CONFIG_SCHED_PREEMPT)
+			lua_sethook(L, &l_preempt, LUA_MASKCOUNT, 1000);
+	}
 	return L;
 }
 
@@ -7,6 +7,14 @@ extern "C" {
 
 #include <xboot.h>
 
+struct block_stat_t
+{
+	u64_t hit;
+	u64_t miss;
+	u64_t rblk;
+	u64_t wblk;
+};
+
 struct block_t
 {
 	/* The block name */
@@ -21,14 +29,23 @@ struct block_t
 	/* Read block device, return the block counts of reading */
 	u64_t (*read)(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t blkcnt);
 
-	/* Write block device, return the block counts of writing */
+	/* Write block device, return the block counts of writing, NULL if read only */
 	u64_t (*write)(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t blkcnt);
 
 	/* Sync cache to block device */
 	void (*sync)(struct block_t * blk);
 
+	/* Map blocks of memory backed device, return NULL if not addressable */
+	const void * (*mmap)(struct block_t * blk, u64_t blkno, u64_t blkcnt);
+
 	/* Private data */
 	void * priv;
+
+	/* Buffer cache statistics, maintained by the block layer */
+	struct block_stat_t stat;
+
+	/* Serializes cached access and device io, maintained by the block layer */
+	struct mutex_t lock;
 };
 
 static inline u64_t block_size(struct block_t * blk)
@@ -78,6 +95,7 @@ void unregister_sub_block(struct block_t * pblk);
 u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count);
 u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count);
 void block_sync(struct block_t * blk);
+const void * block_mmap(struct block_t * blk, u64_t offset, u64_t count);
 
 #ifdef __cplusplus
 }
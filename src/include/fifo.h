@@ -5,14 +5,32 @@
 extern "C" {
 #endif
 
+#include <types.h>
+#include <atomic.h>
 #include <spinlock.h>
 
+#define FIFO_CACHE_LINE_SIZE	(64)
+
+enum fifo_mode_t {
+	FIFO_MODE_LOCKED	= 0,
+	FIFO_MODE_SPSC		= 1,
+	FIFO_MODE_MPSC		= 2,
+};
+
 struct fifo_t {
 	unsigned char * buffer;
 	unsigned int size;
-	unsigned int in;
-	unsigned int out;
+	enum fifo_mode_t mode;
 	spinlock_t lock;
+
+	/*
+	 * Producer and consumer indices live on separate cache lines. In mpsc
+	 * mode producers reserve space by advancing head, then publish in the
+	 * order they reserved by advancing in.
+	 */
+	unsigned int in __attribute__((aligned(FIFO_CACHE_LINE_SIZE)));
+	atomic_t head;
+	unsigned int out __attribute__((aligned(FIFO_CACHE_LINE_SIZE)));
 };
 
 void __fifo_reset(struct fifo_t * f);
@@ -20,6 +38,7 @@ unsigned int __fifo_len(struct fifo_t * f);
 unsigned int __fifo_put(struct fifo_t * f, unsigned char * buf, unsigned int len);
 unsigned int __fifo_get(struct fifo_t * f, unsigned char * buf, unsigned int len);
 
+struct fifo_t * fifo_alloc_mode(unsigned int size, enum fifo_mode_t mode);
 struct fifo_t * fifo_alloc(unsigned int size);
 void fifo_free(struct fifo_t * f);
 void fifo_reset(struct fifo_t * f);
@@ -33,6 +33,12 @@ struct framebuffer_t
 	/* Present a surface */
 	void (*present)(struct framebuffer_t * fb, struct surface_t * s, struct region_list_t * rl);
 
+	/* Get a vram backed page flip buffer, NULL if not supported */
+	struct surface_t * (*buffer)(struct framebuffer_t * fb, int index);
+
+	/* Scan out a page flip buffer, returns once the flip has latched */
+	void (*flip)(struct framebuffer_t * fb, int index);
+
 	/* Private data */
 	void * priv;
 };
@@ -95,6 +101,18 @@ static inline void framebuffer_present_surface(struct framebuffer_t * fb, struct
 	fb->present(fb, s, rl);
 }
 
+static inline struct surface_t * framebuffer_get_buffer(struct framebuffer_t * fb, int index)
+{
+	if(fb->buffer && fb->flip)
+		return fb->buffer(fb, index);
+	return NULL;
+}
+
+static inline void framebuffer_flip(struct framebuffer_t * fb, int index)
+{
+	fb->flip(fb, index);
+}
+
 struct framebuffer_t * search_framebuffer(const char * name);
 struct framebuffer_t * search_first_framebuffer(void);
 struct device_t * register_framebuffer(struct framebuffer_t * fb, struct driver_t * drv);
@@ -101,8 +101,16 @@ struct ldobject_t {
 	struct matrix_t global_matrix;
 	struct region_t global_bounds;
 	struct region_t dirty_bounds;
+	struct region_t tree_bounds;
+	struct {
+		int enable;
+		struct surface_t * s;
+		struct matrix_t m;
+		struct region_t r;
+		double width, height;
+	} cache;
 
-	void (*draw)(struct ldobject_t * o, struct window_t * w);
+	void (*draw)(struct ldobject_t * o, struct surface_t * s, struct matrix_t * m, struct region_t * clip);
 	void * priv;
 };
 
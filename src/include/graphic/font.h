@@ -9,9 +9,34 @@ extern "C" {
 #include <hmap.h>
 #include <xfs/xfs.h>
 
+struct font_glyph_t {
+	struct hlist_node node;
+	struct list_head entry;
+
+	void * face;
+	int index;
+	int size;
+	int sub;
+
+	int left, top;
+	int width, height;
+	int advance;
+	int hadvance, vadvance;
+	int hbearingx, hbearingy;
+	uint8_t * bitmap;
+	int pitch;
+};
+
+struct font_family_t {
+	int n;
+	char * names[0];
+};
+
 struct font_context_t {
 	void * library;
 	struct hmap_t * map;
+	struct hmap_t * families;
+	struct font_cache_t * cache;
 };
 
 struct font_context_t * font_context_alloc(void);
@@ -19,7 +44,12 @@ void font_context_free(struct font_context_t * ctx);
 void font_install(struct font_context_t * ctx, const char * family, const char * path);
 void font_install_from_xfs(struct font_context_t * ctx, struct xfs_context_t * xfs, const char * family, const char * path);
 void font_uninstall(struct font_context_t * ctx, const char * family);
+struct font_family_t * search_family(struct font_context_t * ctx, const char * family);
+int search_family_glyph(struct font_context_t * ctx, struct font_family_t * family, u32_t code, void ** face);
 int search_glyph(struct font_context_t * ctx, const char * family, u32_t code, void ** face);
+struct font_glyph_t * font_glyph_search(struct font_context_t * ctx, void * face, int index, int size, int sub);
+struct font_glyph_t * font_glyph_lookup(struct font_context_t * ctx, void * face, int index, int size, int sub);
+void font_glyph_flush(struct font_context_t * ctx, void * face);
 
 #ifdef __cplusplus
 }
@@ -6,6 +6,7 @@ extern "C" {
 #endif
 
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
 struct region_t {
@@ -101,6 +102,26 @@ void region_list_merge(struct region_list_t * rl, struct region_list_t * o);
 void region_list_add(struct region_list_t * rl, struct region_t * r);
 void region_list_clear(struct region_list_t * rl);
 
+/*
+ * Damage tracker, a bitmap of fixed size tiles covering the surface.
+ */
+struct region_damage_t {
+	int width, height;
+	int shift;
+	int cols, rows;
+	int words;
+	int dirty;
+	uint32_t * bits;
+	int * spans;
+};
+
+struct region_damage_t * region_damage_alloc(int width, int height, int tsize);
+void region_damage_free(struct region_damage_t * d);
+void region_damage_add(struct region_damage_t * d, struct region_t * r);
+void region_damage_merge(struct region_damage_t * d, struct region_damage_t * o);
+void region_damage_clear(struct region_damage_t * d);
+void region_damage_to_list(struct region_damage_t * d, struct region_list_t * rl);
+
 #ifdef __cplusplus
 }
 #endif
@@ -223,6 +223,9 @@ static inline void surface_filter_blur(struct surface_t * s, int radius)
 	s->r->filter_blur(s, radius);
 }
 
+const char * render_default_pixops_name(int index);
+const char * render_default_pixops_get(void);
+bool_t render_default_pixops_set(const char * name);
 void * render_default_create(struct surface_t * s);
 void render_default_destroy(void * pctx);
 void render_default_blit(struct surface_t * s, struct region_t * clip, struct matrix_t * m, struct surface_t * src, enum render_type_t type);
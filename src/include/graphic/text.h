@@ -10,13 +10,21 @@ extern "C" {
 #include <graphic/matrix.h>
 #include <graphic/font.h>
 
+struct text_glyph_t {
+	void * face;
+	int index;
+};
+
 struct text_t {
 	char * utf8;
 	struct color_t c;
 	struct font_context_t * fctx;
 	char * family;
+	struct font_family_t * fam;
 	int size;
 	struct region_t e;
+	struct text_glyph_t * glyphs;
+	int nglyph;
 };
 
 struct text_t * text_alloc(const char * utf8, struct color_t * c, struct font_context_t * fctx, const char * family, int size);
@@ -50,7 +50,11 @@ struct ext4fs_control_t {
 
 	u32_t group_count;
 	u32_t group_table_blkno;
+	u32_t group_desc_size;
 	struct ext4fs_group_t * groups;
+
+	/* Features or a device this driver can not write safely */
+	bool_t read_only;
 };
 
 u32_t ext4fs_current_timestamp(void);
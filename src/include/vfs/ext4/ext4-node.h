@@ -49,6 +49,20 @@ struct ext4fs_node_t {
 	u32_t dindir2_blkno;
 	bool_t dindir2_dirty;
 
+	/*
+	 * Last extent found in the extent tree, a hole when ext_blkno is zero
+	 * and invalid when ext_blkcnt is zero
+	 */
+	u32_t ext_blkpos;
+	u32_t ext_blkcnt;
+	u32_t ext_blkno;
+
+	/* Extent tree block
+	 * Allocated on demand. Must be freed in vput()
+	 */
+	u8_t * ext_block;
+	u32_t ext_block_blkno;
+
 	/* Child directory entry lookup table */
 	u32_t lookup_victim;
 	char lookup_name[EXT4_NODE_LOOKUP_SIZE][VFS_MAX_NAME];
@@ -60,6 +74,7 @@ void ext4fs_node_set_size(struct ext4fs_node_t * node, u64_t size);
 int ext4fs_node_read_blk(struct ext4fs_node_t * node, u32_t blkno, u32_t blkoff, u32_t blklen, char * buf);
 int ext4fs_node_write_blk(struct ext4fs_node_t * node, u32_t blkno, u32_t blkoff, u32_t blklen, char * buf);
 int ext4fs_node_sync(struct ext4fs_node_t * node);
+int ext4fs_node_read_extent(struct ext4fs_node_t * node, u32_t blkpos, u32_t * blkno, u32_t * blkcnt);
 int ext4fs_node_read_blkno(struct ext4fs_node_t * node, u32_t blkpos, u32_t * blkno);
 int ext4fs_node_write_blkno(struct ext4fs_node_t * node, u32_t blkpos, u32_t blkno);
 u32_t ext4fs_node_read(struct ext4fs_node_t * node, u64_t pos, u32_t len, char * buf);
@@ -74,11 +74,14 @@ struct ext2_sblock_t {
 	u32_t hash_seed[4];
 	u8_t def_hash_version;
 	u8_t jnl_backup_type;
-	u16_t reserved_word_pad;
+	u16_t desc_size;
 	u32_t default_mount_opts;
 	u32_t first_meta_bg;
 	u32_t mkfs_time;
 	u32_t jnl_blocks[17];
+	u32_t total_blocks_hi;
+	u32_t reserved_blocks_hi;
+	u32_t free_blocks_hi;
 } __attribute__ ((packed));
 
 /* FS States */
@@ -115,11 +118,25 @@ struct ext2_sblock_t {
 #define EXT3_FEAT_INCOMPAT_RECOVER		0x0004
 #define EXT3_FEAT_INCOMPAT_JOURNAL_DEV	0x0008	 
 #define EXT2_FEAT_INCOMPAT_META_BG		0x0010
+#define EXT4_FEAT_INCOMPAT_EXTENTS		0x0040 /* Extents are used by some inodes */
+#define EXT4_FEAT_INCOMPAT_64BIT		0x0080 /* Group descriptors are desc_size bytes */
+#define EXT4_FEAT_INCOMPAT_FLEX_BG		0x0200 /* Bitmaps and inode tables of groups packed together */
+
+/* Incompat features understood, mounting anything else is refused */
+#define EXT4_FEAT_INCOMPAT_SUPP			(EXT2_FEAT_INCOMPAT_FILETYPE | EXT3_FEAT_INCOMPAT_RECOVER | EXT4_FEAT_INCOMPAT_EXTENTS | EXT4_FEAT_INCOMPAT_64BIT | EXT4_FEAT_INCOMPAT_FLEX_BG)
 
 /* Feature Read-Only Compatibility */
 #define EXT2_FEAT_RO_COMPAT_SPARS_SUPER	0x0001 /* Sparse Superblock */
 #define EXT2_FEAT_RO_COMPAT_LARGE_FILE	0x0002 /* Large file support, 64-bit file size */
 #define EXT2_FEAT_RO_COMPAT_BTREE_DIR	0x0004 /* Binary tree sorted directory files */
+#define EXT4_FEAT_RO_COMPAT_HUGE_FILE	0x0008 /* Block counts in file system blocks */
+#define EXT4_FEAT_RO_COMPAT_GDT_CSUM	0x0010 /* Group descriptors have checksums */
+#define EXT4_FEAT_RO_COMPAT_DIR_NLINK	0x0020 /* Directories may exceed 65000 links */
+#define EXT4_FEAT_RO_COMPAT_EXTRA_ISIZE	0x0040 /* Large inodes carry extra fields */
+#define EXT4_FEAT_RO_COMPAT_METADATA_CSUM	0x0400 /* Metadata checksums, implies gdt csum */
+
+/* Ro compat features kept intact by writes, anything else mounts read only */
+#define EXT4_FEAT_RO_COMPAT_SUPP		(EXT2_FEAT_RO_COMPAT_SPARS_SUPER | EXT2_FEAT_RO_COMPAT_LARGE_FILE | EXT2_FEAT_RO_COMPAT_BTREE_DIR | EXT4_FEAT_RO_COMPAT_DIR_NLINK | EXT4_FEAT_RO_COMPAT_EXTRA_ISIZE)
 
 /* Compression Algo Bitmap */
 #define EXT2_LZV1_ALG					0 /* Binary value of 0x00000001 */
@@ -215,8 +232,40 @@ struct ext2_inode_t {
 #define EXT2_INDEX_FL					0x00001000 /* hash indexed directory */
 #define EXT2_IMAGIC_FL					0x00002000 /* AFS directory */
 #define EXT3_JOURNAL_DATA_FL			0x00004000 /* journal file data */
+#define EXT4_EXTENTS_FL					0x00080000 /* inode uses extents */
 #define EXT2_RESERVED_FL				0x80000000 /* reserved for ext2 library */
 
+/* Magic value of the ext4 extent tree nodes */
+#define EXT4_EXT_MAGIC					0xF30A
+
+/* Extents longer than this are uninitialized, reading them returns zeros */
+#define EXT4_EXT_INIT_MAX_LEN			32768
+
+/* Header at the start of every extent tree node, inode i_block included */
+struct ext4_extent_header_t {
+	u16_t magic;
+	u16_t entries;
+	u16_t max;
+	u16_t depth;
+	u32_t generation;
+} __attribute__ ((packed));
+
+/* Index entry of an interior extent tree node */
+struct ext4_extent_idx_t {
+	u32_t block;	/* First logical block covered */
+	u32_t leaf_lo;	/* Physical block of the next level */
+	u16_t leaf_hi;
+	u16_t unused;
+} __attribute__ ((packed));
+
+/* Leaf entry, a run of physically contiguous blocks */
+struct ext4_extent_t {
+	u32_t block;	/* First logical block */
+	u16_t len;		/* Number of blocks */
+	u16_t start_hi;	/* Physical block, high 16 bits */
+	u32_t start_lo;	/* Physical block, low 32 bits */
+} __attribute__ ((packed));
+
 /* The ext2 directory entry. */
 struct ext2_dirent_t {
 	u32_t inode;
@@ -7,7 +7,7 @@ extern "C" {
 
 #include <vfs/fat/fat.h>
 
-#define FAT_TABLE_CACHE_SIZE	(32)
+#define FAT_TABLE_CACHE_SIZE	(CONFIG_FAT_TABLE_CACHE_SIZE)
 
 /*
  * Information about a "mounted" FAT filesystem
@@ -42,12 +42,19 @@ struct fatfs_control_t {
 	/* FAT type */
 	enum fat_type_t type;
 
-	/* FAT sector cache */
+	/* FAT sector cache, least recently used sector is evicted */
 	struct mutex_t fat_cache_lock;
-	u32_t fat_cache_victim;
+	u32_t fat_cache_tick;
+	int fat_cache_last;
 	bool_t fat_cache_dirty[FAT_TABLE_CACHE_SIZE];
 	u32_t fat_cache_num[FAT_TABLE_CACHE_SIZE];
+	u32_t fat_cache_stamp[FAT_TABLE_CACHE_SIZE];
 	u8_t * fat_cache_buf;
+
+	/* Free cluster bitmap, built on first allocation */
+	u32_t * free_map;
+	u32_t free_last;
+	u32_t free_hint;
 };
 
 u32_t fatfs_pack_timestamp(u32_t year, u32_t mon, u32_t day, u32_t hour, u32_t min, u32_t sec);
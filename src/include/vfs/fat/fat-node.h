@@ -8,6 +8,15 @@ extern "C" {
 #include <vfs/fat/fat.h>
 
 
+/*
+ * Contiguous clusters of a chain, starting at file cluster index
+ */
+struct fatfs_run_t {
+	u32_t index;
+	u32_t cluster;
+	u32_t count;
+};
+
 /*
  * Information for accessing a FAT file/directory
  */
@@ -25,9 +34,12 @@ struct fatfs_node_t {
 	/* First cluster */
 	u32_t first_cluster;
 
-	/* Current cluster */
-	u32_t cur_cluster;
-	u32_t cur_pos;
+	/* Cluster chain runs, mapped from the first cluster on demand */
+	struct fatfs_run_t * runs;
+	u32_t runs_count;
+	u32_t runs_size;
+	u32_t runs_first;
+	u32_t runs_mapped;
 
 	/* Cached clusters */
 	u8_t *cached_data;
@@ -105,6 +105,11 @@ enum vfs_dirent_type_t {
 	VDT_SOCK,
 };
 
+struct vfs_iovec_t {
+	void * iov_base;
+	u64_t iov_len;
+};
+
 struct vfs_dirent_t {
 	u64_t d_off;
 	u32_t d_reclen;
@@ -115,6 +120,7 @@ struct vfs_dirent_t {
 enum vfs_node_flag_t {
 	VNF_NONE,
 	VNF_ROOT,
+	VNF_NEGATIVE,
 };
 
 enum vfs_node_type_t {
@@ -130,9 +136,13 @@ enum vfs_node_type_t {
 
 struct vfs_node_t {
 	struct list_head v_link;
+	struct list_head v_lru;
 	struct vfs_mount_t * v_mount;
+	struct vfs_node_t * v_parent;
 	atomic_t v_refcnt;
-	char v_path[VFS_MAX_PATH];
+	atomic_t v_readers;
+	u32_t v_hash;
+	char * v_name;
 	enum vfs_node_flag_t v_flags;
 	enum vfs_node_type_t v_type;
 	struct mutex_t v_lock;
@@ -142,6 +152,7 @@ struct vfs_node_t {
 	u32_t v_mode;
 	s64_t v_size;
 	void * v_data;
+	char v_path[0];
 };
 
 enum {
@@ -163,10 +174,16 @@ struct vfs_mount_t {
 	void * m_data;
 };
 
+enum {
+	FS_NOCACHE		= (0x1 << 0),
+	FS_SHARED_READ	= (0x1 << 1),
+};
+
 struct filesystem_t {
 	struct kobj_t * kobj;
 	struct list_head list;
 	const char * name;
+	u32_t flags;
 
 	int (*mount)(struct vfs_mount_t *, const char *);
 	int (*unmount)(struct vfs_mount_t *);
@@ -176,6 +193,7 @@ struct filesystem_t {
 
 	u64_t (*read)(struct vfs_node_t *, s64_t, void *, u64_t);
 	u64_t (*write)(struct vfs_node_t *, s64_t, void *, u64_t);
+	const void * (*mmap)(struct vfs_node_t *, s64_t, u64_t);
 	int (*truncate)(struct vfs_node_t *, s64_t);
 	int (*sync)(struct vfs_node_t *);
 	int (*readdir)(struct vfs_node_t *, s64_t, struct vfs_dirent_t *);
@@ -204,6 +222,10 @@ int vfs_open(const char * path, u32_t flags, u32_t mode);
 int vfs_close(int fd);
 u64_t vfs_read(int fd, void * buf, u64_t len);
 u64_t vfs_write(int fd, void * buf, u64_t len);
+u64_t vfs_pread(int fd, void * buf, u64_t len, s64_t off);
+u64_t vfs_pwrite(int fd, void * buf, u64_t len, s64_t off);
+u64_t vfs_readv(int fd, struct vfs_iovec_t * iov, int iovcnt);
+const void * vfs_mmap(int fd, s64_t off, u64_t len);
 s64_t vfs_lseek(int fd, s64_t off, int whence);
 int vfs_fsync(int fd);
 int vfs_fchmod(int fd, u32_t mode);
@@ -60,6 +60,7 @@ extern "C" {
 #include <xboot/device.h>
 #include <xboot/driver.h>
 #include <xboot/task.h>
+#include <xboot/waitqueue.h>
 #include <xboot/mutex.h>
 #include <xboot/channel.h>
 #include <xboot/window.h>
@@ -6,23 +6,27 @@ extern "C" {
 #endif
 
 #include <types.h>
-#include <list.h>
-#include <spinlock.h>
+#include <stdint.h>
+#include <fifo.h>
+#include <xboot/waitqueue.h>
 
 struct channel_t {
-	unsigned char * buffer;
-	unsigned int size;
-	unsigned int in;
-	unsigned int out;
-	struct list_head swait;
-	struct list_head rwait;
-	spinlock_t lock;
+	struct fifo_t * fifo;
+	struct waitqueue_t swait;
+	struct waitqueue_t rwait;
 };
 
+struct channel_t * channel_alloc_mode(unsigned int size, enum fifo_mode_t mode);
 struct channel_t * channel_alloc(unsigned int size);
 void channel_free(struct channel_t * c);
 void channel_send(struct channel_t * c, unsigned char * buf, unsigned int len);
 void channel_recv(struct channel_t * c, unsigned char * buf, unsigned int len);
+/*
+ * Receive up to len bytes, waiting at most ns nanoseconds in total. A zero
+ * timeout only takes what is already queued, a negative one waits forever.
+ * Returns the number of bytes received.
+ */
+unsigned int channel_recv_timeout(struct channel_t * c, unsigned char * buf, unsigned int len, int64_t ns);
 
 #ifdef __cplusplus
 }
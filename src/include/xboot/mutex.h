@@ -6,18 +6,34 @@ extern "C" {
 #endif
 
 #include <types.h>
+#include <stdint.h>
 #include <list.h>
 #include <atomic.h>
 #include <spinlock.h>
 
+struct task_t;
+struct scheduler_t;
+
+/*
+ * The atomic is 1 when unlocked, 0 when locked and -1 when locked with
+ * sleeping waiters, only the last state forces mutex_unlock to the slow path.
+ * The owner's scheduler is kept here so spinners never touch the owner task,
+ * which may already have exited. While there are waiters the mutex is linked
+ * on the owner's mheld list, with pnice the nice value of its best waiter.
+ */
 struct mutex_t {
 	atomic_t atomic;
+	struct task_t * owner;
+	struct scheduler_t * osched;
+	int pnice;
+	struct list_head hentry;
 	struct list_head mwait;
 	spinlock_t lock;
 };
 
 void mutex_init(struct mutex_t * m);
 void mutex_lock(struct mutex_t * m);
+int mutex_lock_timeout(struct mutex_t * m, int64_t ns);
 void mutex_unlock(struct mutex_t * m);
 
 #ifdef __cplusplus
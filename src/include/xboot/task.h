@@ -27,9 +27,6 @@ enum task_status_t {
 struct task_t {
 	struct rb_node node;
 	struct list_head list;
-	struct list_head slist;
-	struct list_head rlist;
-	struct list_head mlist;
 	struct scheduler_t * sched;
 	enum task_status_t status;
 	uint64_t start;
@@ -40,8 +37,11 @@ struct task_t {
 	void * stack;
 	size_t stksz;
 	int nice;
+	int bnice;
+	struct list_head mheld;
 	int weight;
 	uint32_t inv_weight;
+	int oncpu;
 	task_func_t func;
 	void * data;
 	int __errno;
@@ -51,8 +51,15 @@ struct scheduler_t {
 	struct rb_root_cached ready;
 	struct list_head suspend;
 	struct task_t * running;
+	struct task_t * idle;
 	uint64_t min_vtime;
 	uint64_t weight;
+	uint64_t load;
+	int nready;
+	uint64_t balance;
+	uint64_t nsteal;
+	uint64_t nmigrate;
+	int need_resched;
 	spinlock_t lock;
 };
 
@@ -71,9 +78,22 @@ static inline struct task_t * task_self(void)
 struct task_t * task_create(struct scheduler_t * sched, const char * name, task_func_t func, void * data, size_t stksz, int nice);
 void task_destroy(struct task_t * task);
 void task_renice(struct task_t * task, int nice);
+void task_inherit(struct task_t * task, int nice);
 void task_suspend(struct task_t * task);
 void task_resume(struct task_t * task);
+void task_wakeup(struct task_t * task, int * wake, int value);
 void task_yield(void);
+int task_wait_timeout(int * wake, int64_t ns);
+void task_sleep(uint64_t ns);
+
+/*
+ * Preemption point, yield only if the scheduler tick has asked for it.
+ */
+static inline void task_preempt(void)
+{
+	if(unlikely(scheduler_self()->need_resched))
+		task_yield();
+}
 
 void scheduler_loop(void);
 void do_init_sched(void);
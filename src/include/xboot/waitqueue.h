@@ -0,0 +1,91 @@
+#ifndef __WAITQUEUE_H__
+#define __WAITQUEUE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <types.h>
+#include <stdint.h>
+#include <list.h>
+#include <spinlock.h>
+#include <xboot/ktime.h>
+#include <xboot/task.h>
+
+struct waitqueue_t {
+	struct list_head list;
+	spinlock_t lock;
+};
+
+struct waiter_t {
+	struct list_head entry;
+	struct task_t * task;
+	int wake;
+};
+
+static inline void waiter_init(struct waiter_t * w)
+{
+	init_list_head(&w->entry);
+	w->task = task_self();
+	w->wake = 0;
+}
+
+/*
+ * Lockless check for sleepers, pairs with the barrier in waitqueue_prepare
+ */
+static inline int waitqueue_active(struct waitqueue_t * wq)
+{
+	smp_mb();
+	return !list_empty(&wq->list);
+}
+
+/*
+ * Wait until the condition is true or the timeout in nanoseconds expires, a
+ * negative timeout waits forever. Returns zero on timeout, otherwise the time
+ * left, at least one.
+ */
+#define wait_event_timeout(wq, condition, ns) \
+({ \
+	struct waiter_t __w; \
+	int64_t __ret = (ns); \
+	uint64_t __end = ktime_to_ns(ktime_get()) + __ret; \
+	waiter_init(&__w); \
+	while(1) \
+	{ \
+		waitqueue_prepare((wq), &__w); \
+		if(condition) \
+		{ \
+			if(__ret <= 0) \
+				__ret = 1; \
+			break; \
+		} \
+		if((ns) >= 0) \
+		{ \
+			__ret = (int64_t)(__end - ktime_to_ns(ktime_get())); \
+			if(__ret <= 0) \
+			{ \
+				__ret = 0; \
+				break; \
+			} \
+		} \
+		task_wait_timeout(&__w.wake, __ret); \
+	} \
+	waitqueue_finish((wq), &__w); \
+	__ret; \
+})
+
+#define wait_event(wq, condition) \
+	do { wait_event_timeout(wq, condition, -1); } while(0)
+
+void waitqueue_init(struct waitqueue_t * wq);
+void waitqueue_prepare(struct waitqueue_t * wq, struct waiter_t * w);
+void waitqueue_finish(struct waitqueue_t * wq, struct waiter_t * w);
+int waitqueue_wait(struct waitqueue_t * wq, int64_t ns);
+void waitqueue_wakeup(struct waitqueue_t * wq);
+void waitqueue_wakeup_all(struct waitqueue_t * wq);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __WAITQUEUE_H__ */
@@ -11,6 +11,7 @@ extern "C" {
 #include <fifo.h>
 #include <irqflags.h>
 #include <spinlock.h>
+#include <xboot/waitqueue.h>
 #include <framebuffer/framebuffer.h>
 
 struct window_manager_t {
@@ -19,6 +20,7 @@ struct window_manager_t {
 	struct list_head window;
 	struct framebuffer_t * fb;
 	struct fifo_t * event;
+	struct waitqueue_t wait;
 	int wcount;
 	int refresh;
 	struct {
@@ -28,6 +30,12 @@ struct window_manager_t {
 		int dirty;
 		int show;
 	} cursor;
+	struct {
+		int count;
+		int back;
+		struct surface_t * s[3];
+		struct region_damage_t * damage[3];
+	} flip;
 };
 
 struct window_t {
@@ -35,6 +43,7 @@ struct window_t {
 	struct window_manager_t * wm;
 	struct surface_t * s;
 	struct region_list_t * rl;
+	struct region_damage_t * damage;
 	struct hmap_t * map;
 	int launcher;
 	void * priv;
@@ -107,6 +116,7 @@ void window_region_list_add(struct window_t * w, struct region_t * r);
 void window_region_list_clear(struct window_t * w);
 void window_present(struct window_t * w, struct color_t * c, void * o, void (*draw)(struct window_t *, void *));
 int window_pump_event(struct window_t * w, struct event_t * e);
+int window_wait_event(struct window_t * w, int64_t ns);
 void push_event(struct event_t * e);
 
 #ifdef __cplusplus
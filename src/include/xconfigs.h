@@ -19,6 +19,22 @@ extern "C" {
 #define CONFIG_TASK_STACK_SIZE				(512 * 1024)
 #endif
 
+#if !defined(CONFIG_SCHED_BALANCE_INTERVAL)
+#define CONFIG_SCHED_BALANCE_INTERVAL		(4000000)
+#endif
+
+#if !defined(CONFIG_SCHED_PREEMPT)
+#define CONFIG_SCHED_PREEMPT				(0)
+#endif
+
+#if !defined(CONFIG_SCHED_GRANULARITY)
+#define CONFIG_SCHED_GRANULARITY			(4000000)
+#endif
+
+#if !defined(CONFIG_MUTEX_SPIN_COUNT)
+#define CONFIG_MUTEX_SPIN_COUNT				(1000)
+#endif
+
 #if !defined(CONFIG_DRIVER_HASH_SIZE)
 #define CONFIG_DRIVER_HASH_SIZE				(257)
 #endif
@@ -27,6 +43,58 @@ extern "C" {
 #define CONFIG_DEVICE_HASH_SIZE				(257)
 #endif
 
+#if !defined(CONFIG_BLOCK_CACHE_SIZE)
+#define CONFIG_BLOCK_CACHE_SIZE				(1024 * 1024)
+#endif
+
+#if !defined(CONFIG_BLOCK_CACHE_HASH_SIZE)
+#define CONFIG_BLOCK_CACHE_HASH_SIZE		(257)
+#endif
+
+#if !defined(CONFIG_BLOCK_CACHE_STREAM_SIZE)
+#define CONFIG_BLOCK_CACHE_STREAM_SIZE		(64 * 1024)
+#endif
+
+#if !defined(CONFIG_BLOCK_READAHEAD_SIZE)
+#define CONFIG_BLOCK_READAHEAD_SIZE			(128 * 1024)
+#endif
+
+#if !defined(CONFIG_WINDOW_DAMAGE_TILE_SIZE)
+#define CONFIG_WINDOW_DAMAGE_TILE_SIZE		(32)
+#endif
+
+#if !defined(CONFIG_WINDOW_PAGE_FLIP)
+#define CONFIG_WINDOW_PAGE_FLIP				(1)
+#endif
+
+#if !defined(CONFIG_FONT_GLYPH_CACHE_SIZE)
+#define CONFIG_FONT_GLYPH_CACHE_SIZE		(512)
+#endif
+
+#if !defined(CONFIG_FONT_GLYPH_HASH_SIZE)
+#define CONFIG_FONT_GLYPH_HASH_SIZE			(257)
+#endif
+
+#if !defined(CONFIG_FONT_CODE_CACHE_SIZE)
+#define CONFIG_FONT_CODE_CACHE_SIZE			(1024)
+#endif
+
+#if !defined(CONFIG_FONT_ATLAS_SIZE)
+#define CONFIG_FONT_ATLAS_SIZE				(512)
+#endif
+
+#if !defined(CONFIG_DOBJECT_OCCLUSION)
+#define CONFIG_DOBJECT_OCCLUSION			(0)
+#endif
+
+#if !defined(CONFIG_VFS_NODE_CACHE_SIZE)
+#define CONFIG_VFS_NODE_CACHE_SIZE			(256)
+#endif
+
+#if !defined(CONFIG_FAT_TABLE_CACHE_SIZE)
+#define CONFIG_FAT_TABLE_CACHE_SIZE			(64)
+#endif
+
 #if !defined(CONFIG_PROFILER_HASH_SIZE)
 #define CONFIG_PROFILER_HASH_SIZE			(257)
 #endif
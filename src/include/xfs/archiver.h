@@ -41,6 +41,9 @@ struct xfs_archiver_t
 	void * (*open)(void * m, const char * name, int mode);
 	s64_t (*read)(void * f, void * buf, s64_t size);
 	s64_t (*write)(void * f, void * buf, s64_t size);
+	s64_t (*pread)(void * f, void * buf, s64_t size, s64_t offset);
+	s64_t (*pwrite)(void * f, void * buf, s64_t size, s64_t offset);
+	const void * (*mmap)(void * f, s64_t offset, s64_t size);
 	s64_t (*seek)(void * f, s64_t offset);
 	s64_t (*tell)(void * f);
 	s64_t (*length)(void * f);
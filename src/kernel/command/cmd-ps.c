@@ -78,7 +78,7 @@ static int do_ps(int argc, char ** argv)
 		}
 		slist_sort(sl);
 
-		printf("CPU%d:\r\n", i);
+		printf("CPU%d: migrations %llu, steals %llu\r\n", i, (unsigned long long)sched->nmigrate, (unsigned long long)sched->nsteal);
 		slist_for_each_entry(e, sl)
 		{
 			pos = (struct task_t *)e->priv;
@@ -29,7 +29,7 @@
 #include <xboot.h>
 #include <xboot/channel.h>
 
-struct channel_t * channel_alloc(unsigned int size)
+struct channel_t * channel_alloc_mode(unsigned int size, enum fifo_mode_t mode)
 {
 	struct channel_t * c;
 
@@ -37,242 +37,99 @@ struct channel_t * channel_alloc(unsigned int size)
 	if(!c)
 		return NULL;
 
-	if(size & (size - 1))
-		size = roundup_pow_of_two(size);
-
-	c->buffer = malloc(size);
-	if(!c->buffer)
+	c->fifo = fifo_alloc_mode(size, mode);
+	if(!c->fifo)
 	{
 		free(c);
 		return NULL;
 	}
-	c->size = size;
-	c->in = 0;
-	c->out = 0;
-	init_list_head(&c->swait);
-	init_list_head(&c->rwait);
-	spin_lock_init(&c->lock);
+	waitqueue_init(&c->swait);
+	waitqueue_init(&c->rwait);
 
 	return c;
 }
 
+struct channel_t * channel_alloc(unsigned int size)
+{
+	return channel_alloc_mode(size, FIFO_MODE_LOCKED);
+}
+
 void channel_free(struct channel_t * c)
 {
 	if(c)
 	{
-		free(c->buffer);
+		fifo_free(c->fifo);
 		free(c);
 	}
 }
 
 static inline int channel_isempty(struct channel_t * c)
 {
-	int ret;
-
-	spin_lock(&c->lock);
-	ret = (c->in - c->out <= 0) ? 1 : 0;
-	spin_unlock(&c->lock);
-
-	return ret;
+	return (fifo_len(c->fifo) == 0) ? 1 : 0;
 }
 
 static inline int channel_isfull(struct channel_t * c)
 {
-	int ret;
-
-	spin_lock(&c->lock);
-	ret = (c->in - c->out >= c->size) ? 1 : 0;
-	spin_unlock(&c->lock);
-
-	return ret;
-}
-
-static inline unsigned int __channel_put(struct channel_t * c, unsigned char * buf, unsigned int len)
-{
-	unsigned int l;
-
-	spin_lock(&c->lock);
-	len = min(len, c->size - c->in + c->out);
-	smp_mb();
-	l = min(len, c->size - (c->in & (c->size - 1)));
-	memcpy(c->buffer + (c->in & (c->size - 1)), buf, l);
-	memcpy(c->buffer, buf + l, len - l);
-	smp_wmb();
-	c->in += len;
-	spin_unlock(&c->lock);
-
-	return len;
-}
-
-static inline unsigned int __channel_get(struct channel_t * c, unsigned char * buf, unsigned int len)
-{
-	unsigned int l;
-
-	spin_lock(&c->lock);
-	len = min(len, c->in - c->out);
-	smp_rmb();
-	l = min(len, c->size - (c->out & (c->size - 1)));
-	memcpy(buf, c->buffer + (c->out & (c->size - 1)), l);
-	memcpy(buf + l, c->buffer, len - l);
-	smp_mb();
-	c->out += len;
-	spin_unlock(&c->lock);
-
-	return len;
+	return (fifo_len(c->fifo) >= c->fifo->size) ? 1 : 0;
 }
 
-static inline unsigned int channel_put(struct channel_t * c, unsigned char * buf, unsigned int len)
+void channel_send(struct channel_t * c, unsigned char * buf, unsigned int len)
 {
-	struct task_t * self;
-	struct task_t * pos, * n;
-	unsigned int l;
+	unsigned int l = 0, n;
 
-	if(channel_isfull(c))
-	{
-		self = task_self();
-		spin_lock(&c->lock);
-		if(!list_empty(&c->rwait))
-		{
-			list_for_each_entry_safe(pos, n, &c->rwait, rlist)
-			{
-				list_del_init(&pos->rlist);
-				task_resume(pos);
-			}
-		}
-		if(list_empty_careful(&self->slist))
-		{
-			list_add_tail(&self->slist, &c->swait);
-		}
-		spin_unlock(&c->lock);
-		task_suspend(self);
-		l = __channel_put(c, buf, len);
-	}
-	else if(channel_isempty(c))
-	{
-		l = __channel_put(c, buf, len);
-		spin_lock(&c->lock);
-		if(!list_empty(&c->rwait))
-		{
-			list_for_each_entry_safe(pos, n, &c->rwait, rlist)
-			{
-				list_del_init(&pos->rlist);
-				task_resume(pos);
-			}
-		}
-		if(!list_empty(&c->swait))
-		{
-			list_for_each_entry_safe(pos, n, &c->swait, slist)
-			{
-				list_del_init(&pos->slist);
-				task_resume(pos);
-			}
-		}
-		spin_unlock(&c->lock);
-	}
-	else
+	if(c && buf)
 	{
-		l = __channel_put(c, buf, len);
-		spin_lock(&c->lock);
-		if(!list_empty(&c->rwait))
+		while(l < len)
 		{
-			list_for_each_entry_safe(pos, n, &c->rwait, rlist)
-			{
-				list_del_init(&pos->rlist);
-				task_resume(pos);
-			}
+			wait_event(&c->swait, !channel_isfull(c));
+			n = fifo_put(c->fifo, buf + l, len - l);
+			if((n > 0) && waitqueue_active(&c->rwait))
+				waitqueue_wakeup_all(&c->rwait);
+			l += n;
 		}
-		spin_unlock(&c->lock);
 	}
-	return l;
 }
 
-static inline unsigned int channel_get(struct channel_t * c, unsigned char * buf, unsigned int len)
+void channel_recv(struct channel_t * c, unsigned char * buf, unsigned int len)
 {
-	struct task_t * self;
-	struct task_t * pos, * n;
-	unsigned int l;
+	unsigned int l = 0, n;
 
-	if(channel_isempty(c))
-	{
-		self = task_self();
-		spin_lock(&c->lock);
-		if(!list_empty(&c->swait))
-		{
-			list_for_each_entry_safe(pos, n, &c->swait, slist)
-			{
-				list_del_init(&pos->slist);
-				task_resume(pos);
-			}
-		}
-		if(list_empty_careful(&self->rlist))
-		{
-			list_add_tail(&self->rlist, &c->rwait);
-		}
-		spin_unlock(&c->lock);
-		task_suspend(self);
-		l = __channel_get(c, buf, len);
-	}
-	else if(channel_isfull(c))
-	{
-		l = __channel_get(c, buf, len);
-		spin_lock(&c->lock);
-		if(!list_empty(&c->rwait))
-		{
-			list_for_each_entry_safe(pos, n, &c->rwait, rlist)
-			{
-				list_del_init(&pos->rlist);
-				task_resume(pos);
-			}
-		}
-		if(!list_empty(&c->swait))
-		{
-			list_for_each_entry_safe(pos, n, &c->swait, slist)
-			{
-				list_del_init(&pos->slist);
-				task_resume(pos);
-			}
-		}
-		spin_unlock(&c->lock);
-	}
-	else
+	if(c && buf)
 	{
-		l = __channel_get(c, buf, len);
-		spin_lock(&c->lock);
-		if(!list_empty(&c->swait))
+		while(l < len)
 		{
-			list_for_each_entry_safe(pos, n, &c->swait, slist)
-			{
-				list_del_init(&pos->slist);
-				task_resume(pos);
-			}
+			wait_event(&c->rwait, !channel_isempty(c));
+			n = fifo_get(c->fifo, buf + l, len - l);
+			if((n > 0) && waitqueue_active(&c->swait))
+				waitqueue_wakeup_all(&c->swait);
+			l += n;
 		}
-		spin_unlock(&c->lock);
-	}
-	return l;
-}
-
-void channel_send(struct channel_t * c, unsigned char * buf, unsigned int len)
-{
-	unsigned int l = 0;
-
-	if(c && buf)
-	{
-		do {
-			l += channel_put(c, buf + l, len - l);
-			task_yield();
-		} while(l < len);
 	}
 }
 
-void channel_recv(struct channel_t * c, unsigned char * buf, unsigned int len)
+unsigned int channel_recv_timeout(struct channel_t * c, unsigned char * buf, unsigned int len, int64_t ns)
 {
-	unsigned int l = 0;
+	uint64_t end = ktime_to_ns(ktime_get()) + ns;
+	int64_t remain = ns;
+	unsigned int l = 0, n;
 
 	if(c && buf)
 	{
-		do {
-			l += channel_get(c, buf + l, len - l);
-			task_yield();
-		} while(l < len);
+		while(l < len)
+		{
+			if(ns >= 0)
+			{
+				remain = (int64_t)(end - ktime_to_ns(ktime_get()));
+				if(remain < 0)
+					remain = 0;
+			}
+			if(!wait_event_timeout(&c->rwait, !channel_isempty(c), remain))
+				break;
+			n = fifo_get(c->fifo, buf + l, len - l);
+			if((n > 0) && waitqueue_active(&c->swait))
+				waitqueue_wakeup_all(&c->swait);
+			l += n;
+		}
 	}
+	return l;
 }
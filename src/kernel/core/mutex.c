@@ -29,44 +29,252 @@
 #include <xboot.h>
 #include <xboot/mutex.h>
 
+struct mutex_waiter_t {
+	struct list_head entry;
+	struct task_t * task;
+	int wake;
+	int granted;
+};
+
+static inline struct task_t * mutex_owner(struct mutex_t * m)
+{
+	return *((struct task_t * volatile *)&m->owner);
+}
+
+static spinlock_t __mutex_pi_lock = SPIN_LOCK_INIT();
+
+static inline void mutex_set_owner(struct mutex_t * m, struct task_t * task)
+{
+	m->osched = task ? task->sched : NULL;
+	m->owner = task;
+}
+
+/*
+ * Run a task at the best of its base nice value and the best waiter of every
+ * mutex it holds. Called with __mutex_pi_lock held.
+ */
+static void mutex_pi_update(struct task_t * task)
+{
+	struct mutex_t * pos;
+	int nice = task->bnice;
+
+	if(nice > 19)
+		return;
+	list_for_each_entry(pos, &task->mheld, hentry)
+	{
+		if(pos->pnice < nice)
+			nice = pos->pnice;
+	}
+	if(task->nice != nice)
+		task_inherit(task, nice);
+}
+
+/*
+ * Priority inheritance, link the mutex on its owner while anybody waits and
+ * reevaluate the owner. Called with m->lock held.
+ */
+static void mutex_adjust_owner(struct mutex_t * m)
+{
+	struct task_t * owner = m->owner;
+	struct mutex_waiter_t * w;
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&__mutex_pi_lock, flags);
+	list_del_init(&m->hentry);
+	if(owner && !list_empty(&m->mwait))
+	{
+		w = list_first_entry(&m->mwait, struct mutex_waiter_t, entry);
+		m->pnice = w->task->nice;
+		list_add_tail(&m->hentry, &owner->mheld);
+	}
+	if(owner)
+		mutex_pi_update(owner);
+	spin_unlock_irqrestore(&__mutex_pi_lock, flags);
+}
+
+/*
+ * Drop the boost a mutex gave to the task releasing it. Called with m->lock
+ * held.
+ */
+static void mutex_release_owner(struct mutex_t * m, struct task_t * task)
+{
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&__mutex_pi_lock, flags);
+	list_del_init(&m->hentry);
+	if(task)
+		mutex_pi_update(task);
+	spin_unlock_irqrestore(&__mutex_pi_lock, flags);
+}
+
+/*
+ * Spin while the owner is running on another cpu, it is likely to release
+ * the mutex sooner than a context switch would take. The owner is only
+ * compared against the running task of its scheduler, never dereferenced.
+ */
+static int mutex_spin_on_owner(struct mutex_t * m)
+{
+#if CONFIG_MAX_SMP_CPUS > 1
+	struct scheduler_t * sched = scheduler_self();
+	struct scheduler_t * osched;
+	struct task_t * owner;
+	int i, v;
+
+	for(i = 0; i < CONFIG_MUTEX_SPIN_COUNT; i++)
+	{
+		v = atomic_get(&m->atomic);
+		if(v < 0)
+			break;
+		if((v == 1) && (atomic_cmpxchg(&m->atomic, 1, 0) == 1))
+			return 1;
+		owner = mutex_owner(m);
+		osched = *((struct scheduler_t * volatile *)&m->osched);
+		if(!owner || !osched || (osched == sched) || sched->need_resched)
+			break;
+		smp_rmb();
+		if((mutex_owner(m) != owner) || (*((struct task_t * volatile *)&osched->running) != owner))
+			break;
+	}
+#endif
+	return 0;
+}
+
+static int mutex_lock_slowpath(struct mutex_t * m, int64_t ns)
+{
+	struct task_t * self = task_self();
+	struct mutex_waiter_t w, * pos;
+	irq_flags_t flags;
+	uint64_t end = ktime_to_ns(ktime_get()) + ns;
+	int64_t remain = ns;
+	int v;
+
+	if(mutex_spin_on_owner(m))
+	{
+		mutex_set_owner(m, self);
+		return 1;
+	}
+	if(!self)
+	{
+		while(atomic_cmpxchg(&m->atomic, 1, 0) != 1)
+		{
+			if((ns >= 0) && ((int64_t)(end - ktime_to_ns(ktime_get())) <= 0))
+				return 0;
+		}
+		mutex_set_owner(m, self);
+		return 1;
+	}
+
+	spin_lock_irqsave(&m->lock, flags);
+	while(1)
+	{
+		v = atomic_get(&m->atomic);
+		if(v == 1)
+		{
+			if(atomic_cmpxchg(&m->atomic, 1, 0) == 1)
+			{
+				mutex_set_owner(m, self);
+				spin_unlock_irqrestore(&m->lock, flags);
+				return 1;
+			}
+		}
+		else if((v < 0) || (atomic_cmpxchg(&m->atomic, 0, -1) == 0))
+			break;
+	}
+	w.task = self;
+	w.wake = 0;
+	w.granted = 0;
+	list_for_each_entry(pos, &m->mwait, entry)
+	{
+		if(self->nice < pos->task->nice)
+			break;
+	}
+	list_add_tail(&w.entry, &pos->entry);
+	mutex_adjust_owner(m);
+
+	while(!w.granted)
+	{
+		if(ns >= 0)
+		{
+			remain = (int64_t)(end - ktime_to_ns(ktime_get()));
+			if(remain <= 0)
+			{
+				list_del(&w.entry);
+				mutex_adjust_owner(m);
+				if(list_empty(&m->mwait))
+					atomic_cmpxchg(&m->atomic, -1, 0);
+				spin_unlock_irqrestore(&m->lock, flags);
+				return 0;
+			}
+		}
+		w.wake = 0;
+		spin_unlock_irqrestore(&m->lock, flags);
+		task_wait_timeout(&w.wake, remain);
+		spin_lock_irqsave(&m->lock, flags);
+	}
+	spin_unlock_irqrestore(&m->lock, flags);
+	return 1;
+}
+
 void mutex_init(struct mutex_t * m)
 {
 	atomic_set(&m->atomic, 1);
+	m->owner = NULL;
+	m->osched = NULL;
+	m->pnice = 0;
+	init_list_head(&m->hentry);
 	init_list_head(&m->mwait);
 	spin_lock_init(&m->lock);
 }
 
 void mutex_lock(struct mutex_t * m)
 {
-	struct task_t * self;
+	if(atomic_cmpxchg(&m->atomic, 1, 0) == 1)
+		mutex_set_owner(m, task_self());
+	else
+		mutex_lock_slowpath(m, -1);
+}
 
-	while(atomic_cmpxchg(&m->atomic, 1, 0) != 1)
+int mutex_lock_timeout(struct mutex_t * m, int64_t ns)
+{
+	if(atomic_cmpxchg(&m->atomic, 1, 0) == 1)
 	{
-		self = task_self();
-		spin_lock(&m->lock);
-		if(list_empty_careful(&self->mlist))
-			list_add_tail(&self->mlist, &m->mwait);
-		spin_unlock(&m->lock);
-		task_suspend(self);
+		mutex_set_owner(m, task_self());
+		return 1;
 	}
+	return mutex_lock_slowpath(m, ns);
 }
 
+/*
+ * With sleeping waiters the mutex is handed straight to the best one, it
+ * never becomes free in between, so the woken task can not lose it again.
+ */
 void mutex_unlock(struct mutex_t * m)
 {
-	struct task_t * pos, * n;
+	struct task_t * self = m->owner;
+	struct mutex_waiter_t * w;
+	irq_flags_t flags;
 
+	m->owner = NULL;
 	if(atomic_cmpxchg(&m->atomic, 0, 1) == 0)
+		return;
+
+	spin_lock_irqsave(&m->lock, flags);
+	mutex_release_owner(m, self);
+	if(list_empty(&m->mwait))
 	{
-		spin_lock(&m->lock);
-		if(!list_empty(&m->mwait))
-		{
-			list_for_each_entry_safe(pos, n, &m->mwait, mlist)
-			{
-				list_del_init(&pos->mlist);
-				task_resume(pos);
-				break;
-			}
-		}
-		spin_unlock(&m->lock);
+		atomic_set(&m->atomic, 1);
+	}
+	else
+	{
+		w = list_first_entry(&m->mwait, struct mutex_waiter_t, entry);
+		list_del_init(&w->entry);
+		mutex_set_owner(m, w->task);
+		if(list_empty(&m->mwait))
+			atomic_set(&m->atomic, 0);
+		else
+			mutex_adjust_owner(m);
+		w->granted = 1;
+		task_wakeup(w->task, &w->wake, 1);
 	}
+	spin_unlock_irqrestore(&m->lock, flags);
 }
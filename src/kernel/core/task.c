@@ -28,6 +28,7 @@
 
 #include <xboot.h>
 #include <xboot/task.h>
+#include <time/timer.h>
 
 struct transfer_t
 {
@@ -40,6 +41,7 @@ extern struct transfer_t jump_fcontext(void * fctx, void * priv);
 
 struct scheduler_t __sched[CONFIG_MAX_SMP_CPUS];
 EXPORT_SYMBOL(__sched);
+static struct timer_t __sched_tick[CONFIG_MAX_SMP_CPUS];
 
 static const int nice_to_weight[40] = {
  /* -20 */     88761,     71755,     56483,     46273,     36291,
@@ -145,6 +147,8 @@ static inline void scheduler_enqueue_task(struct scheduler_t * sched, struct tas
 
 	rb_link_node(&task->node, parent, link);
 	rb_insert_color_cached(&task->node, &sched->ready, leftmost);
+	sched->load += task->weight;
+	sched->nready++;
 	next = scheduler_next_ready_task(sched);
 	if(likely(next))
 		sched->min_vtime = next->vtime;
@@ -159,6 +163,8 @@ static inline void scheduler_dequeue_task(struct scheduler_t * sched, struct tas
 	struct task_t * next;
 
 	rb_erase_cached(&task->node, &sched->ready);
+	sched->load -= task->weight;
+	sched->nready--;
 	next = scheduler_next_ready_task(sched);
 	if(likely(next))
 		sched->min_vtime = next->vtime;
@@ -168,13 +174,45 @@ static inline void scheduler_dequeue_task(struct scheduler_t * sched, struct tas
 		sched->min_vtime = 0;
 }
 
+static inline struct task_t * scheduler_pick_next_task(struct scheduler_t * sched)
+{
+	struct task_t * next = scheduler_next_ready_task(sched);
+
+	if(likely(next))
+	{
+		scheduler_dequeue_task(sched, next);
+		next->status = TASK_STATUS_RUNNING;
+		next->oncpu = 1;
+	}
+	return next;
+}
+
+static inline struct scheduler_t * task_sched_lock(struct task_t * task, irq_flags_t * flags)
+{
+	struct scheduler_t * sched;
+
+	while(1)
+	{
+		sched = task->sched;
+		spin_lock_irqsave(&sched->lock, *flags);
+		if(likely(sched == task->sched))
+			return sched;
+		spin_unlock_irqrestore(&sched->lock, *flags);
+	}
+}
+
 static inline void scheduler_switch_task(struct scheduler_t * sched, struct task_t * task)
 {
 	struct task_t * running = sched->running;
 	sched->running = task;
 	struct transfer_t from = jump_fcontext(task->fctx, running);
 	struct task_t * t = (struct task_t *)from.priv;
-	t->fctx = from.fctx;
+	if(t)
+	{
+		t->fctx = from.fctx;
+		smp_wmb();
+		t->oncpu = 0;
+	}
 }
 
 static inline struct scheduler_t * scheduler_load_balance_choice(void)
@@ -194,21 +232,109 @@ static inline struct scheduler_t * scheduler_load_balance_choice(void)
 	return sched;
 }
 
+#if defined(CONFIG_MAX_SMP_CPUS) && (CONFIG_MAX_SMP_CPUS > 1)
+/*
+ * Pull one ready task from the busiest cpu. The task is chosen by weight, the
+ * heaviest one not exceeding half of the load difference, searching from the
+ * right of the victim's ready tree where the least urgent tasks live. An idle
+ * cpu takes any migratable task. The vtime is rebased against the min_vtime
+ * of the target so the task keeps its relative position.
+ */
+static int scheduler_load_balance(struct scheduler_t * sched)
+{
+	struct scheduler_t * src = NULL, * first, * second;
+	struct task_t * pos, * task = NULL;
+	struct rb_node * rb;
+	uint64_t load = 0, imbalance;
+	irq_flags_t flags;
+	int64_t lag;
+	int idle, i;
+
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+	{
+		if((&__sched[i] != sched) && (__sched[i].nready > 0) && (__sched[i].load > load))
+		{
+			src = &__sched[i];
+			load = __sched[i].load;
+		}
+	}
+	if(!src || (load <= sched->load))
+		return 0;
+
+	if(src < sched)
+	{
+		first = src;
+		second = sched;
+	}
+	else
+	{
+		first = sched;
+		second = src;
+	}
+	local_irq_save(flags);
+	spin_lock(&first->lock);
+	spin_lock(&second->lock);
+
+	sched->nsteal++;
+	idle = ((sched->running == sched->idle) && (sched->nready == 0)) ? 1 : 0;
+	imbalance = (src->load > sched->load) ? (src->load - sched->load) / 2 : 0;
+	for(rb = rb_last(&src->ready.rb_root), i = 0; rb && (i < 8); rb = rb_prev(rb), i++)
+	{
+		pos = rb_entry(rb, struct task_t, node);
+		if((pos == src->idle) || pos->oncpu)
+			continue;
+		if((pos->weight <= imbalance) && (!task || (pos->weight > task->weight)))
+			task = pos;
+		else if(idle && !task)
+			task = pos;
+	}
+	if(task)
+	{
+		lag = (int64_t)(task->vtime - src->min_vtime);
+		scheduler_dequeue_task(src, task);
+		src->weight -= task->weight;
+		task->sched = sched;
+		task->vtime = sched->min_vtime + lag;
+		sched->weight += task->weight;
+		scheduler_enqueue_task(sched, task);
+		sched->nmigrate++;
+	}
+
+	spin_unlock(&second->lock);
+	spin_unlock(&first->lock);
+	local_irq_restore(flags);
+	return task ? 1 : 0;
+}
+#else
+static inline int scheduler_load_balance(struct scheduler_t * sched)
+{
+	return 0;
+}
+#endif
+
 static void fcontext_entry_func(struct transfer_t from)
 {
 	struct task_t * t = (struct task_t *)from.priv;
 	struct scheduler_t * sched = t->sched;
 	struct task_t * next, * task = sched->running;
+	irq_flags_t flags;
 
 	t->fctx = from.fctx;
+	if(t != task)
+	{
+		smp_wmb();
+		t->oncpu = 0;
+	}
 	task->func(task, task->data);
+	sched = scheduler_self();
 	task_destroy(task);
+	sched->running = NULL;
 
-	next = scheduler_next_ready_task(sched);
+	spin_lock_irqsave(&sched->lock, flags);
+	next = scheduler_pick_next_task(sched);
+	spin_unlock_irqrestore(&sched->lock, flags);
 	if(likely(next))
 	{
-		scheduler_dequeue_task(sched, next);
-		next->status = TASK_STATUS_RUNNING;
 		next->start = ktime_to_ns(ktime_get());
 		scheduler_switch_task(sched, next);
 	}
@@ -217,6 +343,7 @@ static void fcontext_entry_func(struct transfer_t from)
 struct task_t * task_create(struct scheduler_t * sched, const char * name, task_func_t func, void * data, size_t stksz, int nice)
 {
 	struct task_t * task;
+	irq_flags_t flags;
 	void * stack;
 
 	if(!func)
@@ -246,13 +373,10 @@ struct task_t * task_create(struct scheduler_t * sched, const char * name, task_
 
 	RB_CLEAR_NODE(&task->node);
 	init_list_head(&task->list);
-	init_list_head(&task->slist);
-	init_list_head(&task->rlist);
-	init_list_head(&task->mlist);
-	spin_lock(&sched->lock);
+	spin_lock_irqsave(&sched->lock, flags);
 	list_add_tail(&task->list, &sched->suspend);
 	sched->weight += nice_to_weight[nice + 20];
-	spin_unlock(&sched->lock);
+	spin_unlock_irqrestore(&sched->lock, flags);
 
 	task->name = strdup(name);
 	task->status = TASK_STATUS_SUSPEND;
@@ -263,8 +387,11 @@ struct task_t * task_create(struct scheduler_t * sched, const char * name, task_
 	task->stack = stack;
 	task->stksz = stksz;
 	task->nice = nice;
+	task->bnice = nice;
+	init_list_head(&task->mheld);
 	task->weight = nice_to_weight[nice + 20];
 	task->inv_weight = nice_to_wmult[nice + 20];
+	task->oncpu = 0;
 	task->fctx = make_fcontext(task->stack + stksz, task->stksz, fcontext_entry_func);
 	task->func = func;
 	task->data = data;
@@ -275,11 +402,14 @@ struct task_t * task_create(struct scheduler_t * sched, const char * name, task_
 
 void task_destroy(struct task_t * task)
 {
+	struct scheduler_t * sched;
+	irq_flags_t flags;
+
 	if(task)
 	{
-		spin_lock(&task->sched->lock);
-		task->sched->weight -= nice_to_weight[task->nice + 20];
-		spin_unlock(&task->sched->lock);
+		sched = task_sched_lock(task, &flags);
+		sched->weight -= nice_to_weight[task->nice + 20];
+		spin_unlock_irqrestore(&sched->lock, flags);
 
 		if(task->name)
 			free(task->name);
@@ -288,8 +418,15 @@ void task_destroy(struct task_t * task)
 	}
 }
 
-void task_renice(struct task_t * task, int nice)
+/*
+ * Change the effective nice value only, the base one is kept. Used by mutex
+ * priority inheritance, which always returns to task->bnice.
+ */
+void task_inherit(struct task_t * task, int nice)
 {
+	struct scheduler_t * sched;
+	irq_flags_t flags;
+
 	if(nice < -20)
 		nice = -20;
 	else if(nice > 19)
@@ -297,66 +434,187 @@ void task_renice(struct task_t * task, int nice)
 
 	if(task->nice != nice)
 	{
-		spin_lock(&task->sched->lock);
-		task->sched->weight -= nice_to_weight[task->nice + 20];
-		task->sched->weight += nice_to_weight[nice + 20];
-		spin_unlock(&task->sched->lock);
-
+		sched = task_sched_lock(task, &flags);
+		sched->weight -= nice_to_weight[task->nice + 20];
+		sched->weight += nice_to_weight[nice + 20];
+		if(task->status == TASK_STATUS_READY)
+			sched->load = sched->load - task->weight + nice_to_weight[nice + 20];
 		task->nice = nice;
 		task->weight = nice_to_weight[nice + 20];
 		task->inv_weight = nice_to_wmult[nice + 20];
+		spin_unlock_irqrestore(&sched->lock, flags);
 	}
 }
 
-void task_suspend(struct task_t * task)
+void task_renice(struct task_t * task, int nice)
+{
+	if(nice < -20)
+		nice = -20;
+	else if(nice > 19)
+		nice = 19;
+
+	task->bnice = nice;
+	task_inherit(task, nice);
+}
+
+/*
+ * Suspend the running task, unless *wake has already been set. The flag is
+ * checked under the scheduler lock, the same lock task_wakeup() sets it with,
+ * so a wakeup can not be lost in between.
+ */
+static void task_suspend_running(struct task_t * task, int * wake)
 {
+	struct scheduler_t * sched = task->sched;
 	struct task_t * next;
+	irq_flags_t flags;
 	uint64_t now, detla;
 
+	now = ktime_to_ns(ktime_get());
+	detla = now - task->start;
+
+	task->time += detla;
+	task->vtime += calc_delta_fair(task, detla);
+	task->start = now;
+	spin_lock_irqsave(&sched->lock, flags);
+	if(wake && *wake)
+	{
+		spin_unlock_irqrestore(&sched->lock, flags);
+		return;
+	}
+	task->status = TASK_STATUS_SUSPEND;
+	list_add_tail(&task->list, &sched->suspend);
+	next = scheduler_pick_next_task(sched);
+	spin_unlock_irqrestore(&sched->lock, flags);
+
+	if(next)
+	{
+		next->start = now;
+		if(likely(next != task))
+			scheduler_switch_task(sched, next);
+	}
+}
+
+void task_suspend(struct task_t * task)
+{
+	struct scheduler_t * sched;
+	irq_flags_t flags;
+
 	if(task)
 	{
 		if(task->status == TASK_STATUS_READY)
 		{
-			task->status = TASK_STATUS_SUSPEND;
-			spin_lock(&task->sched->lock);
-			list_add_tail(&task->list, &task->sched->suspend);
-			spin_unlock(&task->sched->lock);
-			scheduler_dequeue_task(task->sched, task);
+			sched = task_sched_lock(task, &flags);
+			if(task->status == TASK_STATUS_READY)
+			{
+				task->status = TASK_STATUS_SUSPEND;
+				list_add_tail(&task->list, &sched->suspend);
+				scheduler_dequeue_task(sched, task);
+			}
+			spin_unlock_irqrestore(&sched->lock, flags);
 		}
 		else if(task->status == TASK_STATUS_RUNNING)
 		{
-			now = ktime_to_ns(ktime_get());
-			detla = now - task->start;
-
-			task->time += detla;
-			task->vtime += calc_delta_fair(task, detla);
-			task->status = TASK_STATUS_SUSPEND;
-			spin_lock(&task->sched->lock);
-			list_add_tail(&task->list, &task->sched->suspend);
-			spin_unlock(&task->sched->lock);
-
-			next = scheduler_next_ready_task(task->sched);
-			if(next)
-			{
-				scheduler_dequeue_task(task->sched, next);
-				next->status = TASK_STATUS_RUNNING;
-				next->start = now;
-				scheduler_switch_task(task->sched, next);
-			}
+			task_suspend_running(task, NULL);
 		}
 	}
 }
 
-void task_resume(struct task_t * task)
+static inline void __task_resume(struct scheduler_t * sched, struct task_t * task)
 {
-	if(task && (task->status == TASK_STATUS_SUSPEND))
+	if(task->status == TASK_STATUS_SUSPEND)
 	{
-		task->vtime = task->sched->min_vtime;
+		task->vtime = sched->min_vtime;
 		task->status = TASK_STATUS_READY;
-		spin_lock(&task->sched->lock);
 		list_del_init(&task->list);
-		spin_unlock(&task->sched->lock);
-		scheduler_enqueue_task(task->sched, task);
+		scheduler_enqueue_task(sched, task);
+	}
+}
+
+void task_resume(struct task_t * task)
+{
+	struct scheduler_t * sched;
+	irq_flags_t flags;
+
+	if(task && (task->status == TASK_STATUS_SUSPEND))
+	{
+		sched = task_sched_lock(task, &flags);
+		__task_resume(sched, task);
+		spin_unlock_irqrestore(&sched->lock, flags);
+	}
+}
+
+/*
+ * Set the wake flag and resume the task under its scheduler lock, pairs with
+ * the flag test in task_suspend_running so the wakeup can not slip in between
+ * the test and the suspend. A timeout never overrides a real wakeup.
+ */
+void task_wakeup(struct task_t * task, int * wake, int value)
+{
+	struct scheduler_t * sched;
+	irq_flags_t flags;
+
+	sched = task_sched_lock(task, &flags);
+	if((value > 0) || (*wake == 0))
+		*wake = value;
+	__task_resume(sched, task);
+	spin_unlock_irqrestore(&sched->lock, flags);
+}
+
+struct task_timeout_t {
+	struct timer_t timer;
+	struct task_t * task;
+	int * wake;
+};
+
+static int task_timeout_function(struct timer_t * timer, void * data)
+{
+	struct task_timeout_t * t = (struct task_timeout_t *)data;
+
+	task_wakeup(t->task, t->wake, -1);
+	return 0;
+}
+
+int task_wait_timeout(int * wake, int64_t ns)
+{
+	struct task_t * self = task_self();
+	struct task_timeout_t t;
+	int w = 0;
+
+	if(!wake)
+		wake = &w;
+	if(ns >= 0)
+	{
+		t.task = self;
+		t.wake = wake;
+		timer_init(&t.timer, task_timeout_function, &t);
+		timer_start_now(&t.timer, ns_to_ktime(ns));
+	}
+	task_suspend_running(self, wake);
+	if(ns >= 0)
+		timer_cancel(&t.timer);
+	return (*wake < 0) ? 0 : 1;
+}
+
+void task_sleep(uint64_t ns)
+{
+	uint64_t end = ktime_to_ns(ktime_get()) + ns;
+	int64_t remain;
+	int wake;
+
+	if(!task_self())
+	{
+		while((int64_t)(end - ktime_to_ns(ktime_get())) > 0);
+		return;
+	}
+	if(ns == 0)
+	{
+		task_yield();
+		return;
+	}
+	while((remain = (int64_t)(end - ktime_to_ns(ktime_get()))) > 0)
+	{
+		wake = 0;
+		task_wait_timeout(&wake, remain);
 	}
 }
 
@@ -366,9 +624,17 @@ void task_yield(void)
 	struct task_t * next, * self = task_self();
 	uint64_t now = ktime_to_ns(ktime_get());
 	uint64_t detla = now - self->start;
+	irq_flags_t flags;
 
 	self->time += detla;
 	self->vtime += calc_delta_fair(self, detla);
+	sched->need_resched = 0;
+
+	if((CONFIG_MAX_SMP_CPUS > 1) && ((int64_t)(now - sched->balance) >= 0))
+	{
+		sched->balance = now + CONFIG_SCHED_BALANCE_INTERVAL;
+		scheduler_load_balance(sched);
+	}
 
 	if((int64_t)(self->vtime - sched->min_vtime) < 0)
 	{
@@ -376,11 +642,11 @@ void task_yield(void)
 	}
 	else
 	{
+		spin_lock_irqsave(&sched->lock, flags);
 		self->status = TASK_STATUS_READY;
 		scheduler_enqueue_task(sched, self);
-		next = scheduler_next_ready_task(sched);
-		scheduler_dequeue_task(sched, next);
-		next->status = TASK_STATUS_RUNNING;
+		next = scheduler_pick_next_task(sched);
+		spin_unlock_irqrestore(&sched->lock, flags);
 		next->start = now;
 		if(likely(next != self))
 			scheduler_switch_task(sched, next);
@@ -389,64 +655,84 @@ void task_yield(void)
 
 static void idle_task(struct task_t * task, void * data)
 {
+	struct scheduler_t * sched = task->sched;
+
 	while(1)
 	{
+		scheduler_load_balance(sched);
 		task_yield();
 	}
 }
 
-static void smpboot_entry_func(void)
+/*
+ * The scheduler tick runs in interrupt context and can not switch fcontext
+ * there, it only raises need_resched when the running task has gone past
+ * min_vtime by more than the granularity, the switch is taken at the next
+ * task_preempt() point.
+ */
+static int scheduler_tick(struct timer_t * timer, void * data)
 {
-	machine_smpinit();
-
-	struct scheduler_t * sched = scheduler_self();
-	struct task_t * task = task_create(sched, "idle", idle_task, (void *)(unsigned long)(smp_processor_id()), SZ_8K, 0);
-	spin_lock(&sched->lock);
-	sched->weight -= task->weight;
-	task->nice = 26;
-	task->weight = 3;
-	task->inv_weight = 1431655765;
-	sched->weight += task->weight;
-	spin_unlock(&sched->lock);
-	task_resume(task);
+	struct scheduler_t * sched = (struct scheduler_t *)data;
+	struct task_t * running = sched->running;
+	uint64_t now = ktime_to_ns(ktime_get());
+	uint64_t vtime;
 
-	struct task_t * next = scheduler_next_ready_task(sched);
-	if(next)
+	if(running && (sched->nready > 0))
 	{
-		sched->running = next;
-		scheduler_dequeue_task(sched, next);
-		next->status = TASK_STATUS_RUNNING;
-		next->start = ktime_to_ns(ktime_get());
-		scheduler_switch_task(sched, next);
+		vtime = running->vtime + calc_delta_fair(running, now - running->start);
+		if((int64_t)(vtime - sched->min_vtime) > CONFIG_SCHED_GRANULARITY)
+			sched->need_resched = 1;
 	}
+	timer_forward_now(timer, ns_to_ktime(CONFIG_SCHED_GRANULARITY));
+	return 1;
 }
 
-void scheduler_loop(void)
+static void scheduler_start(struct scheduler_t * sched)
 {
-	machine_smpboot(smpboot_entry_func);
-
-	struct scheduler_t * sched = scheduler_self();
 	struct task_t * task = task_create(sched, "idle", idle_task, (void *)(unsigned long)smp_processor_id(), SZ_8K, 0);
-	spin_lock(&sched->lock);
+	struct task_t * next;
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&sched->lock, flags);
 	sched->weight -= task->weight;
 	task->nice = 26;
+	task->bnice = 26;
 	task->weight = 3;
 	task->inv_weight = 1431655765;
 	sched->weight += task->weight;
-	spin_unlock(&sched->lock);
+	sched->idle = task;
+	spin_unlock_irqrestore(&sched->lock, flags);
 	task_resume(task);
 
-	struct task_t * next = scheduler_next_ready_task(sched);
+	if(CONFIG_SCHED_PREEMPT)
+	{
+		timer_init(&__sched_tick[sched - &__sched[0]], scheduler_tick, sched);
+		timer_start_now(&__sched_tick[sched - &__sched[0]], ns_to_ktime(CONFIG_SCHED_GRANULARITY));
+	}
+
+	spin_lock_irqsave(&sched->lock, flags);
+	next = scheduler_pick_next_task(sched);
+	spin_unlock_irqrestore(&sched->lock, flags);
 	if(next)
 	{
 		sched->running = next;
-		scheduler_dequeue_task(sched, next);
-		next->status = TASK_STATUS_RUNNING;
 		next->start = ktime_to_ns(ktime_get());
 		scheduler_switch_task(sched, next);
 	}
 }
 
+static void smpboot_entry_func(void)
+{
+	machine_smpinit();
+	scheduler_start(scheduler_self());
+}
+
+void scheduler_loop(void)
+{
+	machine_smpboot(smpboot_entry_func);
+	scheduler_start(scheduler_self());
+}
+
 void do_init_sched(void)
 {
 	struct scheduler_t * sched;
@@ -461,8 +747,15 @@ void do_init_sched(void)
 		sched->ready = RB_ROOT_CACHED;
 		init_list_head(&sched->suspend);
 		sched->running = NULL;
+		sched->idle = NULL;
 		sched->min_vtime = 0;
 		sched->weight = 0;
+		sched->load = 0;
+		sched->nready = 0;
+		sched->balance = 0;
+		sched->nsteal = 0;
+		sched->nmigrate = 0;
+		sched->need_resched = 0;
 		spin_unlock(&sched->lock);
 	}
 }
@@ -0,0 +1,98 @@
+/*
+ * kernel/core/waitqueue.c
+ *
+ * Copyright(c) 2007-2020 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <xboot/waitqueue.h>
+
+void waitqueue_init(struct waitqueue_t * wq)
+{
+	init_list_head(&wq->list);
+	spin_lock_init(&wq->lock);
+}
+
+void waitqueue_prepare(struct waitqueue_t * wq, struct waiter_t * w)
+{
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&wq->lock, flags);
+	w->wake = 0;
+	if(list_empty(&w->entry))
+		list_add_tail(&w->entry, &wq->list);
+	spin_unlock_irqrestore(&wq->lock, flags);
+	smp_mb();
+}
+
+void waitqueue_finish(struct waitqueue_t * wq, struct waiter_t * w)
+{
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&wq->lock, flags);
+	list_del_init(&w->entry);
+	spin_unlock_irqrestore(&wq->lock, flags);
+}
+
+int waitqueue_wait(struct waitqueue_t * wq, int64_t ns)
+{
+	struct waiter_t w;
+	int ret;
+
+	waiter_init(&w);
+	waitqueue_prepare(wq, &w);
+	ret = task_wait_timeout(&w.wake, ns);
+	waitqueue_finish(wq, &w);
+	return ret;
+}
+
+void waitqueue_wakeup(struct waitqueue_t * wq)
+{
+	struct waiter_t * w;
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&wq->lock, flags);
+	if(!list_empty(&wq->list))
+	{
+		w = list_first_entry(&wq->list, struct waiter_t, entry);
+		list_del_init(&w->entry);
+		task_wakeup(w->task, &w->wake, 1);
+	}
+	spin_unlock_irqrestore(&wq->lock, flags);
+}
+
+void waitqueue_wakeup_all(struct waitqueue_t * wq)
+{
+	struct waiter_t * pos, * n;
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&wq->lock, flags);
+	list_for_each_entry_safe(pos, n, &wq->list, entry)
+	{
+		list_del_init(&pos->entry);
+		task_wakeup(pos->task, &pos->wake, 1);
+	}
+	spin_unlock_irqrestore(&wq->lock, flags);
+}
@@ -89,6 +89,60 @@ static inline struct window_manager_t * window_manager_search(struct framebuffer
 	return NULL;
 }
 
+/*
+ * Page flip buffers are vram backed surfaces rendered into directly. Each one
+ * accumulates the damage of the frames presented since it was drawn last, so
+ * only that part needs to be repainted when it becomes the back buffer again.
+ */
+static void window_manager_flip_init(struct window_manager_t * wm)
+{
+	struct region_t region;
+	int i;
+
+	wm->flip.count = 0;
+	wm->flip.back = 0;
+	for(i = 0; i < ARRAY_SIZE(wm->flip.s); i++)
+	{
+		wm->flip.s[i] = NULL;
+		wm->flip.damage[i] = NULL;
+	}
+	if(!CONFIG_WINDOW_PAGE_FLIP)
+		return;
+
+	region_init(&region, 0, 0, framebuffer_get_width(wm->fb), framebuffer_get_height(wm->fb));
+	for(i = 0; i < ARRAY_SIZE(wm->flip.s); i++)
+	{
+		wm->flip.s[i] = framebuffer_get_buffer(wm->fb, i);
+		if(!wm->flip.s[i])
+			break;
+		wm->flip.damage[i] = region_damage_alloc(region.w, region.h, CONFIG_WINDOW_DAMAGE_TILE_SIZE);
+		if(!wm->flip.damage[i])
+			break;
+		region_damage_add(wm->flip.damage[i], &region);
+	}
+	if(i < 2)
+	{
+		for(i = 0; i < ARRAY_SIZE(wm->flip.s); i++)
+		{
+			region_damage_free(wm->flip.damage[i]);
+			wm->flip.s[i] = NULL;
+			wm->flip.damage[i] = NULL;
+		}
+		return;
+	}
+	wm->flip.count = i;
+	wm->flip.back = 1;
+}
+
+static void window_manager_flip_exit(struct window_manager_t * wm)
+{
+	int i;
+
+	for(i = 0; i < wm->flip.count; i++)
+		region_damage_free(wm->flip.damage[i]);
+	wm->flip.count = 0;
+}
+
 static struct window_manager_t * window_manager_alloc(const char * fb)
 {
 	struct window_manager_t * wm;
@@ -119,7 +173,8 @@ static struct window_manager_t * window_manager_alloc(const char * fb)
 		return NULL;
 
 	wm->fb = dev;
-	wm->event = fifo_alloc(sizeof(struct event_t) * CONFIG_EVENT_FIFO_SIZE);
+	wm->event = fifo_alloc_mode(sizeof(struct event_t) * CONFIG_EVENT_FIFO_SIZE, FIFO_MODE_MPSC);
+	waitqueue_init(&wm->wait);
 	wm->wcount = 0;
 	wm->refresh = 0;
 	wm->cursor.s = s;
@@ -127,6 +182,7 @@ static struct window_manager_t * window_manager_alloc(const char * fb)
 	region_init(&wm->cursor.rn, 0, 0, surface_get_width(wm->cursor.s) + 2, surface_get_height(wm->cursor.s) + 2);
 	wm->cursor.dirty = 0;
 	wm->cursor.show = 0;
+	window_manager_flip_init(wm);
 	spin_lock_init(&wm->lock);
 	init_list_head(&wm->list);
 	init_list_head(&wm->window);
@@ -154,6 +210,7 @@ static void window_manager_free(struct window_manager_t * wm)
 			spin_unlock_irqrestore(&__window_manager_lock, flags);
 			fifo_free(pos->event);
 			surface_free(pos->cursor.s);
+			window_manager_flip_exit(pos);
 			free(pos);
 		}
 	}
@@ -175,8 +232,22 @@ struct window_t * window_alloc(const char * fb, const char * input, void * data)
 	if(!w)
 		return NULL;
 
+	/*
+	 * Page flipping can only present through the damage tracker
+	 */
+	w->damage = region_damage_alloc(framebuffer_get_width(wm->fb), framebuffer_get_height(wm->fb), CONFIG_WINDOW_DAMAGE_TILE_SIZE);
+	if((wm->flip.count > 0) && !w->damage)
+	{
+		free(w);
+		if(wm->wcount <= 0)
+			window_manager_free(wm);
+		return NULL;
+	}
 	w->wm = wm;
-	w->s = framebuffer_create_surface(w->wm->fb);
+	if(wm->flip.count > 0)
+		w->s = wm->flip.s[(wm->flip.back + wm->flip.count - 1) % wm->flip.count];
+	else
+		w->s = framebuffer_create_surface(w->wm->fb);
 	w->rl = region_list_alloc(0);
 	w->launcher = 0;
 	w->priv = data;
@@ -230,11 +301,13 @@ void window_free(struct window_t * w)
 	w->wm->wcount--;
 	w->wm->refresh = 1;
 	spin_unlock(&w->wm->lock);
-	if(w->wm->wcount <= 0)
-		window_manager_free(w->wm);
 	hmap_free(w->map);
-	framebuffer_destroy_surface(w->wm->fb, w->s);
+	if(w->wm->flip.count <= 0)
+		framebuffer_destroy_surface(w->wm->fb, w->s);
 	region_list_free(w->rl);
+	region_damage_free(w->damage);
+	if(w->wm->wcount <= 0)
+		window_manager_free(w->wm);
 	free(w);
 }
 
@@ -268,29 +341,70 @@ void window_region_list_add(struct window_t * w, struct region_t * r)
 	{
 		region_init(&region, 0, 0, framebuffer_get_width(w->wm->fb), framebuffer_get_height(w->wm->fb));
 		if(region_intersect(&region, &region, r))
-			region_list_add(w->rl, &region);
+		{
+			if(w->damage)
+				region_damage_add(w->damage, &region);
+			else
+				region_list_add(w->rl, &region);
+		}
 	}
 }
 
 void window_region_list_clear(struct window_t * w)
 {
 	if(w)
+	{
 		region_list_clear(w->rl);
+		region_damage_clear(w->damage);
+	}
+}
+
+/*
+ * The draw callback renders each dirty region on its own, overlapping regions
+ * would blend their common pixels twice. They are collapsed into the bounding
+ * box first, so clearing, drawing and presenting all cover the same pixels.
+ */
+static void window_region_list_disjoint(struct window_t * w)
+{
+	struct region_list_t * rl = w->rl;
+	struct region_t r, region;
+	int i, j;
+
+	for(i = 0; i < rl->count; i++)
+	{
+		for(j = i + 1; j < rl->count; j++)
+		{
+			if(region_intersect(&r, &rl->region[i], &rl->region[j]) && !region_isempty(&r))
+				break;
+		}
+		if(j < rl->count)
+			break;
+	}
+	if(i < rl->count)
+	{
+		region_clone(&region, &rl->region[0]);
+		for(i = 1; i < rl->count; i++)
+			region_union(&region, &region, &rl->region[i]);
+		region_list_clear(rl);
+		region_list_add(rl, &region);
+	}
 }
 
 void window_present(struct window_t * w, struct color_t * c, void * o, void (*draw)(struct window_t *, void *))
 {
-	struct surface_t * s = w->s;
+	struct window_manager_t * wm = w->wm;
+	struct surface_t * s;
 	struct region_t * r, region;
 	struct matrix_t m;
+	int flip = 0;
 	int count;
 	int i;
 
 	if(w->wm->refresh)
 	{
 		region_init(&region, 0, 0, framebuffer_get_width(w->wm->fb), framebuffer_get_height(w->wm->fb));
-		region_list_clear(w->rl);
-		region_list_add(w->rl, &region);
+		window_region_list_clear(w);
+		window_region_list_add(w, &region);
 		w->wm->refresh = 0;
 	}
 	else if(w->wm->cursor.show && w->wm->cursor.dirty)
@@ -299,6 +413,22 @@ void window_present(struct window_t * w, struct color_t * c, void * o, void (*dr
 		window_region_list_add(w, &w->wm->cursor.rn);
 		w->wm->cursor.dirty = 0;
 	}
+	if((wm->flip.count > 0) && w->damage && w->damage->dirty)
+	{
+		for(i = 0; i < wm->flip.count; i++)
+		{
+			if(i != wm->flip.back)
+				region_damage_merge(wm->flip.damage[i], w->damage);
+		}
+		region_damage_merge(w->damage, wm->flip.damage[wm->flip.back]);
+		region_damage_clear(wm->flip.damage[wm->flip.back]);
+		w->s = wm->flip.s[wm->flip.back];
+		flip = 1;
+	}
+	if(w->damage)
+		region_damage_to_list(w->damage, w->rl);
+	window_region_list_disjoint(w);
+	s = w->s;
 	if((count = w->rl->count) > 0)
 	{
 		for(i = 0; i < count; i++)
@@ -316,7 +446,13 @@ void window_present(struct window_t * w, struct color_t * c, void * o, void (*dr
 			surface_blit(s, NULL, &m, w->wm->cursor.s, RENDER_TYPE_GOOD);
 		}
 	}
-	framebuffer_present_surface(w->wm->fb, w->s, w->rl);
+	if(flip)
+	{
+		framebuffer_flip(wm->fb, wm->flip.back);
+		wm->flip.back = (wm->flip.back + 1) % wm->flip.count;
+	}
+	else if(wm->flip.count <= 0)
+		framebuffer_present_surface(w->wm->fb, w->s, w->rl);
 }
 
 int window_pump_event(struct window_t * w, struct event_t * e)
@@ -333,6 +469,13 @@ int window_pump_event(struct window_t * w, struct event_t * e)
 	return 0;
 }
 
+int window_wait_event(struct window_t * w, int64_t ns)
+{
+	if(w)
+		return wait_event_timeout(&w->wm->wait, fifo_len(w->wm->event) > 0, ns) ? 1 : 0;
+	return 0;
+}
+
 void push_event(struct event_t * e)
 {
 	struct window_manager_t * pos, * n;
@@ -403,6 +546,8 @@ void push_event(struct event_t * e)
 				break;
 			}
 			fifo_put(pos->event, (unsigned char *)e, sizeof(struct event_t));
+			if(waitqueue_active(&pos->wait))
+				waitqueue_wakeup_all(&pos->wait);
 		}
 	}
 }
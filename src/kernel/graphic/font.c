@@ -26,10 +26,41 @@
  *
  */
 
+#include <xconfigs.h>
 #include <graphic/font.h>
+#include <graphic/surface.h>
 #include <ft2build.h>
 #include FT_FREETYPE_H
 
+/*
+ * Glyph resolution results, direct mapped on (family, code). Misses are
+ * cached too, with a zero index and the face of the last fallback tried.
+ */
+struct font_code_t {
+	struct font_family_t * family;
+	u32_t code;
+	void * face;
+	int index;
+};
+
+/*
+ * Rendered glyphs are kept in a bounded lru keyed by (face, glyph, size,
+ * subpixel offset). The coverage bitmaps live in one a8 atlas packed in
+ * shelves, space of evicted entries is only reclaimed when the atlas is
+ * full and the whole cache is dropped. Surfaces are always 32 bits per
+ * pixel, so the atlas surface is a quarter of CONFIG_FONT_ATLAS_SIZE wide
+ * and each of its rows holds CONFIG_FONT_ATLAS_SIZE coverage bytes.
+ */
+struct font_cache_t {
+	struct font_code_t codes[CONFIG_FONT_CODE_CACHE_SIZE];
+	struct hlist_head hash[CONFIG_FONT_GLYPH_HASH_SIZE];
+	struct list_head lru;
+	struct list_head free;
+	struct font_glyph_t glyphs[CONFIG_FONT_GLYPH_CACHE_SIZE];
+	struct surface_t * atlas;
+	int x, y, h;
+};
+
 struct font_description_t {
 	const char * family;
 	const char * path;
@@ -42,6 +73,169 @@ static struct font_description_t fdesc[] = {
 	{"roboto-bold-italic",	"/framework/assets/fonts/Roboto-BoldItalic.ttf"},
 };
 
+static void font_cache_reset(struct font_cache_t * c)
+{
+	int i;
+
+	for(i = 0; i < CONFIG_FONT_GLYPH_HASH_SIZE; i++)
+		init_hlist_head(&c->hash[i]);
+	init_list_head(&c->lru);
+	init_list_head(&c->free);
+	for(i = 0; i < CONFIG_FONT_GLYPH_CACHE_SIZE; i++)
+	{
+		init_hlist_node(&c->glyphs[i].node);
+		list_add_tail(&c->glyphs[i].entry, &c->free);
+	}
+	c->x = 0;
+	c->y = 0;
+	c->h = 0;
+}
+
+static inline unsigned int font_glyph_hash(void * face, int index, int size, int sub)
+{
+	unsigned int h = (unsigned int)((unsigned long)face >> 4);
+
+	h = h * 31 + (unsigned int)index;
+	h = h * 31 + (unsigned int)size;
+	h = h * 4 + (unsigned int)sub;
+	return h % CONFIG_FONT_GLYPH_HASH_SIZE;
+}
+
+static uint8_t * font_atlas_alloc(struct font_cache_t * c, int w, int h)
+{
+	uint8_t * p;
+
+	if(c->x + w > CONFIG_FONT_ATLAS_SIZE)
+	{
+		c->x = 0;
+		c->y += c->h;
+		c->h = 0;
+	}
+	if(c->y + h > CONFIG_FONT_ATLAS_SIZE)
+		return NULL;
+	p = (uint8_t *)surface_get_pixels(c->atlas) + c->y * surface_get_stride(c->atlas) + c->x;
+	c->x += w;
+	if(h > c->h)
+		c->h = h;
+	return p;
+}
+
+struct font_glyph_t * font_glyph_search(struct font_context_t * ctx, void * face, int index, int size, int sub)
+{
+	struct font_cache_t * c = ctx->cache;
+	struct font_glyph_t * g;
+
+	if(!c || !face)
+		return NULL;
+	hlist_for_each_entry(g, &c->hash[font_glyph_hash(face, index, size, sub)], node)
+	{
+		if((g->face == face) && (g->index == index) && (g->size == size) && (g->sub == sub))
+		{
+			list_move(&g->entry, &c->lru);
+			return g;
+		}
+	}
+	return NULL;
+}
+
+struct font_glyph_t * font_glyph_lookup(struct font_context_t * ctx, void * face, int index, int size, int sub)
+{
+	struct font_cache_t * c = ctx->cache;
+	struct font_glyph_t * g;
+	FT_GlyphSlot slot;
+	FT_Vector delta;
+	uint8_t * p;
+	int stride;
+	int y;
+
+	if(!c || !face)
+		return NULL;
+	g = font_glyph_search(ctx, face, index, size, sub);
+	if(g)
+		return g;
+
+	FT_Set_Pixel_Sizes((FT_Face)face, size, size);
+	delta.x = sub << 4;
+	delta.y = 0;
+	FT_Set_Transform((FT_Face)face, NULL, &delta);
+	y = FT_Load_Glyph((FT_Face)face, index, FT_LOAD_RENDER);
+	FT_Set_Transform((FT_Face)face, NULL, NULL);
+	if(y != 0)
+		return NULL;
+	slot = ((FT_Face)face)->glyph;
+
+	/*
+	 * Glyphs larger than the atlas are kept with their metrics only and
+	 * rendered uncached, dropping the cache could never make room for them.
+	 */
+	p = NULL;
+	stride = surface_get_stride(c->atlas);
+	if((slot->bitmap.pixel_mode == FT_PIXEL_MODE_GRAY) && (slot->bitmap.width > 0) && (slot->bitmap.rows > 0)
+		&& (slot->bitmap.width <= stride) && (slot->bitmap.rows <= surface_get_height(c->atlas)))
+	{
+		p = font_atlas_alloc(c, slot->bitmap.width, slot->bitmap.rows);
+		if(!p)
+		{
+			font_cache_reset(c);
+			p = font_atlas_alloc(c, slot->bitmap.width, slot->bitmap.rows);
+		}
+		if(p)
+		{
+			for(y = 0; y < slot->bitmap.rows; y++)
+				memcpy(p + y * stride, slot->bitmap.buffer + y * slot->bitmap.pitch, slot->bitmap.width);
+		}
+	}
+
+	if(!list_empty(&c->free))
+		g = list_first_entry(&c->free, struct font_glyph_t, entry);
+	else
+		g = list_last_entry(&c->lru, struct font_glyph_t, entry);
+	hlist_del_init(&g->node);
+	list_move(&g->entry, &c->lru);
+	hlist_add_head(&g->node, &c->hash[font_glyph_hash(face, index, size, sub)]);
+
+	g->face = face;
+	g->index = index;
+	g->size = size;
+	g->sub = sub;
+	g->left = slot->bitmap_left;
+	g->top = slot->bitmap_top;
+	g->width = slot->bitmap.width;
+	g->height = slot->bitmap.rows;
+	g->advance = slot->advance.x;
+	g->hadvance = slot->metrics.horiAdvance;
+	g->vadvance = slot->metrics.vertAdvance;
+	g->hbearingx = slot->metrics.horiBearingX;
+	g->hbearingy = slot->metrics.horiBearingY;
+	g->bitmap = p;
+	g->pitch = stride;
+	return g;
+}
+
+void font_glyph_flush(struct font_context_t * ctx, void * face)
+{
+	struct font_cache_t * c;
+	struct font_glyph_t * g, * n;
+
+	if(ctx && ctx->cache)
+	{
+		c = ctx->cache;
+		if(!face)
+		{
+			font_cache_reset(c);
+			return;
+		}
+		list_for_each_entry_safe(g, n, &c->lru, entry)
+		{
+			if(g->face == face)
+			{
+				hlist_del_init(&g->node);
+				list_move_tail(&g->entry, &c->free);
+			}
+		}
+	}
+}
+
 struct font_context_t * font_context_alloc(void)
 {
 	struct font_context_t * ctx;
@@ -51,6 +245,22 @@ struct font_context_t * font_context_alloc(void)
 		return NULL;
 	FT_Init_FreeType((FT_Library *)&ctx->library);
 	ctx->map = hmap_alloc(0);
+	ctx->families = hmap_alloc(0);
+	ctx->cache = malloc(sizeof(struct font_cache_t));
+	if(ctx->cache)
+	{
+		ctx->cache->atlas = surface_alloc(CONFIG_FONT_ATLAS_SIZE >> 2, CONFIG_FONT_ATLAS_SIZE, NULL);
+		if(!ctx->cache->atlas)
+		{
+			free(ctx->cache);
+			ctx->cache = NULL;
+		}
+		else
+		{
+			memset(ctx->cache->codes, 0, sizeof(ctx->cache->codes));
+			font_cache_reset(ctx->cache);
+		}
+	}
 	return ctx;
 }
 
@@ -60,12 +270,31 @@ static void face_done_callback(const char * key, void * value)
 		FT_Done_Face((FT_Face)value);
 }
 
+static void family_free_callback(const char * key, void * value)
+{
+	if(value)
+		free(value);
+}
+
+static void font_code_flush(struct font_context_t * ctx)
+{
+	if(ctx->cache)
+		memset(ctx->cache->codes, 0, sizeof(ctx->cache->codes));
+}
+
 void font_context_free(struct font_context_t * ctx)
 {
 	if(ctx)
 	{
 		hmap_walk(ctx->map, face_done_callback);
 		hmap_free(ctx->map);
+		hmap_walk(ctx->families, family_free_callback);
+		hmap_free(ctx->families);
+		if(ctx->cache)
+		{
+			surface_free(ctx->cache->atlas);
+			free(ctx->cache);
+		}
 		FT_Done_FreeType((FT_Library)ctx->library);
 	}
 }
@@ -80,6 +309,7 @@ void font_install(struct font_context_t * ctx, const char * family, const char *
 		{
 			FT_Select_Charmap(face, FT_ENCODING_UNICODE);
 			hmap_add(ctx->map, family, face);
+			font_code_flush(ctx);
 		}
 	}
 }
@@ -90,9 +320,9 @@ static unsigned long ft_xfs_stream_io(FT_Stream stream, unsigned long offset, un
 
 	if(!count && offset > stream->size)
 		return 1;
-	if(stream->pos != offset)
-		xfs_seek(file, offset);
-	return (unsigned long)xfs_read(file, buffer, count);
+	if(!count)
+		return 0;
+	return (unsigned long)xfs_pread(file, buffer, count, offset);
 }
 
 static void ft_xfs_stream_close(FT_Stream stream)
@@ -111,7 +341,7 @@ static FT_Stream ft_new_xfs_stream(struct xfs_context_t * xfs, const char * path
 	FT_Stream stream = NULL;
 	struct xfs_file_t * file;
 
-	stream = malloc(sizeof(*stream));
+	stream = calloc(1, sizeof(*stream));
 	if(!stream)
 		return NULL;
 
@@ -131,9 +361,14 @@ static FT_Stream ft_new_xfs_stream(struct xfs_context_t * xfs, const char * path
 	}
 	xfs_seek(file, 0);
 
+	/*
+	 * A memory stream without read callback lets freetype access the
+	 * mapped file in place, the same as FT_New_Memory_Face
+	 */
+	stream->base = (unsigned char *)xfs_mmap(file, 0, stream->size);
 	stream->descriptor.pointer = file;
 	stream->pathname.pointer = (char *)pathname;
-	stream->read = ft_xfs_stream_io;
+	stream->read = stream->base ? NULL : ft_xfs_stream_io;
 	stream->close = ft_xfs_stream_close;
 
     return stream;
@@ -161,6 +396,7 @@ void font_install_from_xfs(struct font_context_t * ctx, struct xfs_context_t * x
 		{
 			FT_Select_Charmap(face, FT_ENCODING_UNICODE);
 			hmap_add(ctx->map, family, face);
+			font_code_flush(ctx);
 		}
 	}
 }
@@ -173,7 +409,12 @@ void font_uninstall(struct font_context_t * ctx, const char * family)
 	{
 		face = hmap_search(ctx->map, family);
 		if(face)
+		{
+			font_glyph_flush(ctx, face);
+			font_code_flush(ctx);
+			hmap_remove(ctx->map, family);
 			FT_Done_Face(face);
+		}
 	}
 }
 
@@ -200,26 +441,82 @@ static void * search_face(struct font_context_t * ctx, const char * family)
 	return NULL;
 }
 
-int search_glyph(struct font_context_t * ctx, const char * family, u32_t code, void ** face)
+/*
+ * Family lists are parsed once and interned in the context, so a family
+ * pointer identifies the list in the code cache for the context lifetime.
+ */
+struct font_family_t * search_family(struct font_context_t * ctx, const char * family)
+{
+	struct font_family_t * fam;
+	const char * q;
+	char * buf, * p, * r;
+	int n;
+
+	if(!family)
+		family = "";
+	fam = hmap_search(ctx->families, family);
+	if(fam)
+		return fam;
+	for(q = family, n = 1; *q; q++)
+	{
+		if(strchr(",;:|", *q))
+			n++;
+	}
+	fam = malloc(sizeof(struct font_family_t) + n * sizeof(char *) + strlen(family) + 1);
+	if(!fam)
+		return NULL;
+	buf = (char *)&fam->names[n];
+	strcpy(buf, family);
+	fam->n = 0;
+	p = buf;
+	while((r = strsep(&p, ",;:|")) != NULL)
+	{
+		if(*r)
+			fam->names[fam->n++] = r;
+	}
+	hmap_add(ctx->families, family, fam);
+	return fam;
+}
+
+int search_family_glyph(struct font_context_t * ctx, struct font_family_t * family, u32_t code, void ** face)
 {
-	char buffer[SZ_512];
-	char * r, * p;
+	struct font_code_t * c = NULL;
 	int glyph;
 	int i;
 
-	strlcpy(buffer, family ? family : "", sizeof(buffer));
-	p = buffer;
-	while((r = strsep(&p, ",;:|")) != NULL)
+	if(ctx->cache)
 	{
-		*face = search_face(ctx, r);
+		c = &ctx->cache->codes[(((unsigned long)family >> 4) * 31 + code) % CONFIG_FONT_CODE_CACHE_SIZE];
+		if((c->family == family) && (c->code == code) && c->face)
+		{
+			*face = c->face;
+			return c->index;
+		}
+	}
+	*face = NULL;
+	glyph = 0;
+	for(i = 0; family && (i < family->n); i++)
+	{
+		*face = search_face(ctx, family->names[i]);
 		if((glyph = FT_Get_Char_Index((FT_Face)(*face), code)) != 0)
-			return glyph;
+			break;
 	}
-	for(i = 0; i < ARRAY_SIZE(fdesc); i++)
+	for(i = 0; (glyph == 0) && (i < ARRAY_SIZE(fdesc)); i++)
 	{
 		*face = search_face(ctx, fdesc[i].family);
-		if((glyph = FT_Get_Char_Index((FT_Face)(*face), code)) != 0)
-			return glyph;
+		glyph = FT_Get_Char_Index((FT_Face)(*face), code);
 	}
-	return 0;
+	if(c)
+	{
+		c->family = family;
+		c->code = code;
+		c->face = *face;
+		c->index = glyph;
+	}
+	return glyph;
+}
+
+int search_glyph(struct font_context_t * ctx, const char * family, u32_t code, void ** face)
+{
+	return search_family_glyph(ctx, search_family(ctx, family), code, face);
 }
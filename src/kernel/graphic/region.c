@@ -175,7 +175,7 @@ void region_list_add(struct region_list_t * rl, struct region_t * r)
 	}
 	else
 	{
-		if(rl->size < rl->count)
+		if(rl->count >= rl->size)
 			region_list_resize(rl, rl->size << 1);
 		region_clone(&rl->region[rl->count], r);
 		rl->count++;
@@ -187,3 +187,164 @@ void region_list_clear(struct region_list_t * rl)
 	if(rl)
 		rl->count = 0;
 }
+
+static inline void region_list_append(struct region_list_t * rl, int x, int y, int w, int h)
+{
+	if(rl->count >= rl->size)
+		region_list_resize(rl, rl->size << 1);
+	region_init(&rl->region[rl->count], x, y, w, h);
+	rl->count++;
+}
+
+struct region_damage_t * region_damage_alloc(int width, int height, int tsize)
+{
+	struct region_damage_t * d;
+
+	if((width <= 0) || (height <= 0) || (tsize <= 0))
+		return NULL;
+
+	d = malloc(sizeof(struct region_damage_t));
+	if(!d)
+		return NULL;
+
+	d->width = width;
+	d->height = height;
+	d->shift = ilog2(tsize);
+	d->cols = (width + (1 << d->shift) - 1) >> d->shift;
+	d->rows = (height + (1 << d->shift) - 1) >> d->shift;
+	d->words = (d->cols + 31) >> 5;
+	d->bits = malloc(d->rows * d->words * sizeof(uint32_t));
+	d->spans = malloc((d->cols + 1) * 2 * sizeof(int));
+	if(!d->bits || !d->spans)
+	{
+		if(d->bits)
+			free(d->bits);
+		if(d->spans)
+			free(d->spans);
+		free(d);
+		return NULL;
+	}
+	region_damage_clear(d);
+	return d;
+}
+
+void region_damage_free(struct region_damage_t * d)
+{
+	if(d)
+	{
+		free(d->bits);
+		free(d->spans);
+		free(d);
+	}
+}
+
+void region_damage_add(struct region_damage_t * d, struct region_t * r)
+{
+	uint32_t * p;
+	int x0, x1, y0, y1;
+	int x, y;
+
+	if(!d || !r)
+		return;
+
+	x0 = max(r->x, 0);
+	y0 = max(r->y, 0);
+	x1 = min(r->x + r->w, d->width);
+	y1 = min(r->y + r->h, d->height);
+	if((x0 >= x1) || (y0 >= y1))
+		return;
+	x0 >>= d->shift;
+	y0 >>= d->shift;
+	x1 = (x1 - 1) >> d->shift;
+	y1 = (y1 - 1) >> d->shift;
+	for(y = y0; y <= y1; y++)
+	{
+		p = &d->bits[y * d->words];
+		for(x = x0; x <= x1; x++)
+			p[x >> 5] |= 1U << (x & 0x1f);
+	}
+	d->dirty = 1;
+}
+
+void region_damage_merge(struct region_damage_t * d, struct region_damage_t * o)
+{
+	int i;
+
+	if(d && o && o->dirty && (d->rows == o->rows) && (d->words == o->words))
+	{
+		for(i = 0; i < d->rows * d->words; i++)
+			d->bits[i] |= o->bits[i];
+		d->dirty = 1;
+	}
+}
+
+void region_damage_clear(struct region_damage_t * d)
+{
+	if(d)
+	{
+		memset(d->bits, 0, d->rows * d->words * sizeof(uint32_t));
+		d->dirty = 0;
+	}
+}
+
+/*
+ * Emit the damaged tiles as rectangles, runs of tiles in one row become one
+ * rectangle which grows downwards while the next row has exactly the same run.
+ * The rectangles never overlap and are clipped to the tracked area.
+ */
+void region_damage_to_list(struct region_damage_t * d, struct region_list_t * rl)
+{
+	struct region_t * r;
+	uint32_t * p;
+	int * prev, * next, * t;
+	int np = 0, nn, i;
+	int x, x0, y, ty, th, rx, rw;
+
+	if(!d || !rl)
+		return;
+	rl->count = 0;
+	if(!d->dirty)
+		return;
+
+	prev = d->spans;
+	next = d->spans + d->cols + 1;
+	for(y = 0; y < d->rows; y++)
+	{
+		p = &d->bits[y * d->words];
+		ty = y << d->shift;
+		th = min(d->height, ty + (1 << d->shift)) - ty;
+		nn = 0;
+		i = 0;
+		for(x = 0; x < d->cols;)
+		{
+			if(!(p[x >> 5] & (1U << (x & 0x1f))))
+			{
+				x = ((p[x >> 5] >> (x & 0x1f)) == 0) ? ((x | 0x1f) + 1) : (x + 1);
+				continue;
+			}
+			x0 = x;
+			while((x < d->cols) && (p[x >> 5] & (1U << (x & 0x1f))))
+				x++;
+			rx = x0 << d->shift;
+			rw = min(d->width, x << d->shift) - rx;
+			while((i < np) && (rl->region[prev[i]].x < rx))
+				i++;
+			if((i < np) && (rl->region[prev[i]].x == rx) && (rl->region[prev[i]].w == rw))
+			{
+				r = &rl->region[prev[i]];
+				r->h += th;
+				r->area = -1;
+				next[nn++] = prev[i++];
+			}
+			else
+			{
+				region_list_append(rl, rx, ty, rw, th);
+				next[nn++] = rl->count - 1;
+			}
+		}
+		t = prev;
+		prev = next;
+		next = t;
+		np = nn;
+	}
+}
@@ -28,15 +28,33 @@
 
 #include <xboot.h>
 #include <graphic/surface.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) && defined(__GNUC__) && (__GNUC__ >= 5)
+#include <immintrin.h>
+#define RENDER_HAVE_AVX2
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RENDER_HAVE_NEON
+#endif
 
-void * render_default_create(struct surface_t * s)
-{
-	return NULL;
-}
-
-void render_default_destroy(void * pctx)
-{
-}
+/*
+ * Pixel span operations, one table entry for each instruction set. The best
+ * one supported by the running cpu is selected at boot, the plain c version
+ * is always available as fallback.
+ */
+struct render_pixops_t {
+	const char * name;
+	int (*probe)(void);
+	void (*blend)(uint32_t * d, uint32_t * s, int n);
+	void (*fill)(uint32_t * d, uint32_t v, int n);
+	void (*bilinear)(uint32_t * d, uint32_t * s, int ss, int sw, int sh, int32_t u, int32_t v, int32_t du, int32_t dv, int n);
+	void (*halve)(uint32_t * d, uint32_t * s0, uint32_t * s1, int n);
+	void (*cover)(uint8_t * d, float * a, int n);
+	void (*mask)(uint32_t * d, uint8_t * m, uint32_t v, int n);
+};
 
 static inline void blend(uint32_t * d, uint32_t * s)
 {
@@ -70,20 +88,905 @@ static inline void blend(uint32_t * d, uint32_t * s)
 	}
 }
 
-void render_default_blit(struct surface_t * s, struct region_t * clip, struct matrix_t * m, struct surface_t * src, enum render_type_t type)
+static int pixops_c_probe(void)
 {
-	struct region_t r, region;
+	return 1;
+}
+
+static void pixops_c_blend(uint32_t * d, uint32_t * s, int n)
+{
+	while(n-- > 0)
+		blend(d++, s++);
+}
+
+static void pixops_c_fill(uint32_t * d, uint32_t v, int n)
+{
+	while(n-- > 0)
+		*d++ = v;
+}
+
+/*
+ * Fetch the four neighbours of the 16.16 source position (u, v), clamped to the
+ * source edges, and return the 8 bits horizontal and vertical weights.
+ */
+static inline void bilinear_fetch(uint32_t * s, int ss, int sw, int sh, int32_t u, int32_t v, uint32_t * p, int * wx, int * wy)
+{
+	uint32_t * r0, * r1;
+	int x0 = u >> 16, x1 = x0 + 1;
+	int y0 = v >> 16, y1 = y0 + 1;
+
+	if(x0 < 0)
+		x0 = 0;
+	if(x1 >= sw)
+		x1 = sw - 1;
+	if(y0 < 0)
+		y0 = 0;
+	if(y1 >= sh)
+		y1 = sh - 1;
+	r0 = s + y0 * ss;
+	r1 = s + y1 * ss;
+	p[0] = r0[x0];
+	p[1] = r0[x1];
+	p[2] = r1[x0];
+	p[3] = r1[x1];
+	*wx = (u >> 8) & 0xff;
+	*wy = (v >> 8) & 0xff;
+}
+
+static inline uint32_t lerp(uint32_t a, uint32_t b, int w)
+{
+	uint32_t rb, ag;
+
+	rb = ((((a >> 0) & 0x00ff00ff) * (256 - w) + ((b >> 0) & 0x00ff00ff) * w) >> 8) & 0x00ff00ff;
+	ag = ((((a >> 8) & 0x00ff00ff) * (256 - w) + ((b >> 8) & 0x00ff00ff) * w) >> 8) & 0x00ff00ff;
+	return rb | (ag << 8);
+}
+
+static inline uint32_t average(uint32_t a, uint32_t b)
+{
+	return (a | b) - (((a ^ b) >> 1) & 0x7f7f7f7f);
+}
+
+static void pixops_c_bilinear(uint32_t * d, uint32_t * s, int ss, int sw, int sh, int32_t u, int32_t v, int32_t du, int32_t dv, int n)
+{
+	uint32_t p[4];
+	int wx, wy;
+
+	for(; n > 0; n--, u += du, v += dv)
+	{
+		bilinear_fetch(s, ss, sw, sh, u, v, p, &wx, &wy);
+		*d++ = lerp(lerp(p[0], p[1], wx), lerp(p[2], p[3], wx), wy);
+	}
+}
+
+static void pixops_c_halve(uint32_t * d, uint32_t * s0, uint32_t * s1, int n)
+{
+	uint32_t rb, ag;
+
+	for(; n > 0; n--, s0 += 2, s1 += 2)
+	{
+		rb = ((s0[0] & 0x00ff00ff) + (s0[1] & 0x00ff00ff) + (s1[0] & 0x00ff00ff) + (s1[1] & 0x00ff00ff) + 0x00020002) >> 2;
+		ag = (((s0[0] >> 8) & 0x00ff00ff) + ((s0[1] >> 8) & 0x00ff00ff) + ((s1[0] >> 8) & 0x00ff00ff) + ((s1[1] >> 8) & 0x00ff00ff) + 0x00020002) >> 2;
+		*d++ = (rb & 0x00ff00ff) | ((ag & 0x00ff00ff) << 8);
+	}
+}
+
+/*
+ * Prefix sum the accumulated cell areas into 8 bits coverage, starting from the
+ * running sum acc, and clear the cells for the next use.
+ */
+static inline void cover_span(uint8_t * d, float * a, int n, float acc)
+{
+	float v;
+
+	for(; n > 0; n--)
+	{
+		acc += *a;
+		*a++ = 0;
+		v = fabsf(acc);
+		*d++ = (v >= 1.0f) ? 255 : (uint8_t)(v * 255.0f + 0.5f);
+	}
+}
+
+static inline uint32_t scale(uint32_t v, int a)
+{
+	uint32_t rb = (v & 0x00ff00ff) * a + 0x00800080;
+	uint32_t ag = ((v >> 8) & 0x00ff00ff) * a + 0x00800080;
+
+	rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+	ag = (ag + ((ag >> 8) & 0x00ff00ff)) & 0xff00ff00;
+	return rb | ag;
+}
+
+static void pixops_c_cover(uint8_t * d, float * a, int n)
+{
+	cover_span(d, a, n, 0);
+}
+
+static void pixops_c_mask(uint32_t * d, uint8_t * m, uint32_t v, int n)
+{
+	uint32_t s;
+
+	for(; n > 0; n--, d++, m++)
+	{
+		if(*m == 255)
+		{
+			blend(d, &v);
+		}
+		else if(*m != 0)
+		{
+			s = scale(v, *m);
+			blend(d, &s);
+		}
+	}
+}
+
+/*
+ * The vector versions use d' = s + ((d * (255 - sa) + d) >> 8) on every
+ * channel, which gives the same result as blend() for premultiplied pixels.
+ */
+#if defined(__SSE2__)
+static int pixops_sse2_probe(void)
+{
+	return 1;
+}
+
+static inline __m128i blend_sse2(__m128i d, __m128i s)
+{
+	__m128i z = _mm_setzero_si128();
+	__m128i na, lo, hi, dl, dh;
+
+	na = _mm_sub_epi32(_mm_set1_epi32(0xff), _mm_srli_epi32(s, 24));
+	na = _mm_or_si128(na, _mm_slli_epi32(na, 16));
+	dl = _mm_unpacklo_epi8(d, z);
+	dh = _mm_unpackhi_epi8(d, z);
+	lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(dl, _mm_unpacklo_epi32(na, na)), dl), 8);
+	hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(dh, _mm_unpackhi_epi32(na, na)), dh), 8);
+	return _mm_add_epi8(_mm_packus_epi16(lo, hi), s);
+}
+
+static void pixops_sse2_blend(uint32_t * d, uint32_t * s, int n)
+{
+	__m128i ff = _mm_set1_epi32(0xff);
+	__m128i z = _mm_setzero_si128();
+	__m128i vs, sa;
+
+	for(; n >= 4; n -= 4, d += 4, s += 4)
+	{
+		vs = _mm_loadu_si128((__m128i *)s);
+		sa = _mm_srli_epi32(vs, 24);
+		if(_mm_movemask_epi8(_mm_cmpeq_epi32(sa, ff)) == 0xffff)
+			_mm_storeu_si128((__m128i *)d, vs);
+		else if(_mm_movemask_epi8(_mm_cmpeq_epi32(sa, z)) != 0xffff)
+			_mm_storeu_si128((__m128i *)d, blend_sse2(_mm_loadu_si128((__m128i *)d), vs));
+	}
+	while(n-- > 0)
+		blend(d++, s++);
+}
+
+static void pixops_sse2_fill(uint32_t * d, uint32_t v, int n)
+{
+	__m128i vv = _mm_set1_epi32(v);
+
+	for(; n >= 4; n -= 4, d += 4)
+		_mm_storeu_si128((__m128i *)d, vv);
+	while(n-- > 0)
+		*d++ = v;
+}
+
+static inline __m128i lerp_sse2(__m128i a, __m128i b, __m128i w)
+{
+	__m128i iw = _mm_sub_epi16(_mm_set1_epi16(256), w);
+	return _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(a, iw), _mm_mullo_epi16(b, w)), 8);
+}
+
+static void pixops_sse2_bilinear(uint32_t * d, uint32_t * s, int ss, int sw, int sh, int32_t u, int32_t v, int32_t du, int32_t dv, int n)
+{
+	__m128i z = _mm_setzero_si128();
+	__m128i t, b, wx, wy;
+	uint32_t p[4], q[4];
+	int x0, y0, x1, y1;
+
+	for(; n >= 2; n -= 2, d += 2)
+	{
+		bilinear_fetch(s, ss, sw, sh, u, v, p, &x0, &y0);
+		u += du;
+		v += dv;
+		bilinear_fetch(s, ss, sw, sh, u, v, q, &x1, &y1);
+		u += du;
+		v += dv;
+		wx = _mm_set_epi16(x1, x1, x1, x1, x0, x0, x0, x0);
+		wy = _mm_set_epi16(y1, y1, y1, y1, y0, y0, y0, y0);
+		t = lerp_sse2(_mm_unpacklo_epi8(_mm_set_epi32(0, 0, q[0], p[0]), z), _mm_unpacklo_epi8(_mm_set_epi32(0, 0, q[1], p[1]), z), wx);
+		b = lerp_sse2(_mm_unpacklo_epi8(_mm_set_epi32(0, 0, q[2], p[2]), z), _mm_unpacklo_epi8(_mm_set_epi32(0, 0, q[3], p[3]), z), wx);
+		_mm_storel_epi64((__m128i *)d, _mm_packus_epi16(lerp_sse2(t, b, wy), z));
+	}
+	if(n > 0)
+		pixops_c_bilinear(d, s, ss, sw, sh, u, v, du, dv, n);
+}
+
+static inline __m128i halve_sum_sse2(uint32_t * s)
+{
+	__m128i z = _mm_setzero_si128();
+	__m128i v = _mm_loadu_si128((__m128i *)s);
+	__m128i lo = _mm_unpacklo_epi8(v, z);
+	__m128i hi = _mm_unpackhi_epi8(v, z);
+
+	lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+	hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+	return _mm_unpacklo_epi64(lo, hi);
+}
+
+static void pixops_sse2_halve(uint32_t * d, uint32_t * s0, uint32_t * s1, int n)
+{
+	__m128i two = _mm_set1_epi16(2);
+	__m128i lo, hi;
+
+	for(; n >= 4; n -= 4, d += 4, s0 += 8, s1 += 8)
+	{
+		lo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(halve_sum_sse2(s0), halve_sum_sse2(s1)), two), 2);
+		hi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(halve_sum_sse2(s0 + 4), halve_sum_sse2(s1 + 4)), two), 2);
+		_mm_storeu_si128((__m128i *)d, _mm_packus_epi16(lo, hi));
+	}
+	if(n > 0)
+		pixops_c_halve(d, s0, s1, n);
+}
+
+static void pixops_sse2_cover(uint8_t * d, float * a, int n)
+{
+	__m128 sign = _mm_set1_ps(-0.0f);
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 k = _mm_set1_ps(255.0f);
+	__m128 acc = _mm_setzero_ps();
+	__m128 x;
+	__m128i i;
+
+	for(; n >= 4; n -= 4, d += 4, a += 4)
+	{
+		x = _mm_loadu_ps(a);
+		_mm_storeu_ps(a, _mm_setzero_ps());
+		x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)));
+		x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 8)));
+		x = _mm_add_ps(x, acc);
+		acc = _mm_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3));
+		i = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_andnot_ps(sign, x), one), k));
+		i = _mm_packs_epi32(i, i);
+		*(uint32_t *)d = _mm_cvtsi128_si32(_mm_packus_epi16(i, i));
+	}
+	if(n > 0)
+		cover_span(d, a, n, _mm_cvtss_f32(acc));
+}
+
+static void pixops_sse2_mask(uint32_t * d, uint8_t * m, uint32_t v, int n)
+{
+	__m128i z = _mm_setzero_si128();
+	__m128i c = _mm_set1_epi16(0x80);
+	__m128i vv = _mm_set1_epi32(v);
+	__m128i vl = _mm_unpacklo_epi8(vv, z);
+	__m128i vm, lo, hi;
+	uint32_t mm;
+
+	for(; n >= 4; n -= 4, d += 4, m += 4)
+	{
+		memcpy(&mm, m, 4);
+		if(mm == 0)
+			continue;
+		if((mm == 0xffffffff) && ((v >> 24) == 0xff))
+		{
+			_mm_storeu_si128((__m128i *)d, vv);
+			continue;
+		}
+		vm = _mm_cvtsi32_si128(mm);
+		vm = _mm_unpacklo_epi8(vm, vm);
+		vm = _mm_unpacklo_epi16(vm, vm);
+		lo = _mm_add_epi16(_mm_mullo_epi16(vl, _mm_unpacklo_epi8(vm, z)), c);
+		hi = _mm_add_epi16(_mm_mullo_epi16(vl, _mm_unpackhi_epi8(vm, z)), c);
+		lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+		hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+		_mm_storeu_si128((__m128i *)d, blend_sse2(_mm_loadu_si128((__m128i *)d), _mm_packus_epi16(lo, hi)));
+	}
+	if(n > 0)
+		pixops_c_mask(d, m, v, n);
+}
+#endif
+
+#if defined(RENDER_HAVE_AVX2)
+static int pixops_avx2_probe(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") ? 1 : 0;
+}
+
+static __attribute__((target("avx2"))) void pixops_avx2_blend(uint32_t * d, uint32_t * s, int n)
+{
+	__m256i ff = _mm256_set1_epi32(0xff);
+	__m256i z = _mm256_setzero_si256();
+	__m256i vs, vd, sa, na, lo, hi, dl, dh;
+
+	for(; n >= 8; n -= 8, d += 8, s += 8)
+	{
+		vs = _mm256_loadu_si256((__m256i *)s);
+		sa = _mm256_srli_epi32(vs, 24);
+		if(_mm256_movemask_epi8(_mm256_cmpeq_epi32(sa, ff)) == -1)
+		{
+			_mm256_storeu_si256((__m256i *)d, vs);
+		}
+		else if(_mm256_movemask_epi8(_mm256_cmpeq_epi32(sa, z)) != -1)
+		{
+			vd = _mm256_loadu_si256((__m256i *)d);
+			na = _mm256_sub_epi32(ff, sa);
+			na = _mm256_or_si256(na, _mm256_slli_epi32(na, 16));
+			dl = _mm256_unpacklo_epi8(vd, z);
+			dh = _mm256_unpackhi_epi8(vd, z);
+			lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(dl, _mm256_unpacklo_epi32(na, na)), dl), 8);
+			hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(dh, _mm256_unpackhi_epi32(na, na)), dh), 8);
+			_mm256_storeu_si256((__m256i *)d, _mm256_add_epi8(_mm256_packus_epi16(lo, hi), vs));
+		}
+	}
+	pixops_sse2_blend(d, s, n);
+}
+
+static __attribute__((target("avx2"))) void pixops_avx2_fill(uint32_t * d, uint32_t v, int n)
+{
+	__m256i vv = _mm256_set1_epi32(v);
+
+	for(; n >= 8; n -= 8, d += 8)
+		_mm256_storeu_si256((__m256i *)d, vv);
+	while(n-- > 0)
+		*d++ = v;
+}
+#endif
+
+#if defined(RENDER_HAVE_NEON)
+static int pixops_neon_probe(void)
+{
+	return 1;
+}
+
+static void pixops_neon_blend(uint32_t * d, uint32_t * s, int n)
+{
+	uint32x4_t vs;
+	uint8x16_t vd, na;
+	uint16x8_t lo, hi;
+
+	for(; n >= 4; n -= 4, d += 4, s += 4)
+	{
+		if((s[0] & s[1] & s[2] & s[3]) >= 0xff000000)
+		{
+			vst1q_u32(d, vld1q_u32(s));
+		}
+		else if(((s[0] | s[1] | s[2] | s[3]) >> 24) != 0)
+		{
+			vs = vld1q_u32(s);
+			vd = vreinterpretq_u8_u32(vld1q_u32(d));
+			na = vmvnq_u8(vreinterpretq_u8_u32(vmulq_n_u32(vshrq_n_u32(vs, 24), 0x01010101)));
+			lo = vaddw_u8(vmull_u8(vget_low_u8(vd), vget_low_u8(na)), vget_low_u8(vd));
+			hi = vaddw_u8(vmull_u8(vget_high_u8(vd), vget_high_u8(na)), vget_high_u8(vd));
+			vd = vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8));
+			vst1q_u32(d, vreinterpretq_u32_u8(vaddq_u8(vd, vreinterpretq_u8_u32(vs))));
+		}
+	}
+	while(n-- > 0)
+		blend(d++, s++);
+}
+
+static void pixops_neon_fill(uint32_t * d, uint32_t v, int n)
+{
+	uint32x4_t vv = vdupq_n_u32(v);
+
+	for(; n >= 4; n -= 4, d += 4)
+		vst1q_u32(d, vv);
+	while(n-- > 0)
+		*d++ = v;
+}
+
+static inline uint16x8_t lerp_neon(uint16x8_t a, uint16x8_t b, uint16x8_t w)
+{
+	uint16x8_t iw = vsubq_u16(vdupq_n_u16(256), w);
+	return vshrq_n_u16(vmlaq_u16(vmulq_u16(a, iw), b, w), 8);
+}
+
+static inline uint16x8_t unpack_neon(uint32_t a, uint32_t b)
+{
+	return vmovl_u8(vcreate_u8((uint64_t)a | ((uint64_t)b << 32)));
+}
+
+static inline uint16x8_t weight_neon(int a, int b)
+{
+	return vcombine_u16(vdup_n_u16(a), vdup_n_u16(b));
+}
+
+static void pixops_neon_bilinear(uint32_t * d, uint32_t * s, int ss, int sw, int sh, int32_t u, int32_t v, int32_t du, int32_t dv, int n)
+{
+	uint16x8_t t, b, wx, wy;
+	uint32_t p[4], q[4];
+	int x0, y0, x1, y1;
+
+	for(; n >= 2; n -= 2, d += 2)
+	{
+		bilinear_fetch(s, ss, sw, sh, u, v, p, &x0, &y0);
+		u += du;
+		v += dv;
+		bilinear_fetch(s, ss, sw, sh, u, v, q, &x1, &y1);
+		u += du;
+		v += dv;
+		wx = weight_neon(x0, x1);
+		wy = weight_neon(y0, y1);
+		t = lerp_neon(unpack_neon(p[0], q[0]), unpack_neon(p[1], q[1]), wx);
+		b = lerp_neon(unpack_neon(p[2], q[2]), unpack_neon(p[3], q[3]), wx);
+		vst1_u32(d, vreinterpret_u32_u8(vmovn_u16(lerp_neon(t, b, wy))));
+	}
+	if(n > 0)
+		pixops_c_bilinear(d, s, ss, sw, sh, u, v, du, dv, n);
+}
+
+static void pixops_neon_halve(uint32_t * d, uint32_t * s0, uint32_t * s1, int n)
+{
+	uint32x4x2_t a, b;
+	uint8x16_t ae, ao, be, bo;
+	uint16x8_t lo, hi;
+
+	for(; n >= 4; n -= 4, d += 4, s0 += 8, s1 += 8)
+	{
+		a = vld2q_u32(s0);
+		b = vld2q_u32(s1);
+		ae = vreinterpretq_u8_u32(a.val[0]);
+		ao = vreinterpretq_u8_u32(a.val[1]);
+		be = vreinterpretq_u8_u32(b.val[0]);
+		bo = vreinterpretq_u8_u32(b.val[1]);
+		lo = vaddq_u16(vaddl_u8(vget_low_u8(ae), vget_low_u8(ao)), vaddl_u8(vget_low_u8(be), vget_low_u8(bo)));
+		hi = vaddq_u16(vaddl_u8(vget_high_u8(ae), vget_high_u8(ao)), vaddl_u8(vget_high_u8(be), vget_high_u8(bo)));
+		vst1q_u32(d, vreinterpretq_u32_u8(vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2))));
+	}
+	if(n > 0)
+		pixops_c_halve(d, s0, s1, n);
+}
+
+static void pixops_neon_cover(uint8_t * d, float * a, int n)
+{
+	float32x4_t z = vdupq_n_f32(0);
+	float32x4_t acc = z;
+	float32x4_t x;
+	uint16x4_t i;
+
+	for(; n >= 4; n -= 4, d += 4, a += 4)
+	{
+		x = vld1q_f32(a);
+		vst1q_f32(a, z);
+		x = vaddq_f32(x, vextq_f32(z, x, 3));
+		x = vaddq_f32(x, vextq_f32(z, x, 2));
+		x = vaddq_f32(x, acc);
+		acc = vdupq_n_f32(vgetq_lane_f32(x, 3));
+		x = vmlaq_n_f32(vdupq_n_f32(0.5f), vminq_f32(vabsq_f32(x), vdupq_n_f32(1.0f)), 255.0f);
+		i = vmovn_u32(vcvtq_u32_f32(x));
+		vst1_lane_u32((uint32_t *)d, vreinterpret_u32_u8(vmovn_u16(vcombine_u16(i, i))), 0);
+	}
+	if(n > 0)
+		cover_span(d, a, n, vgetq_lane_f32(acc, 0));
+}
+
+static void pixops_neon_mask(uint32_t * d, uint8_t * m, uint32_t v, int n)
+{
+	uint8x16_t vv = vreinterpretq_u8_u32(vdupq_n_u32(v));
+	uint8x16_t vm;
+	uint16x8_t lo, hi;
+	uint32_t mm, s[4];
+
+	for(; n >= 4; n -= 4, d += 4, m += 4)
+	{
+		memcpy(&mm, m, 4);
+		if(mm == 0)
+			continue;
+		if((mm == 0xffffffff) && ((v >> 24) == 0xff))
+		{
+			vst1q_u32(d, vreinterpretq_u32_u8(vv));
+			continue;
+		}
+		vm = vreinterpretq_u8_u32(vmulq_n_u32(vmovl_u16(vget_low_u16(vmovl_u8(vcreate_u8(mm)))), 0x01010101));
+		lo = vmull_u8(vget_low_u8(vv), vget_low_u8(vm));
+		hi = vmull_u8(vget_high_u8(vv), vget_high_u8(vm));
+		lo = vrsraq_n_u16(lo, lo, 8);
+		hi = vrsraq_n_u16(hi, hi, 8);
+		vst1q_u32(s, vreinterpretq_u32_u8(vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8))));
+		pixops_neon_blend(d, s, 4);
+	}
+	if(n > 0)
+		pixops_c_mask(d, m, v, n);
+}
+#endif
+
+static struct render_pixops_t pixops_table[] = {
+#if defined(RENDER_HAVE_AVX2)
+	{ "avx2", pixops_avx2_probe, pixops_avx2_blend, pixops_avx2_fill, pixops_sse2_bilinear, pixops_sse2_halve, pixops_sse2_cover, pixops_sse2_mask },
+#endif
+#if defined(__SSE2__)
+	{ "sse2", pixops_sse2_probe, pixops_sse2_blend, pixops_sse2_fill, pixops_sse2_bilinear, pixops_sse2_halve, pixops_sse2_cover, pixops_sse2_mask },
+#endif
+#if defined(RENDER_HAVE_NEON)
+	{ "neon", pixops_neon_probe, pixops_neon_blend, pixops_neon_fill, pixops_neon_bilinear, pixops_neon_halve, pixops_neon_cover, pixops_neon_mask },
+#endif
+	{ "c", pixops_c_probe, pixops_c_blend, pixops_c_fill, pixops_c_bilinear, pixops_c_halve, pixops_c_cover, pixops_c_mask },
+};
+static struct render_pixops_t * __pixops = &pixops_table[ARRAY_SIZE(pixops_table) - 1];
+
+const char * render_default_pixops_name(int index)
+{
+	int i;
+
+	for(i = 0; i < ARRAY_SIZE(pixops_table); i++)
+	{
+		if(pixops_table[i].probe() && (index-- == 0))
+			return pixops_table[i].name;
+	}
+	return NULL;
+}
+
+const char * render_default_pixops_get(void)
+{
+	return __pixops->name;
+}
+
+bool_t render_default_pixops_set(const char * name)
+{
+	int i;
+
+	for(i = 0; i < ARRAY_SIZE(pixops_table); i++)
+	{
+		if((!name || (strcmp(pixops_table[i].name, name) == 0)) && pixops_table[i].probe())
+		{
+			__pixops = &pixops_table[i];
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+static __init void render_default_pixops_init(void)
+{
+	render_default_pixops_set(NULL);
+}
+core_initcall(render_default_pixops_init);
+
+/*
+ * Narrow the row [*x1, *x2) to the pixels whose source coordinate u + i * du,
+ * in 16.16 fixed point, falls inside [0, limit).
+ */
+static inline void span_range(int64_t u, int64_t du, int limit, int * x1, int * x2)
+{
+	int64_t l = (int64_t)limit << 16;
+	double r1, r2;
+	int a = *x1, b = *x2;
+
+	if(du == 0)
+	{
+		if(u < 0 || u >= l)
+			*x2 = a;
+		return;
+	}
+	r1 = (double)(0 - u) / (double)du;
+	r2 = (double)(l - u) / (double)du;
+	if(r1 > r2)
+	{
+		double t = r1;
+		r1 = r2;
+		r2 = t;
+	}
+	if(r1 - 1 > a)
+		a = (r1 - 1 < b) ? (int)(r1 - 1) : b;
+	if(r2 + 1 < b)
+		b = (r2 + 1 > a) ? (int)(r2 + 1) : a;
+	while((a < b) && ((u + a * du < 0) || (u + a * du >= l)))
+		a++;
+	while((a < b) && ((u + (b - 1) * du < 0) || (u + (b - 1) * du >= l)))
+		b--;
+	*x1 = a;
+	*x2 = b;
+}
+
+static inline int32_t to_fixed(double v)
+{
+	return (int32_t)(v * 65536.0 + ((v < 0) ? -0.5 : 0.5));
+}
+
+struct blit_t {
+	uint32_t * dp;
+	int ds;
+	int w, h;
+	uint32_t * sp;
+	int ss;
+	int sw, sh;
+	double fx, fy;
 	struct matrix_t t;
+};
+
+static inline int span_opaque(uint32_t * s, int n)
+{
+	uint32_t v = 0xff000000;
+
+	while(n-- > 0)
+		v &= *s++;
+	return (v >= 0xff000000) ? 1 : 0;
+}
+
+/*
+ * Pure translation, every destination row maps to a contiguous source row.
+ * Opaque sources are copied row by row, others blended straight from the source.
+ */
+static void blit_translate(struct blit_t * b)
+{
+	uint32_t * d, * s;
+	int64_t fu = (int64_t)(b->fx * 65536.0);
+	int64_t fv = (int64_t)(b->fy * 65536.0);
+	int xs = 0, xe = b->w;
+	int ys = 0, ye = b->h;
+	int y, n, opaque = 1;
+
+	span_range(fu, 1 << 16, b->sw, &xs, &xe);
+	span_range(fv, 1 << 16, b->sh, &ys, &ye);
+	if((xs >= xe) || (ys >= ye))
+		return;
+	n = xe - xs;
+	d = b->dp + ys * b->ds + xs;
+	s = b->sp + ((fv + ((int64_t)ys << 16)) >> 16) * b->ss + ((fu + ((int64_t)xs << 16)) >> 16);
+	for(y = ys; opaque && (y < ye); y++)
+		opaque = span_opaque(s + (y - ys) * b->ss, n);
+	for(y = ys; y < ye; y++, d += b->ds, s += b->ss)
+	{
+		if(opaque)
+			memcpy(d, s, n << 2);
+		else
+			__pixops->blend(d, s, n);
+	}
+}
+
+/*
+ * Axis aligned scale, the horizontal mapping is the same for all rows. A source
+ * row is expanded once into the line buffer and reused for each destination row
+ * sampling it. Integer scale factors with integer offsets replicate pixels
+ * without any stepping.
+ */
+static void blit_scale(struct blit_t * b, struct matrix_t * m, uint32_t * line)
+{
+	uint32_t * d, * s, * l;
+	int64_t fu, fv;
+	int32_t u, du;
+	int xs = 0, xe = b->w;
+	int x, y, n, row, last = -1;
+	int kx = 0, ky = 0, ox = 0, oy = 0;
+
+	if((m->a >= 1) && (m->d >= 1) && (m->a == (int)m->a) && (m->d == (int)m->d) && (m->tx == (int)m->tx) && (m->ty == (int)m->ty))
+	{
+		kx = (int)m->a;
+		ky = (int)m->d;
+		ox = (int)floor(b->fx * kx);
+		oy = (int)floor(b->fy * ky);
+		xs = max(0, -ox);
+		xe = min(b->w, b->sw * kx - ox);
+		fu = 0;
+		du = 0;
+	}
+	else
+	{
+		fu = (int64_t)(b->fx * 65536.0);
+		du = to_fixed(b->t.a);
+		span_range(fu, du, b->sw, &xs, &xe);
+	}
+	if(xs >= xe)
+		return;
+	n = xe - xs;
+	d = b->dp + xs;
+
+	for(y = 0; y < b->h; y++, d += b->ds)
+	{
+		if(ky > 0)
+		{
+			if((oy + y < 0) || (oy + y >= b->sh * ky))
+				continue;
+			row = (oy + y) / ky;
+		}
+		else
+		{
+			fv = (int64_t)((b->fy + b->t.d * y) * 65536.0);
+			if((fv < 0) || (fv >= ((int64_t)b->sh << 16)))
+				continue;
+			row = fv >> 16;
+		}
+		if(row != last)
+		{
+			s = b->sp + row * b->ss;
+			l = line;
+			if(kx > 0)
+			{
+				x = (ox + xs) % kx;
+				s += (ox + xs) / kx;
+				while(l < line + n)
+				{
+					for(; (x < kx) && (l < line + n); x++)
+						*l++ = *s;
+					s++;
+					x = 0;
+				}
+			}
+			else
+			{
+				u = (int32_t)(fu + xs * (int64_t)du);
+				for(x = 0; x < n; x++, u += du)
+					*l++ = s[u >> 16];
+			}
+			last = row;
+		}
+		__pixops->blend(d, line, n);
+	}
+}
+
+static void blit_affine(struct blit_t * b)
+{
+	uint32_t buf[256];
+	uint32_t * p = b->dp;
+	int32_t u, v, du, dv;
+	int64_t fu, fv;
+	int x, y, i, n, xs, xe;
+
+	du = to_fixed(b->t.a);
+	dv = to_fixed(b->t.b);
+	for(y = 0; y < b->h; y++, p += b->ds)
+	{
+		fu = (int64_t)((b->fx + b->t.c * y) * 65536.0);
+		fv = (int64_t)((b->fy + b->t.d * y) * 65536.0);
+		xs = 0;
+		xe = b->w;
+		span_range(fu, du, b->sw, &xs, &xe);
+		span_range(fv, dv, b->sh, &xs, &xe);
+		for(x = xs; x < xe; x += n)
+		{
+			n = min(xe - x, (int)ARRAY_SIZE(buf));
+			u = (int32_t)(fu + x * (int64_t)du);
+			v = (int32_t)(fv + x * (int64_t)dv);
+			for(i = 0; i < n; i++, u += du, v += dv)
+				buf[i] = b->sp[(v >> 16) * b->ss + (u >> 16)];
+			__pixops->blend(p + x, buf, n);
+		}
+	}
+}
+
+/*
+ * Bilinear filtered sampling for RENDER_TYPE_GOOD and RENDER_TYPE_BEST.
+ */
+static void blit_filter(struct blit_t * b)
+{
+	uint32_t buf[256];
+	uint32_t * p = b->dp;
+	int32_t du, dv;
+	int64_t fu, fv;
+	int x, y, n, xs, xe;
+
+	du = to_fixed(b->t.a);
+	dv = to_fixed(b->t.b);
+	for(y = 0; y < b->h; y++, p += b->ds)
+	{
+		fu = (int64_t)((b->fx + b->t.c * y) * 65536.0);
+		fv = (int64_t)((b->fy + b->t.d * y) * 65536.0);
+		xs = 0;
+		xe = b->w;
+		span_range(fu, du, b->sw, &xs, &xe);
+		span_range(fv, dv, b->sh, &xs, &xe);
+		for(x = xs; x < xe; x += n)
+		{
+			n = min(xe - x, (int)ARRAY_SIZE(buf));
+			__pixops->bilinear(buf, b->sp, b->ss, b->sw, b->sh, (int32_t)(fu + x * (int64_t)du) - 0x8000, (int32_t)(fv + x * (int64_t)dv) - 0x8000, du, dv, n);
+			__pixops->blend(p + x, buf, n);
+		}
+	}
+}
+
+/*
+ * Scratch memory for the reduced levels of best quality blits, kept per cpu
+ * and only ever grown, so repeated blits do not allocate. A blit never hits
+ * a preemption point, the buffer of the cpu stays ours for the whole call.
+ */
+static struct {
+	uint32_t * buf;
+	size_t len;
+} __blit_scratch[CONFIG_MAX_SMP_CPUS];
+
+static uint32_t * blit_scratch(size_t len)
+{
 	uint32_t * p;
-	uint32_t * dp = surface_get_pixels(s);
-	uint32_t * sp = surface_get_pixels(src);
-	int ds = surface_get_stride(s) >> 2;
-	int ss = surface_get_stride(src) >> 2;
-	int sw = surface_get_width(src);
-	int sh = surface_get_height(src);
-	int x1, y1, x2, y2, stride;
-	int x, y, ox, oy;
-	double fx, fy, ofx, ofy;
+	int cpu = smp_processor_id();
+
+	if(len > __blit_scratch[cpu].len)
+	{
+		p = malloc(len * sizeof(uint32_t));
+		if(!p)
+			return NULL;
+		if(__blit_scratch[cpu].buf)
+			free(__blit_scratch[cpu].buf);
+		__blit_scratch[cpu].buf = p;
+		__blit_scratch[cpu].len = len;
+	}
+	return __blit_scratch[cpu].buf;
+}
+
+/*
+ * Box filter the source down by two along each axis shrunk to half size or
+ * less, until the remaining scale is above one half. All levels are laid out
+ * one after another in the scratch buffer, the caller bilinear samples the
+ * last one.
+ */
+static void blit_reduce(struct blit_t * b, struct matrix_t * m)
+{
+	uint32_t * l, * r0, * r1;
+	double sx = sqrt(m->a * m->a + m->b * m->b);
+	double sy = sqrt(m->c * m->c + m->d * m->d);
+	double tx = sx, ty = sy;
+	size_t len = 0;
+	int kx, ky, w, h, x, y;
+
+	w = b->sw;
+	h = b->sh;
+	while(1)
+	{
+		kx = ((tx <= 0.5) && (w > 1)) ? 2 : 1;
+		ky = ((ty <= 0.5) && (h > 1)) ? 2 : 1;
+		if((kx == 1) && (ky == 1))
+			break;
+		w = (w + kx - 1) / kx;
+		h = (h + ky - 1) / ky;
+		len += (size_t)w * h;
+		tx *= kx;
+		ty *= ky;
+	}
+	if(len == 0)
+		return;
+	l = blit_scratch(len);
+	if(!l)
+		return;
+
+	while(1)
+	{
+		kx = ((sx <= 0.5) && (b->sw > 1)) ? 2 : 1;
+		ky = ((sy <= 0.5) && (b->sh > 1)) ? 2 : 1;
+		if((kx == 1) && (ky == 1))
+			break;
+		w = (b->sw + kx - 1) / kx;
+		h = (b->sh + ky - 1) / ky;
+		for(y = 0; y < h; y++)
+		{
+			r0 = b->sp + y * ky * b->ss;
+			r1 = (y * ky + 1 < b->sh) ? r0 + (ky - 1) * b->ss : r0;
+			if(kx == 2)
+			{
+				__pixops->halve(l + y * w, r0, r1, b->sw >> 1);
+				if(b->sw & 1)
+					l[y * w + w - 1] = average(r0[b->sw - 1], r1[b->sw - 1]);
+			}
+			else
+			{
+				for(x = 0; x < w; x++)
+					l[y * w + x] = average(r0[x], r1[x]);
+			}
+		}
+		b->sp = l;
+		b->ss = b->sw = w;
+		b->sh = h;
+		b->fx /= kx;
+		b->t.a /= kx;
+		b->t.c /= kx;
+		b->fy /= ky;
+		b->t.b /= ky;
+		b->t.d /= ky;
+		sx *= kx;
+		sy *= ky;
+		l += w * h;
+	}
+}
+
+void render_default_blit(struct surface_t * s, struct region_t * clip, struct matrix_t * m, struct surface_t * src, enum render_type_t type)
+{
+	struct region_t r, region;
+	struct blit_t b;
+	uint32_t buf[256];
+	uint32_t * line;
 
 	region_init(&r, 0, 0, surface_get_width(s), surface_get_height(s));
 	if(clip)
@@ -91,38 +994,51 @@ void render_default_blit(struct surface_t * s, struct region_t * clip, struct ma
 		if(!region_intersect(&r, &r, clip))
 			return;
 	}
-	matrix_transform_region(m, sw, sh, &region);
+	matrix_transform_region(m, surface_get_width(src), surface_get_height(src), &region);
 	if(!region_intersect(&r, &r, &region))
 		return;
 
-	x1 = r.x;
-	y1 = r.y;
-	x2 = r.x + r.w;
-	y2 = r.y + r.h;
-	stride = ds - r.w;
-	p = dp + y1 * ds + x1;
-	fx = x1;
-	fy = y1;
-	memcpy(&t, m, sizeof(struct matrix_t));
-	matrix_invert(&t);
-	matrix_transform_point(&t, &fx, &fy);
-
-	for(y = y1; y < y2; ++y, fx += t.c, fy += t.d)
+	b.ds = surface_get_stride(s) >> 2;
+	b.dp = (uint32_t *)surface_get_pixels(s) + r.y * b.ds + r.x;
+	b.w = r.w;
+	b.h = r.h;
+	b.sp = surface_get_pixels(src);
+	b.ss = surface_get_stride(src) >> 2;
+	b.sw = surface_get_width(src);
+	b.sh = surface_get_height(src);
+	b.fx = r.x + 0.5;
+	b.fy = r.y + 0.5;
+	memcpy(&b.t, m, sizeof(struct matrix_t));
+	matrix_invert(&b.t);
+	matrix_transform_point(&b.t, &b.fx, &b.fy);
+
+	if((m->b == 0) && (m->c == 0) && (m->a == 1) && (m->d == 1))
+	{
+		if((type == RENDER_TYPE_FAST) || ((m->tx == floor(m->tx)) && (m->ty == floor(m->ty))))
+		{
+			blit_translate(&b);
+			return;
+		}
+	}
+	if(type != RENDER_TYPE_FAST)
+	{
+		if(type == RENDER_TYPE_BEST)
+			blit_reduce(&b, m);
+		blit_filter(&b);
+		return;
+	}
+	if((m->b == 0) && (m->c == 0))
 	{
-		ofx = fx;
-		ofy = fy;
-		for(x = x1; x < x2; ++x, ofx += t.a, ofy += t.b)
+		line = (b.w <= (int)ARRAY_SIZE(buf)) ? buf : malloc(b.w << 2);
+		if(line)
 		{
-			ox = (int)ofx;
-			oy = (int)ofy;
-			if(ox >= 0 && ox < sw && oy >= 0 && oy < sh)
-			{
-				blend(p, sp + oy * ss + ox);
-			}
-			p++;
+			blit_scale(&b, m, line);
+			if(line != buf)
+				free(line);
+			return;
 		}
-		p += stride;
 	}
+	blit_affine(&b);
 }
 
 void render_default_fill(struct surface_t * s, struct region_t * clip, struct matrix_t * m, int w, int h, struct color_t * c, enum render_type_t type)
@@ -131,9 +1047,10 @@ void render_default_fill(struct surface_t * s, struct region_t * clip, struct ma
 	struct matrix_t t;
 	uint32_t * p, v;
 	int ds = surface_get_stride(s) >> 2;
-	int x1, y1, x2, y2, stride;
-	int x, y, ox, oy;
-	double fx, fy, ofx, ofy;
+	int y, xs, xe;
+	int32_t du, dv;
+	int64_t fu, fv;
+	double fx, fy;
 
 	region_init(&r, 0, 0, surface_get_width(s), surface_get_height(s));
 	if(clip)
@@ -145,40 +1062,30 @@ void render_default_fill(struct surface_t * s, struct region_t * clip, struct ma
 	if(!region_intersect(&r, &r, &region))
 		return;
 
-	x1 = r.x;
-	y1 = r.y;
-	x2 = r.x + r.w;
-	y2 = r.y + r.h;
-	stride = ds - r.w;
-	p = (uint32_t *)surface_get_pixels(s) + y1 * ds + x1;
+	p = (uint32_t *)surface_get_pixels(s) + r.y * ds + r.x;
 	v = color_get_premult(c);
-	fx = x1;
-	fy = y1;
+	fx = r.x + 0.5;
+	fy = r.y + 0.5;
 	memcpy(&t, m, sizeof(struct matrix_t));
 	matrix_invert(&t);
 	matrix_transform_point(&t, &fx, &fy);
+	du = to_fixed(t.a);
+	dv = to_fixed(t.b);
 
-	for(y = y1; y < y2; ++y, fx += t.c, fy += t.d)
+	for(y = 0; y < r.h; y++, p += ds)
 	{
-		ofx = fx;
-		ofy = fy;
-		for(x = x1; x < x2; ++x, ofx += t.a, ofy += t.b)
-		{
-			ox = (int)ofx;
-			oy = (int)ofy;
-			if(ox >= 0 && ox < w && oy >= 0 && oy < h)
-				*p = v;
-			p++;
-		}
-		p += stride;
+		fu = (int64_t)((fx + t.c * y) * 65536.0);
+		fv = (int64_t)((fy + t.d * y) * 65536.0);
+		xs = 0;
+		xe = r.w;
+		span_range(fu, du, w, &xs, &xe);
+		span_range(fv, dv, h, &xs, &xe);
+		if(xs < xe)
+			__pixops->fill(p + xs, v, xe - xs);
 	}
 }
 
-#define XVG_SUBSAMPLES		(5)
-#define XVG_FIXSHIFT		(14)
-#define XVG_FIX				(1 << XVG_FIXSHIFT)
-#define XVG_FIXMASK			(XVG_FIX - 1)
-#define XVG_MPAGE_SIZE		(4096)
+#define XVG_BAND_ROWS		(16)
 #define XVG_KAPPA90			(0.5522847493f)
 
 enum xvg_line_join_t {
@@ -193,11 +1100,6 @@ enum xvg_line_cap_t {
 	XVG_CAP_SQUARE			= 2,
 };
 
-enum xvg_fill_rule_t {
-	XVG_FILLRULE_NONZERO	= 0,
-	XVG_FILLRULE_EVENODD	= 1,
-};
-
 enum {
 	XVG_POINT_CORNER		= (1 << 0),
 	XVG_POINT_BEVEL			= (1 << 1),
@@ -218,19 +1120,10 @@ struct xvg_edge_t {
 	struct xvg_edge_t * next;
 };
 
-struct xvg_active_edge_t {
-	int x, dx;
-	float ey;
-	int dir;
-	struct xvg_active_edge_t * next;
-};
-
-struct xvg_mem_page_t {
-	unsigned char mem[XVG_MPAGE_SIZE];
-	int size;
-	struct xvg_mem_page_t * next;
-};
-
+/*
+ * Rasterizer state, one for each surface. The buffers only ever grow, so after
+ * the first few shapes drawing does not allocate anymore.
+ */
 struct xvg_context_t {
 	float tesstol;
 	float disttol;
@@ -240,13 +1133,14 @@ struct xvg_context_t {
 	struct xvg_point_t * points;
 	int npoints;
 	int cpoints;
-	struct xvg_active_edge_t * freelist;
-	struct xvg_mem_page_t * pages;
-	struct xvg_mem_page_t * cpage;
+	struct xvg_edge_t ** bands;
+	int cbands;
+	float * cells;
+	int ccells;
+	uint8_t * cover;
+	int ccover;
 	unsigned char * bitmap;
 	int width, height, stride;
-	unsigned char * scanline;
-	int cscanline;
 	float * pts;
 	int cpts;
 	int npts;
@@ -256,50 +1150,8 @@ struct xvg_context_t {
 	float miter;
 	enum xvg_line_join_t join;
 	enum xvg_line_cap_t cap;
-	enum xvg_fill_rule_t rule;
 };
 
-static struct xvg_mem_page_t * xvg_next_page(struct xvg_context_t * ctx, struct xvg_mem_page_t * cur)
-{
-	struct xvg_mem_page_t * page;
-
-	if(cur && cur->next)
-		return cur->next;
-	page = malloc(sizeof(struct xvg_mem_page_t));
-	if(!page)
-		return NULL;
-	memset(page, 0, sizeof(struct xvg_mem_page_t));
-	if(cur)
-		cur->next = page;
-	else
-		ctx->pages = page;
-	return page;
-}
-
-static void xvg_reset_pool(struct xvg_context_t * ctx)
-{
-	struct xvg_mem_page_t * p = ctx->pages;
-	while(p)
-	{
-		p->size = 0;
-		p = p->next;
-	}
-	ctx->cpage = ctx->pages;
-}
-
-static unsigned char * xvg_mem_alloc(struct xvg_context_t * ctx, int size)
-{
-	unsigned char * buf;
-
-	if(size > XVG_MPAGE_SIZE)
-		return NULL;
-	if(!ctx->cpage || (ctx->cpage->size + size > XVG_MPAGE_SIZE))
-		ctx->cpage = xvg_next_page(ctx, ctx->cpage);
-	buf = &ctx->cpage->mem[ctx->cpage->size];
-	ctx->cpage->size += size;
-	return buf;
-}
-
 static int xvg_pt_equals(float x1, float y1, float x2, float y2, float tol)
 {
 	float dx = x2 - x1;
@@ -322,10 +1174,11 @@ static void xvg_add_path_point(struct xvg_context_t * ctx, float x, float y, int
 	}
 	if(ctx->npoints + 1 > ctx->cpoints)
 	{
-		ctx->cpoints = ctx->cpoints > 0 ? ctx->cpoints * 2 : 64;
-		ctx->points = realloc(ctx->points, sizeof(struct xvg_point_t) * ctx->cpoints);
-		if(!ctx->points)
+		pt = realloc(ctx->points, sizeof(struct xvg_point_t) * (ctx->cpoints > 0 ? ctx->cpoints * 2 : 64));
+		if(!pt)
 			return;
+		ctx->points = pt;
+		ctx->cpoints = ctx->cpoints > 0 ? ctx->cpoints * 2 : 64;
 	}
 	pt = &ctx->points[ctx->npoints];
 	pt->x = x;
@@ -342,10 +1195,11 @@ static void xvg_add_edge(struct xvg_context_t * ctx, float x0, float y0, float x
 		return;
 	if(ctx->nedges + 1 > ctx->cedges)
 	{
-		ctx->cedges = ctx->cedges > 0 ? ctx->cedges * 2 : 64;
-		ctx->edges = (struct xvg_edge_t *)realloc(ctx->edges, sizeof(struct xvg_edge_t) * ctx->cedges);
-		if(!ctx->edges)
+		e = (struct xvg_edge_t *)realloc(ctx->edges, sizeof(struct xvg_edge_t) * (ctx->cedges > 0 ? ctx->cedges * 2 : 64));
+		if(!e)
 			return;
+		ctx->edges = e;
+		ctx->cedges = ctx->cedges > 0 ? ctx->cedges * 2 : 64;
 	}
 	e = &ctx->edges[ctx->nedges];
 	ctx->nedges++;
@@ -758,247 +1612,232 @@ static void xvg_prepare_stroke(struct xvg_context_t * ctx, float miter, enum xvg
 	}
 }
 
-static int xvg_cmp_edge(const void * p, const void * q)
-{
-	const struct xvg_edge_t * a = (const struct xvg_edge_t *)p;
-	const struct xvg_edge_t * b = (const struct xvg_edge_t *)q;
-	if(a->y0 < b->y0)
-		return -1;
-	if(a->y0 > b->y0)
-		return 1;
-	return 0;
-}
-
-static struct xvg_active_edge_t * xvg_add_active(struct xvg_context_t * ctx, struct xvg_edge_t * e, float startPoint)
-{
-	struct xvg_active_edge_t * z;
-
-	if(ctx->freelist)
-	{
-		z = ctx->freelist;
-		ctx->freelist = z->next;
-	}
-	else
-	{
-		z = (struct xvg_active_edge_t *)xvg_mem_alloc(ctx, sizeof(struct xvg_active_edge_t));
-		if(!z)
-			return NULL;
-	}
-	float dxdy = (e->x1 - e->x0) / (e->y1 - e->y0);
-	if(dxdy < 0)
-		z->dx = (int)(-floorf(XVG_FIX * -dxdy));
-	else
-		z->dx = (int)floorf(XVG_FIX * dxdy);
-	z->x = (int)floorf(XVG_FIX * (e->x0 + dxdy * (startPoint - e->y0)));
-	z->ey = e->y1;
-	z->next = 0;
-	z->dir = e->dir;
-
-	return z;
-}
-
-static void xvg_free_active(struct xvg_context_t * ctx, struct xvg_active_edge_t * z)
+/*
+ * Split the parts of an edge left or right of the clip and project them onto
+ * the clip border. That keeps the winding of every pixel inside, and the cells
+ * never have to be touched outside of the clip columns.
+ */
+static void xvg_clip_edges(struct xvg_context_t * ctx)
 {
-	z->next = ctx->freelist;
-	ctx->freelist = z;
-}
+	struct xvg_edge_t e;
+	float xl = ctx->clip.x;
+	float xr = ctx->clip.x + ctx->clip.w;
+	float t[4], x0, y0, x1, y1, k;
+	int n = ctx->nedges;
+	int i, j, c;
 
-static void xvg_fill_scanline(unsigned char * scanline, int len, int x0, int x1, int maxweight, int * xmin, int * xmax)
-{
-	int i = x0 >> XVG_FIXSHIFT;
-	int j = x1 >> XVG_FIXSHIFT;
-	if(i < *xmin)
-		*xmin = i;
-	if(j > *xmax)
-		*xmax = j;
-	if(i < len && j >= 0)
+	for(i = 0; i < n; i++)
 	{
-		if(i == j)
+		memcpy(&e, &ctx->edges[i], sizeof(struct xvg_edge_t));
+		if((min(e.x0, e.x1) >= xl) && (max(e.x0, e.x1) <= xr))
+			continue;
+		ctx->edges[i].dir = 0;
+		c = 0;
+		t[c++] = 0;
+		if((e.x0 - xl) * (e.x1 - xl) < 0)
+			t[c++] = (xl - e.x0) / (e.x1 - e.x0);
+		if((e.x0 - xr) * (e.x1 - xr) < 0)
+			t[c++] = (xr - e.x0) / (e.x1 - e.x0);
+		t[c++] = 1;
+		if((c == 4) && (t[1] > t[2]))
 		{
-			scanline[i] = (unsigned char)(scanline[i] + ((x1 - x0) * maxweight >> XVG_FIXSHIFT));
+			k = t[1];
+			t[1] = t[2];
+			t[2] = k;
 		}
-		else
+		for(j = 0; j < c - 1; j++)
 		{
-			if(i >= 0)
-				scanline[i] = (unsigned char)(scanline[i] + (((XVG_FIX - (x0 & XVG_FIXMASK)) * maxweight) >> XVG_FIXSHIFT));
+			x0 = clamp(e.x0 + (e.x1 - e.x0) * t[j], xl, xr);
+			y0 = e.y0 + (e.y1 - e.y0) * t[j];
+			x1 = clamp(e.x0 + (e.x1 - e.x0) * t[j + 1], xl, xr);
+			y1 = e.y0 + (e.y1 - e.y0) * t[j + 1];
+			if(e.dir > 0)
+				xvg_add_edge(ctx, x0, y0, x1, y1);
 			else
-				i = -1;
-			if(j < len)
-				scanline[j] = (unsigned char)(scanline[j] + (((x1 & XVG_FIXMASK) * maxweight) >> XVG_FIXSHIFT));
-			else
-				j = len;
-			for(++i; i < j; ++i)
-				scanline[i] = (unsigned char)(scanline[i] + maxweight);
+				xvg_add_edge(ctx, x1, y1, x0, y0);
 		}
 	}
 }
 
-static void xvg_fill_active_edges(unsigned char * scanline, int len, struct xvg_active_edge_t * e, int maxweight, int * xmin, int * xmax, enum xvg_fill_rule_t rule)
+/*
+ * Accumulate the signed area of an edge, for the rows [oy, oy + rows), into
+ * the cells. Each row holds the coverage deltas, a prefix sum over a row gives
+ * the nonzero winding coverage of every pixel. The edge is followed exactly
+ * but both of its ends are clamped into the row, so no cell index goes out of
+ * bounds and the parts outside of the band land in the border cells.
+ */
+static void xvg_cell_edge(float * cells, int pitch, float ox, float oy, int rows, struct xvg_edge_t * e, int * xmin, int * xmax)
 {
-	int x0 = 0, w = 0;
+	float * line;
+	float ys = max(e->y0, oy) - oy;
+	float ye = min(e->y1, oy + rows) - oy;
+	float dxdy, xs, x, xn, x0, x1, dy, d;
+	float x0f, x1f, s, a0, a1, a2, am;
+	int y, x0i, x1i, i;
 
-	if(rule == XVG_FILLRULE_NONZERO)
-	{
-		while(e)
+	if(ys >= ye)
+		return;
+	dxdy = (e->x1 - e->x0) / (e->y1 - e->y0);
+	xs = e->x0 + (ys + oy - e->y0) * dxdy - ox;
+	x = clamp(xs, 0.0f, (float)(pitch - 2));
+	for(y = (int)ys; (y < rows) && (y < ye); y++)
+	{
+		line = &cells[y * pitch];
+		dy = min((float)(y + 1), ye) - max((float)y, ys);
+		xs += dxdy * dy;
+		xn = clamp(xs, 0.0f, (float)(pitch - 2));
+		d = dy * e->dir;
+		if(x < xn)
 		{
-			if(w == 0)
-			{
-				x0 = e->x;
-				w += e->dir;
-			}
-			else
-			{
-				int x1 = e->x;
-				w += e->dir;
-				if(w == 0)
-					xvg_fill_scanline(scanline, len, x0, x1, maxweight, xmin, xmax);
-			}
-			e = e->next;
+			x0 = x;
+			x1 = xn;
 		}
-	}
-	else if(rule == XVG_FILLRULE_EVENODD)
-	{
-		while(e)
+		else
+		{
+			x0 = xn;
+			x1 = x;
+		}
+		x0i = (int)floorf(x0);
+		x1i = (int)ceilf(x1);
+		if(x1i <= x0i + 1)
+		{
+			am = 0.5f * (x + xn) - x0i;
+			line[x0i] += d - d * am;
+			line[x0i + 1] += d * am;
+			x1i = x0i + 1;
+		}
+		else
 		{
-			if(w == 0)
+			s = 1.0f / (x1 - x0);
+			x0f = x0 - x0i;
+			a0 = 0.5f * s * (1.0f - x0f) * (1.0f - x0f);
+			x1f = x1 - x1i + 1.0f;
+			am = 0.5f * s * x1f * x1f;
+			line[x0i] += d * a0;
+			if(x1i == x0i + 2)
 			{
-				x0 = e->x;
-				w = 1;
+				line[x0i + 1] += d * (1.0f - a0 - am);
 			}
 			else
 			{
-				int x1 = e->x;
-				w = 0;
-				xvg_fill_scanline(scanline, len, x0, x1, maxweight, xmin, xmax);
+				a1 = s * (1.5f - x0f);
+				line[x0i + 1] += d * (a1 - a0);
+				for(i = x0i + 2; i < x1i - 1; i++)
+					line[i] += d * s;
+				a2 = a1 + (x1i - x0i - 3) * s;
+				line[x1i - 1] += d * (1.0f - a2 - am);
 			}
-			e = e->next;
+			line[x1i] += d * am;
 		}
+		if(x0i < *xmin)
+			*xmin = x0i;
+		if(x1i + 1 > *xmax)
+			*xmax = x1i + 1;
+		x = xn;
 	}
 }
 
-static void xvg_scanline_solid(unsigned char * dst, int count, unsigned char * cover, int x, int y, struct color_t * c)
+static int xvg_prepare(struct xvg_context_t * ctx, int nband, int pitch)
 {
-	int cb = c->b;
-	int cg = c->g;
-	int cr = c->r;
-	int ca = c->a;
-	int i;
+	void * p;
 
-	for(i = 0; i < count; i++)
+	if(nband > ctx->cbands)
 	{
-		int b, g, r;
-		int a = idiv255((int)cover[0] * ca);
-		int ia = 255 - a;
-		b = idiv255(cb * a);
-		g = idiv255(cg * a);
-		r = idiv255(cr * a);
-
-		b += idiv255(ia * (int)dst[0]);
-		g += idiv255(ia * (int)dst[1]);
-		r += idiv255(ia * (int)dst[2]);
-		a += idiv255(ia * (int)dst[3]);
-
-		dst[0] = (unsigned char)b;
-		dst[1] = (unsigned char)g;
-		dst[2] = (unsigned char)r;
-		dst[3] = (unsigned char)a;
-
-		cover++;
-		dst += 4;
+		p = realloc(ctx->bands, sizeof(struct xvg_edge_t *) * nband);
+		if(!p)
+			return 0;
+		ctx->bands = p;
+		ctx->cbands = nband;
+	}
+	if(pitch * XVG_BAND_ROWS > ctx->ccells)
+	{
+		p = calloc(pitch * XVG_BAND_ROWS, sizeof(float));
+		if(!p)
+			return 0;
+		free(ctx->cells);
+		ctx->cells = p;
+		ctx->ccells = pitch * XVG_BAND_ROWS;
+	}
+	if(pitch > ctx->ccover)
+	{
+		p = realloc(ctx->cover, pitch);
+		if(!p)
+			return 0;
+		ctx->cover = p;
+		ctx->ccover = pitch;
 	}
+	memset(ctx->bands, 0, sizeof(struct xvg_edge_t *) * nband);
+	return 1;
 }
 
-static void xvg_rasterize_sorted_edges(struct xvg_context_t * ctx, struct color_t * c, enum xvg_fill_rule_t rule)
+/*
+ * Edges are bucketed by the band of rows they start in, every band then adds
+ * its active edges into the cells and resolves them a row at a time.
+ */
+static void xvg_rasterize(struct xvg_context_t * ctx)
 {
-	struct xvg_active_edge_t * active = NULL;
-	int e = 0;
-	int maxweight = (255 / XVG_SUBSAMPLES);
+	struct xvg_edge_t * active = NULL;
+	struct xvg_edge_t * e, * n, ** pp;
 	int x0 = ctx->clip.x;
 	int y0 = ctx->clip.y;
-	int x1 = x0 + ctx->clip.w - 1;
-	int y1 = y0 + ctx->clip.h - 1;
-	int xmin, xmax;
-	int y, s;
-
-	for(y = y0; y <= y1; y++)
+	int w = ctx->clip.w;
+	int h = ctx->clip.h;
+	int pitch = w + 2;
+	int nband = (h + XVG_BAND_ROWS - 1) / XVG_BAND_ROWS;
+	int b, i, by, rows, xmin, xmax;
+	uint32_t * d;
+	uint32_t v;
+
+	if((w <= 0) || (h <= 0) || (ctx->nedges <= 0))
+		return;
+	v = color_get_premult(&ctx->color);
+	if((v >> 24) == 0)
+		return;
+	xvg_clip_edges(ctx);
+	if(!xvg_prepare(ctx, nband, pitch))
+		return;
+	for(i = 0; i < ctx->nedges; i++)
+	{
+		e = &ctx->edges[i];
+		if((e->dir == 0) || (e->y1 <= y0) || (e->y0 >= y0 + h))
+			continue;
+		b = e->y0 > y0 ? ((int)e->y0 - y0) / XVG_BAND_ROWS : 0;
+		e->next = ctx->bands[b];
+		ctx->bands[b] = e;
+	}
+	for(b = 0; b < nband; b++)
 	{
-		memset(ctx->scanline, 0, ctx->width);
-		xmin = ctx->width;
+		by = y0 + b * XVG_BAND_ROWS;
+		rows = min(XVG_BAND_ROWS, y0 + h - by);
+		for(e = ctx->bands[b]; e; e = n)
+		{
+			n = e->next;
+			e->next = active;
+			active = e;
+		}
+		xmin = pitch;
 		xmax = 0;
-		for(s = 0; s < XVG_SUBSAMPLES; ++s)
+		for(pp = &active; (e = *pp);)
 		{
-			float scany = (float)(y * XVG_SUBSAMPLES + s) + 0.5f;
-			struct xvg_active_edge_t ** step = &active;
-			while(*step)
-			{
-				struct xvg_active_edge_t * z = *step;
-				if(z->ey <= scany)
-				{
-					*step = z->next;
-					xvg_free_active(ctx, z);
-				}
-				else
-				{
-					z->x += z->dx;
-					step = &((*step)->next);
-				}
-			}
-			for(;;)
+			xvg_cell_edge(ctx->cells, pitch, x0, by, rows, e, &xmin, &xmax);
+			if(e->y1 <= by + rows)
+				*pp = e->next;
+			else
+				pp = &e->next;
+		}
+		if(xmin < xmax)
+		{
+			xmax = min(xmax, pitch);
+			for(i = 0; i < rows; i++)
 			{
-				int changed = 0;
-				step = &active;
-				while(*step && (*step)->next)
+				__pixops->cover(ctx->cover, &ctx->cells[i * pitch + xmin], xmax - xmin);
+				if(xmin < w)
 				{
-					if((*step)->x > (*step)->next->x)
-					{
-						struct xvg_active_edge_t * t = *step;
-						struct xvg_active_edge_t * q = t->next;
-						t->next = q->next;
-						q->next = t;
-						*step = q;
-						changed = 1;
-					}
-					step = &(*step)->next;
+					d = (uint32_t *)(ctx->bitmap + (by + i) * ctx->stride) + x0 + xmin;
+					__pixops->mask(d, ctx->cover, v, min(xmax, w) - xmin);
 				}
-				if(!changed)
-					break;
 			}
-			while(e < ctx->nedges && ctx->edges[e].y0 <= scany)
-			{
-				if(ctx->edges[e].y1 > scany)
-				{
-					struct xvg_active_edge_t * z = xvg_add_active(ctx, &ctx->edges[e], scany);
-					if(!z)
-						break;
-					if(!active)
-					{
-						active = z;
-					}
-					else if(z->x < active->x)
-					{
-						z->next = active;
-						active = z;
-					}
-					else
-					{
-						struct xvg_active_edge_t* p = active;
-						while(p->next && p->next->x < z->x)
-							p = p->next;
-						z->next = p->next;
-						p->next = z;
-					}
-				}
-				e++;
-			}
-			if(active)
-				xvg_fill_active_edges(ctx->scanline, ctx->width, active, maxweight, &xmin, &xmax, rule);
 		}
-		if(xmin < x0)
-			xmin = x0;
-		if(xmax > x1)
-			xmax = x1;
-		if(xmin <= xmax)
-			xvg_scanline_solid(&ctx->bitmap[y * ctx->stride] + xmin * 4, xmax - xmin + 1, &ctx->scanline[xmin], xmin, y, c);
 	}
 }
 
@@ -1009,12 +1848,15 @@ static void xvg_reset(struct xvg_context_t * ctx)
 
 static void xvg_add_point(struct xvg_context_t * ctx, float x, float y)
 {
+	float * p;
+
 	if(ctx->npts + 1 > ctx->cpts)
 	{
-		ctx->cpts = ctx->cpts ? ctx->cpts * 2 : 8;
-		ctx->pts = realloc(ctx->pts, ctx->cpts * 2 * sizeof(float));
-		if(!ctx->pts)
+		p = realloc(ctx->pts, (ctx->cpts ? ctx->cpts * 2 : 8) * 2 * sizeof(float));
+		if(!p)
 			return;
+		ctx->pts = p;
+		ctx->cpts = ctx->cpts ? ctx->cpts * 2 : 8;
 	}
 	ctx->pts[ctx->npts * 2 + 0] = x;
 	ctx->pts[ctx->npts * 2 + 1] = y;
@@ -1058,12 +1900,9 @@ static void xvg_cubic_bezto(struct xvg_context_t * ctx, float cpx1, float cpy1,
 
 static void xvg_fill(struct xvg_context_t * ctx)
 {
-	struct xvg_edge_t * e;
 	float * p;
 	int i, j;
 
-	xvg_reset_pool(ctx);
-	ctx->freelist = NULL;
 	ctx->nedges = 0;
 	ctx->npoints = 0;
 	xvg_add_path_point(ctx, ctx->pts[0], ctx->pts[1], 0);
@@ -1075,25 +1914,15 @@ static void xvg_fill(struct xvg_context_t * ctx)
 	xvg_add_path_point(ctx, ctx->pts[0], ctx->pts[1], 0);
 	for(i = 0, j = ctx->npoints - 1; i < ctx->npoints; j = i++)
 		xvg_add_edge(ctx, ctx->points[j].x, ctx->points[j].y, ctx->points[i].x, ctx->points[i].y);
-	for(i = 0; i < ctx->nedges; i++)
-	{
-		e = &ctx->edges[i];
-		e->y0 = e->y0 * XVG_SUBSAMPLES;
-		e->y1 = e->y1 * XVG_SUBSAMPLES;
-	}
-	qsort(ctx->edges, ctx->nedges, sizeof(struct xvg_edge_t), xvg_cmp_edge);
-	xvg_rasterize_sorted_edges(ctx, &ctx->color, ctx->rule);
+	xvg_rasterize(ctx);
 }
 
 static void xvg_stroke(struct xvg_context_t * ctx)
 {
-	struct xvg_edge_t * e;
 	struct xvg_point_t * p0, * p1;
 	float * p;
 	int i, closed;
 
-	xvg_reset_pool(ctx);
-	ctx->freelist = NULL;
 	ctx->nedges = 0;
 	ctx->npoints = 0;
 	xvg_add_path_point(ctx, ctx->pts[0], ctx->pts[1], XVG_POINT_CORNER);
@@ -1115,38 +1944,57 @@ static void xvg_stroke(struct xvg_context_t * ctx)
 	}
 	xvg_prepare_stroke(ctx, ctx->miter, ctx->join);
 	xvg_expand_stroke(ctx, ctx->points, ctx->npoints, closed, ctx->join, ctx->cap, ctx->thickness);
-	for(i = 0; i < ctx->nedges; i++)
-	{
-		e = &ctx->edges[i];
-		e->y0 = e->y0 * XVG_SUBSAMPLES;
-		e->y1 = e->y1 * XVG_SUBSAMPLES;
-	}
-	qsort(ctx->edges, ctx->nedges, sizeof(struct xvg_edge_t), xvg_cmp_edge);
-	xvg_rasterize_sorted_edges(ctx, &ctx->color, ctx->rule);
+	xvg_rasterize(ctx);
 }
 
-static void xvg_init(struct xvg_context_t * ctx, struct surface_t * s, struct region_t * clip, int thickness, struct color_t * c)
+void * render_default_create(struct surface_t * s)
 {
+	struct xvg_context_t * ctx;
+
+	ctx = malloc(sizeof(struct xvg_context_t));
+	if(!ctx)
+		return NULL;
+	memset(ctx, 0, sizeof(struct xvg_context_t));
 	ctx->tesstol = 0.25;
 	ctx->disttol = 0.01;
-	ctx->edges = NULL;
+	return ctx;
+}
+
+void render_default_destroy(void * pctx)
+{
+	struct xvg_context_t * ctx = (struct xvg_context_t *)pctx;
+
+	if(ctx)
+	{
+		if(ctx->edges)
+			free(ctx->edges);
+		if(ctx->points)
+			free(ctx->points);
+		if(ctx->bands)
+			free(ctx->bands);
+		if(ctx->cells)
+			free(ctx->cells);
+		if(ctx->cover)
+			free(ctx->cover);
+		if(ctx->pts)
+			free(ctx->pts);
+		free(ctx);
+	}
+}
+
+static struct xvg_context_t * xvg_init(struct surface_t * s, struct region_t * clip, int thickness, struct color_t * c)
+{
+	struct xvg_context_t * ctx = (struct xvg_context_t *)s->pctx;
+
+	if(!ctx)
+		return NULL;
 	ctx->nedges = 0;
-	ctx->cedges = 0;
-	ctx->points = NULL;
 	ctx->npoints = 0;
-	ctx->cpoints = 0;
-	ctx->freelist = NULL;
-	ctx->pages = NULL;
-	ctx->cpage = NULL;
+	ctx->npts = 0;
 	ctx->bitmap = s->pixels;
 	ctx->width = s->width;
 	ctx->height = s->height;
 	ctx->stride = s->stride;
-	ctx->cscanline = ctx->width;
-	ctx->scanline = malloc(ctx->cscanline);
-	ctx->pts = NULL;
-	ctx->cpts = 0;
-	ctx->npts = 0;
 	if(clip)
 		memcpy(&ctx->clip, clip, sizeof(struct region_t));
 	else
@@ -1159,34 +2007,12 @@ static void xvg_init(struct xvg_context_t * ctx, struct surface_t * s, struct re
 	ctx->miter = 4;
 	ctx->join = XVG_JOIN_MITER;
 	ctx->cap = XVG_CAP_BUTT;
-	ctx->rule = XVG_FILLRULE_NONZERO;
-}
-
-static void xvg_exit(struct xvg_context_t * ctx)
-{
-	struct xvg_mem_page_t * p, * n;
-
-	if(ctx)
-	{
-		p = ctx->pages;
-		while(p)
-		{
-			n = p->next;
-			free(p);
-			p = n;
-		}
-		if(ctx->edges)
-			free(ctx->edges);
-		if(ctx->points)
-			free(ctx->points);
-		if(ctx->scanline)
-			free(ctx->scanline);
-	}
+	return ctx;
 }
 
 void render_default_shape_line(struct surface_t * s, struct region_t * clip, struct point_t * p0, struct point_t * p1, int thickness, struct color_t * c)
 {
-	struct xvg_context_t ctx;
+	struct xvg_context_t * ctx;
 	struct region_t r;
 
 	region_init(&r, 0, 0, surface_get_width(s), surface_get_height(s));
@@ -1195,16 +2021,17 @@ void render_default_shape_line(struct surface_t * s, struct region_t * clip, str
 		if(!region_intersect(&r, &r, clip))
 			return;
 	}
-	xvg_init(&ctx, s, &r, thickness, c);
-	xvg_move_to(&ctx, p0->x, p0->y);
-	xvg_line_to(&ctx, p1->x, p1->y);
-	xvg_stroke(&ctx);
-	xvg_exit(&ctx);
+	ctx = xvg_init(s, &r, thickness, c);
+	if(!ctx)
+		return;
+	xvg_move_to(ctx, p0->x, p0->y);
+	xvg_line_to(ctx, p1->x, p1->y);
+	xvg_stroke(ctx);
 }
 
 void render_default_shape_polyline(struct surface_t * s, struct region_t * clip, struct point_t * p, int n, int thickness, struct color_t * c)
 {
-	struct xvg_context_t ctx;
+	struct xvg_context_t * ctx;
 	struct region_t r;
 	int i;
 
@@ -1216,19 +2043,20 @@ void render_default_shape_polyline(struct surface_t * s, struct region_t * clip,
 			if(!region_intersect(&r, &r, clip))
 				return;
 		}
-		xvg_init(&ctx, s, &r, thickness, c);
-		xvg_reset(&ctx);
-		xvg_move_to(&ctx, p[0].x, p[0].y);
+		ctx = xvg_init(s, &r, thickness, c);
+		if(!ctx)
+			return;
+		xvg_reset(ctx);
+		xvg_move_to(ctx, p[0].x, p[0].y);
 		for(i = 1; i < n; i++)
-			xvg_line_to(&ctx, p[i].x, p[i].y);
-		xvg_stroke(&ctx);
-		xvg_exit(&ctx);
+			xvg_line_to(ctx, p[i].x, p[i].y);
+		xvg_stroke(ctx);
 	}
 }
 
 void render_default_shape_curve(struct surface_t * s, struct region_t * clip, struct point_t * p, int n, int thickness, struct color_t * c)
 {
-	struct xvg_context_t ctx;
+	struct xvg_context_t * ctx;
 	struct region_t r;
 	int i;
 
@@ -1240,19 +2068,20 @@ void render_default_shape_curve(struct surface_t * s, struct region_t * clip, st
 			if(!region_intersect(&r, &r, clip))
 				return;
 		}
-		xvg_init(&ctx, s, &r, thickness, c);
-		xvg_reset(&ctx);
-		xvg_move_to(&ctx, p[0].x, p[0].y);
+		ctx = xvg_init(s, &r, thickness, c);
+		if(!ctx)
+			return;
+		xvg_reset(ctx);
+		xvg_move_to(ctx, p[0].x, p[0].y);
 		for(i = 1; i <= n - 3; i += 3)
-			xvg_cubic_bezto(&ctx, p[i].x, p[i].y, p[i + 1].x, p[i + 1].y, p[i + 2].x, p[i + 2].y);
-		xvg_stroke(&ctx);
-		xvg_exit(&ctx);
+			xvg_cubic_bezto(ctx, p[i].x, p[i].y, p[i + 1].x, p[i + 1].y, p[i + 2].x, p[i + 2].y);
+		xvg_stroke(ctx);
 	}
 }
 
 void render_default_shape_triangle(struct surface_t * s, struct region_t * clip, struct point_t * p0, struct point_t * p1, struct point_t * p2, int thickness, struct color_t * c)
 {
-	struct xvg_context_t ctx;
+	struct xvg_context_t * ctx;
 	struct region_t r;
 
 	region_init(&r, 0, 0, surface_get_width(s), surface_get_height(s));
@@ -1261,22 +2090,23 @@ void render_default_shape_triangle(struct surface_t * s, struct region_t * clip,
 		if(!region_intersect(&r, &r, clip))
 			return;
 	}
-	xvg_init(&ctx, s, &r, thickness, c);
-	xvg_reset(&ctx);
-	xvg_move_to(&ctx, p0->x, p0->y);
-	xvg_line_to(&ctx, p1->x, p1->y);
-	xvg_line_to(&ctx, p2->x, p2->y);
-	xvg_line_to(&ctx, p0->x, p0->y);
+	ctx = xvg_init(s, &r, thickness, c);
+	if(!ctx)
+		return;
+	xvg_reset(ctx);
+	xvg_move_to(ctx, p0->x, p0->y);
+	xvg_line_to(ctx, p1->x, p1->y);
+	xvg_line_to(ctx, p2->x, p2->y);
+	xvg_line_to(ctx, p0->x, p0->y);
 	if(thickness > 0)
-		xvg_stroke(&ctx);
+		xvg_stroke(ctx);
 	else
-		xvg_fill(&ctx);
-	xvg_exit(&ctx);
+		xvg_fill(ctx);
 }
 
 void render_default_shape_rectangle(struct surface_t * s, struct region_t * clip, int x, int y, int w, int h, int radius, int thickness, struct color_t * c)
 {
-	struct xvg_context_t ctx;
+	struct xvg_context_t * ctx;
 	struct region_t r;
 
 	region_init(&r, 0, 0, surface_get_width(s), surface_get_height(s));
@@ -1285,38 +2115,39 @@ void render_default_shape_rectangle(struct surface_t * s, struct region_t * clip
 		if(!region_intersect(&r, &r, clip))
 			return;
 	}
-	xvg_init(&ctx, s, &r, thickness, c);
-	xvg_reset(&ctx);
+	ctx = xvg_init(s, &r, thickness, c);
+	if(!ctx)
+		return;
+	xvg_reset(ctx);
 	if(radius > 0)
 	{
-		xvg_move_to(&ctx, x + radius, y);
-		xvg_line_to(&ctx, x + w - radius, y);
-		xvg_cubic_bezto(&ctx, x + w - radius * (1 - XVG_KAPPA90), y, x + w, y + radius * (1 - XVG_KAPPA90), x + w, y + radius);
-		xvg_line_to(&ctx, x + w, y + h - radius);
-		xvg_cubic_bezto(&ctx, x + w, y + h - radius * (1 - XVG_KAPPA90), x + w - radius * (1 - XVG_KAPPA90), y + h, x + w - radius, y + h);
-		xvg_line_to(&ctx, x + radius, y + h);
-		xvg_cubic_bezto(&ctx, x + radius * (1 - XVG_KAPPA90), y + h, x, y + h - radius * (1 - XVG_KAPPA90), x, y + h - radius);
-		xvg_line_to(&ctx, x, y + radius);
-		xvg_cubic_bezto(&ctx, x, y + radius * (1 - XVG_KAPPA90), x + radius * (1 - XVG_KAPPA90), y, x + radius, y);
+		xvg_move_to(ctx, x + radius, y);
+		xvg_line_to(ctx, x + w - radius, y);
+		xvg_cubic_bezto(ctx, x + w - radius * (1 - XVG_KAPPA90), y, x + w, y + radius * (1 - XVG_KAPPA90), x + w, y + radius);
+		xvg_line_to(ctx, x + w, y + h - radius);
+		xvg_cubic_bezto(ctx, x + w, y + h - radius * (1 - XVG_KAPPA90), x + w - radius * (1 - XVG_KAPPA90), y + h, x + w - radius, y + h);
+		xvg_line_to(ctx, x + radius, y + h);
+		xvg_cubic_bezto(ctx, x + radius * (1 - XVG_KAPPA90), y + h, x, y + h - radius * (1 - XVG_KAPPA90), x, y + h - radius);
+		xvg_line_to(ctx, x, y + radius);
+		xvg_cubic_bezto(ctx, x, y + radius * (1 - XVG_KAPPA90), x + radius * (1 - XVG_KAPPA90), y, x + radius, y);
 	}
 	else
 	{
-		xvg_move_to(&ctx, x, y);
-		xvg_line_to(&ctx, x + w, y);
-		xvg_line_to(&ctx, x + w, y + h);
-		xvg_line_to(&ctx, x, y + h);
+		xvg_move_to(ctx, x, y);
+		xvg_line_to(ctx, x + w, y);
+		xvg_line_to(ctx, x + w, y + h);
+		xvg_line_to(ctx, x, y + h);
 	}
-	xvg_line_to(&ctx, ctx.pts[0], ctx.pts[1]);
+	xvg_line_to(ctx, ctx->pts[0], ctx->pts[1]);
 	if(thickness > 0)
-		xvg_stroke(&ctx);
+		xvg_stroke(ctx);
 	else
-		xvg_fill(&ctx);
-	xvg_exit(&ctx);
+		xvg_fill(ctx);
 }
 
 void render_default_shape_polygon(struct surface_t * s, struct region_t * clip, struct point_t * p, int n, int thickness, struct color_t * c)
 {
-	struct xvg_context_t ctx;
+	struct xvg_context_t * ctx;
 	struct region_t r;
 	int i;
 
@@ -1328,23 +2159,24 @@ void render_default_shape_polygon(struct surface_t * s, struct region_t * clip,
 			if(!region_intersect(&r, &r, clip))
 				return;
 		}
-		xvg_init(&ctx, s, &r, thickness, c);
-		xvg_reset(&ctx);
-		xvg_move_to(&ctx, p[0].x, p[0].y);
+		ctx = xvg_init(s, &r, thickness, c);
+		if(!ctx)
+			return;
+		xvg_reset(ctx);
+		xvg_move_to(ctx, p[0].x, p[0].y);
 		for(i = 1; i < n; i++)
-			xvg_line_to(&ctx, p[i].x, p[i].y);
-		xvg_line_to(&ctx, p[0].x, p[0].y);
+			xvg_line_to(ctx, p[i].x, p[i].y);
+		xvg_line_to(ctx, p[0].x, p[0].y);
 		if(thickness > 0)
-			xvg_stroke(&ctx);
+			xvg_stroke(ctx);
 		else
-			xvg_fill(&ctx);
-		xvg_exit(&ctx);
+			xvg_fill(ctx);
 	}
 }
 
 void render_default_shape_circle(struct surface_t * s, struct region_t * clip, int x, int y, int radius, int thickness, struct color_t * c)
 {
-	struct xvg_context_t ctx;
+	struct xvg_context_t * ctx;
 	struct region_t r;
 
 	if(radius > 0)
@@ -1355,25 +2187,26 @@ void render_default_shape_circle(struct surface_t * s, struct region_t * clip, i
 			if(!region_intersect(&r, &r, clip))
 				return;
 		}
-		xvg_init(&ctx, s, &r, thickness, c);
-		xvg_reset(&ctx);
-		xvg_move_to(&ctx, x + radius, y);
-		xvg_cubic_bezto(&ctx, x + radius, y + radius * XVG_KAPPA90, x + radius * XVG_KAPPA90, y + radius, x, y + radius);
-		xvg_cubic_bezto(&ctx, x - radius * XVG_KAPPA90, y + radius, x - radius, y + radius * XVG_KAPPA90, x - radius, y);
-		xvg_cubic_bezto(&ctx, x - radius, y - radius * XVG_KAPPA90, x - radius * XVG_KAPPA90, y - radius, x, y - radius);
-		xvg_cubic_bezto(&ctx, x + radius * XVG_KAPPA90, y - radius, x + radius, y - radius * XVG_KAPPA90, x + radius, y);
-		xvg_line_to(&ctx, ctx.pts[0], ctx.pts[1]);
+		ctx = xvg_init(s, &r, thickness, c);
+		if(!ctx)
+			return;
+		xvg_reset(ctx);
+		xvg_move_to(ctx, x + radius, y);
+		xvg_cubic_bezto(ctx, x + radius, y + radius * XVG_KAPPA90, x + radius * XVG_KAPPA90, y + radius, x, y + radius);
+		xvg_cubic_bezto(ctx, x - radius * XVG_KAPPA90, y + radius, x - radius, y + radius * XVG_KAPPA90, x - radius, y);
+		xvg_cubic_bezto(ctx, x - radius, y - radius * XVG_KAPPA90, x - radius * XVG_KAPPA90, y - radius, x, y - radius);
+		xvg_cubic_bezto(ctx, x + radius * XVG_KAPPA90, y - radius, x + radius, y - radius * XVG_KAPPA90, x + radius, y);
+		xvg_line_to(ctx, ctx->pts[0], ctx->pts[1]);
 		if(thickness > 0)
-			xvg_stroke(&ctx);
+			xvg_stroke(ctx);
 		else
-			xvg_fill(&ctx);
-		xvg_exit(&ctx);
+			xvg_fill(ctx);
 	}
 }
 
 void render_default_shape_ellipse(struct surface_t * s, struct region_t * clip, int x, int y, int w, int h, int thickness, struct color_t * c)
 {
-	struct xvg_context_t ctx;
+	struct xvg_context_t * ctx;
 	struct region_t r;
 
 	if((w > 0) && (h > 0))
@@ -1384,19 +2217,20 @@ void render_default_shape_ellipse(struct surface_t * s, struct region_t * clip,
 			if(!region_intersect(&r, &r, clip))
 				return;
 		}
-		xvg_init(&ctx, s, &r, thickness, c);
-		xvg_reset(&ctx);
-		xvg_move_to(&ctx, x + w, y);
-		xvg_cubic_bezto(&ctx, x + w, y + h * XVG_KAPPA90, x + w * XVG_KAPPA90, y + h, x, y + h);
-		xvg_cubic_bezto(&ctx, x - w * XVG_KAPPA90, y + h, x - w, y + h * XVG_KAPPA90, x - w, y);
-		xvg_cubic_bezto(&ctx, x - w, y - h * XVG_KAPPA90, x - w * XVG_KAPPA90, y - h, x, y - h);
-		xvg_cubic_bezto(&ctx, x + w * XVG_KAPPA90, y - h, x + w, y - h * XVG_KAPPA90, x + w, y);
-		xvg_line_to(&ctx, ctx.pts[0], ctx.pts[1]);
+		ctx = xvg_init(s, &r, thickness, c);
+		if(!ctx)
+			return;
+		xvg_reset(ctx);
+		xvg_move_to(ctx, x + w, y);
+		xvg_cubic_bezto(ctx, x + w, y + h * XVG_KAPPA90, x + w * XVG_KAPPA90, y + h, x, y + h);
+		xvg_cubic_bezto(ctx, x - w * XVG_KAPPA90, y + h, x - w, y + h * XVG_KAPPA90, x - w, y);
+		xvg_cubic_bezto(ctx, x - w, y - h * XVG_KAPPA90, x - w * XVG_KAPPA90, y - h, x, y - h);
+		xvg_cubic_bezto(ctx, x + w * XVG_KAPPA90, y - h, x + w, y - h * XVG_KAPPA90, x + w, y);
+		xvg_line_to(ctx, ctx->pts[0], ctx->pts[1]);
 		if(thickness > 0)
-			xvg_stroke(&ctx);
+			xvg_stroke(ctx);
 		else
-			xvg_fill(&ctx);
-		xvg_exit(&ctx);
+			xvg_fill(ctx);
 	}
 }
 
@@ -1430,7 +2264,7 @@ static inline void arcto_bezier(float x, float y, float radius, float start, flo
 
 void render_default_shape_arc(struct surface_t * s, struct region_t * clip, int x, int y, int radius, int a1, int a2, int thickness, struct color_t * c)
 {
-	struct xvg_context_t ctx;
+	struct xvg_context_t * ctx;
 	struct region_t r;
 	float angle1, angle2;
 	float start, sweep, step;
@@ -1445,8 +2279,10 @@ void render_default_shape_arc(struct surface_t * s, struct region_t * clip, int
 			if(!region_intersect(&r, &r, clip))
 				return;
 		}
-		xvg_init(&ctx, s, &r, thickness, c);
-		xvg_reset(&ctx);
+		ctx = xvg_init(s, &r, thickness, c);
+		if(!ctx)
+			return;
+		xvg_reset(ctx);
 		angle1 = a1 * (M_PI / 180.0);
 		angle2 = a2 * (M_PI / 180.0);
 		if(angle2 < angle1)
@@ -1464,14 +2300,13 @@ void render_default_shape_arc(struct surface_t * s, struct region_t * clip, int
 		{
 			arcto_bezier(x, y, radius, start, step, cp);
 			if(i == 0)
-				xvg_move_to(&ctx, cp[0], cp[1]);
-			xvg_cubic_bezto(&ctx, cp[2], cp[3], cp[4], cp[5], cp[6], cp[7]);
+				xvg_move_to(ctx, cp[0], cp[1]);
+			xvg_cubic_bezto(ctx, cp[2], cp[3], cp[4], cp[5], cp[6], cp[7]);
 		}
 		if(thickness > 0)
-			xvg_stroke(&ctx);
+			xvg_stroke(ctx);
 		else
-			xvg_fill(&ctx);
-		xvg_exit(&ctx);
+			xvg_fill(ctx);
 	}
 }
 
@@ -36,32 +36,64 @@
 #include <ft2build.h>
 #include FT_FREETYPE_H
 
+/*
+ * Resolve the faces and glyph indexes of the text once, the draw pass walks
+ * this array instead of searching the font families for every character.
+ */
 static void calc_text_extent(struct text_t * txt)
 {
+	struct font_glyph_t * g;
 	const char * p;
 	u32_t code;
 	int glyph;
 	FT_Face face;
 	int x = 0, y = 0, w = 0, h = 0;
+	int ha, va, bx, by;
 	int flag = 0;
 
+	if(txt->glyphs)
+		free(txt->glyphs);
+	txt->glyphs = malloc(strlen(txt->utf8) * sizeof(struct text_glyph_t) + 1);
+	txt->nglyph = 0;
+
 	for(p = txt->utf8; utf8_to_ucs4(&code, 1, p, -1, &p) > 0;)
 	{
-		glyph = search_glyph(txt->fctx, txt->family, code, (void **)(&face));
+		glyph = search_family_glyph(txt->fctx, txt->fam, code, (void **)(&face));
 		if(glyph == 0)
 			glyph = search_glyph(txt->fctx, "roboto", 0xfffd, (void **)(&face));
-		FT_Set_Pixel_Sizes(face, txt->size, txt->size);
-		FT_Load_Glyph(face, glyph, FT_LOAD_BITMAP_METRICS_ONLY);
-		w += face->glyph->metrics.horiAdvance;
-		if(face->glyph->metrics.vertAdvance > h)
-			h = face->glyph->metrics.vertAdvance;
+		if(txt->glyphs)
+		{
+			txt->glyphs[txt->nglyph].face = face;
+			txt->glyphs[txt->nglyph].index = glyph;
+			txt->nglyph++;
+		}
+		g = font_glyph_search(txt->fctx, face, glyph, txt->size, 0);
+		if(g)
+		{
+			ha = g->hadvance;
+			va = g->vadvance;
+			bx = g->hbearingx;
+			by = g->hbearingy;
+		}
+		else
+		{
+			FT_Set_Pixel_Sizes(face, txt->size, txt->size);
+			FT_Load_Glyph(face, glyph, FT_LOAD_BITMAP_METRICS_ONLY);
+			ha = face->glyph->metrics.horiAdvance;
+			va = face->glyph->metrics.vertAdvance;
+			bx = face->glyph->metrics.horiBearingX;
+			by = face->glyph->metrics.horiBearingY;
+		}
+		w += ha;
+		if(va > h)
+			h = va;
 		if(!flag)
 		{
-			x = face->glyph->metrics.horiBearingX;
+			x = bx;
 			flag = 1;
 		}
-		if(face->glyph->metrics.horiBearingY > y)
-			y = face->glyph->metrics.horiBearingY;
+		if(by > y)
+			y = by;
 	}
 	region_init(&txt->e, (x >> 6) + 4, (y >> 6) + 4, (w >> 6) + 8, (h >> 6) + 8);
 }
@@ -84,7 +116,10 @@ struct text_t * text_alloc(const char * utf8, struct color_t * c, struct font_co
 		color_init(&txt->c, 0xff, 0xff, 0xff, 0xff);
 	txt->fctx = fctx;
 	txt->family = strdup(family ? family : "roboto");
+	txt->fam = search_family(fctx, txt->family);
 	txt->size = (size > 0) ? size : 24;
+	txt->glyphs = NULL;
+	txt->nglyph = 0;
 	calc_text_extent(txt);
 
 	return txt;
@@ -98,6 +133,8 @@ void text_free(struct text_t * txt)
 			free(txt->utf8);
 		if(txt->family)
 			free(txt->family);
+		if(txt->glyphs)
+			free(txt->glyphs);
 		free(txt);
 	}
 }
@@ -130,7 +167,8 @@ void text_set_font_family(struct text_t * txt, const char * family)
 	{
 		if(txt->family)
 			free(txt->family);
-		txt->utf8 = strdup(family ? family : "roboto");
+		txt->family = strdup(family ? family : "roboto");
+		txt->fam = search_family(txt->fctx, txt->family);
 		calc_text_extent(txt);
 	}
 }
@@ -144,7 +182,7 @@ void text_set_font_size(struct text_t * txt, int size)
 	}
 }
 
-static inline void draw_font_bitmap(struct surface_t * s, struct region_t * clip, struct color_t * c, int x, int y, FT_Bitmap * bitmap)
+static inline void draw_font_bitmap(struct surface_t * s, struct region_t * clip, struct color_t * c, int x, int y, uint8_t * buffer, int pitch, int width, int rows)
 {
 	struct region_t r, region;
 	uint32_t * dp, dv;
@@ -163,7 +201,7 @@ static inline void draw_font_bitmap(struct surface_t * s, struct region_t * clip
 		if(!region_intersect(&r, &r, clip))
 			return;
 	}
-	region_init(&region, x, y, bitmap->width, bitmap->rows);
+	region_init(&region, x, y, width, rows);
 	if(!region_intersect(&r, &r, &region))
 		return;
 
@@ -174,9 +212,9 @@ static inline void draw_font_bitmap(struct surface_t * s, struct region_t * clip
 	sx = r.x - x;
 	sy = r.y - y;
 	dskip = s->width - dw;
-	sskip = bitmap->pitch - dw;
+	sskip = pitch - dw;
 	dp = (uint32_t *)s->pixels + dy * s->width + dx;
-	sp = (uint8_t *)bitmap->buffer + sy * bitmap->pitch + sx;
+	sp = buffer + sy * pitch + sx;
 
 	for(j = 0; j < dh; j++)
 	{
@@ -216,16 +254,60 @@ static inline void draw_font_bitmap(struct surface_t * s, struct region_t * clip
 	}
 }
 
+static inline void draw_font_glyph(struct surface_t * s, struct region_t * clip, struct text_t * txt, FT_Face face, int glyph, FT_Matrix * matrix, FT_Vector * pen)
+{
+	FT_Set_Pixel_Sizes(face, txt->size, txt->size);
+	FT_Set_Transform(face, matrix, pen);
+	FT_Load_Glyph(face, glyph, FT_LOAD_RENDER);
+	FT_Set_Transform(face, NULL, NULL);
+	draw_font_bitmap(s, clip, &txt->c, face->glyph->bitmap_left, s->height - face->glyph->bitmap_top, face->glyph->bitmap.buffer, face->glyph->bitmap.pitch, face->glyph->bitmap.width, face->glyph->bitmap.rows);
+	pen->x += face->glyph->advance.x;
+	pen->y += face->glyph->advance.y;
+}
+
+/*
+ * Untransformed text is drawn from the glyph cache, the pen is snapped to whole
+ * pixels vertically and to quarter pixels horizontally. Any other matrix, and
+ * glyphs too large for the atlas, are rendered by freetype on every call.
+ */
 void render_default_text(struct surface_t * s, struct region_t * clip, struct matrix_t * m, struct text_t * txt)
 {
-	const char * p;
-	u32_t code;
-	int glyph;
-	FT_Face face;
+	struct text_glyph_t * tg;
+	struct font_glyph_t * g;
 	FT_Matrix matrix;
 	FT_Vector pen;
+	FT_Pos px, py;
 	int tx = txt->e.x;
 	int ty = txt->e.y;
+	int i;
+
+	if(!txt->glyphs)
+		return;
+
+	if((m->b == 0) && (m->c == 0) && (m->a == 1) && (m->d == 1))
+	{
+		px = (FT_Pos)((m->tx + tx) * 64);
+		py = ((FT_Pos)((m->ty + ty) * 64) + 32) >> 6;
+		for(i = 0; i < txt->nglyph; i++)
+		{
+			tg = &txt->glyphs[i];
+			g = font_glyph_lookup(txt->fctx, tg->face, tg->index, txt->size, (px & 63) >> 4);
+			if(!g)
+				continue;
+			if(g->bitmap)
+			{
+				draw_font_bitmap(s, clip, &txt->c, (px >> 6) + g->left, py - g->top, g->bitmap, g->pitch, g->width, g->height);
+			}
+			else if((g->width > 0) && (g->height > 0))
+			{
+				pen.x = px;
+				pen.y = (s->height - py) * 64;
+				draw_font_glyph(s, clip, txt, (FT_Face)tg->face, tg->index, NULL, &pen);
+			}
+			px += g->advance;
+		}
+		return;
+	}
 
 	matrix.xx = (FT_Fixed)(m->a * 65536.0);
 	matrix.xy = -((FT_Fixed)(m->c * 65536.0));
@@ -234,16 +316,9 @@ void render_default_text(struct surface_t * s, struct region_t * clip, struct ma
 	pen.x = (FT_Pos)((m->tx + m->a * tx + m->c * ty) * 64);
 	pen.y = (FT_Pos)((s->height - (m->ty + m->b * tx + m->d * ty)) * 64);
 
-	for(p = txt->utf8; utf8_to_ucs4(&code, 1, p, -1, &p) > 0;)
+	for(i = 0; i < txt->nglyph; i++)
 	{
-		glyph = search_glyph(txt->fctx, txt->family, code, (void **)(&face));
-		if(glyph == 0)
-			glyph = search_glyph(txt->fctx, "roboto", 0xfffd, (void **)(&face));
-		FT_Set_Pixel_Sizes(face, txt->size, txt->size);
-		FT_Set_Transform(face, &matrix, &pen);
-		FT_Load_Glyph(face, glyph, FT_LOAD_RENDER);
-		draw_font_bitmap(s, clip, &txt->c, face->glyph->bitmap_left, s->height - face->glyph->bitmap_top, &face->glyph->bitmap);
-		pen.x += face->glyph->advance.x;
-		pen.y += face->glyph->advance.y;
+		tg = &txt->glyphs[i];
+		draw_font_glyph(s, clip, txt, (FT_Face)tg->face, tg->index, &matrix, &pen);
 	}
 }
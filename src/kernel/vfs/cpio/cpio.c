@@ -46,80 +46,229 @@ struct cpio_newc_header_t {
 	u8_t c_check[8];
 } __attribute__ ((packed));
 
-static bool_t get_next_token(const char * path, const char * prefix, char * result)
-{
-	const char * p, * q;
-	int l;
+/*
+ * The archive is parsed once at mount time into a tree of entries,
+ * hashed by parent and name for lookups
+ */
+struct cpio_entry_t {
+	struct list_head list;
+	struct list_head head;
+	struct list_head child;
+	struct hlist_node node;
+	struct cpio_entry_t * parent;
+	u64_t offset;
+	u32_t size;
+	u32_t mode;
+	u32_t mtime;
+	int implicit;
+	char name[0];
+};
 
-	if(!path || !prefix || !result)
-		return FALSE;
+struct cpio_index_t {
+	struct list_head list;
+	struct hlist_head * hash;
+	int hsize;
+	struct cpio_entry_t root;
+};
 
-	if(*path == '/')
-		path++;
+static u32_t cpio_hex(const u8_t * s)
+{
+	char buf[9];
 
-	if(*prefix == '/')
-		prefix++;
+	memcpy(buf, s, 8);
+	buf[8] = '\0';
+	return strtoul(buf, NULL, 16);
+}
 
-	l = strlen(prefix);
-	if(strncmp(path, prefix, l) != 0)
-		return FALSE;
+static struct hlist_head * cpio_hash(struct cpio_index_t * idx, struct cpio_entry_t * parent, const char * name, int len)
+{
+	u32_t v = 5381 + (u32_t)((unsigned long)parent >> 4);
 
-	p = &path[l];
-	if(*p == '\0')
-		return FALSE;
-	if(*p == '/')
-		p++;
-	if(*p == '\0')
-		return FALSE;
+	while(len-- > 0)
+		v = (v << 5) + v + (*name++);
+	return &idx->hash[v % idx->hsize];
+}
 
-	q = strchr(p, '/');
-	if(q)
-	{
-		if (*(q + 1) != '\0')
-			return FALSE;
-		l = q - p;
-	}
-	else
+static struct cpio_entry_t * cpio_index_find(struct cpio_index_t * idx, struct cpio_entry_t * parent, const char * name, int len)
+{
+	struct cpio_entry_t * e;
+
+	hlist_for_each_entry(e, cpio_hash(idx, parent, name, len), node)
 	{
-		l = strlen(p);
+		if((e->parent == parent) && !strncmp(e->name, name, len) && (e->name[len] == '\0'))
+			return e;
 	}
-	memcpy(result, p, l);
-	result[l] = '\0';
-
-	return TRUE;
+	return NULL;
 }
 
-static bool_t check_path(const char * path, const char * prefix, const char * name)
+static struct cpio_entry_t * cpio_index_add(struct cpio_index_t * idx, struct cpio_entry_t * parent, const char * name, int len)
 {
-	int l;
+	struct cpio_entry_t * e;
+
+	e = malloc(sizeof(struct cpio_entry_t) + len + 1);
+	if(!e)
+		return NULL;
+
+	memcpy(e->name, name, len);
+	e->name[len] = '\0';
+	e->parent = parent;
+	e->offset = 0;
+	e->size = 0;
+	e->mode = 0040755;
+	e->mtime = 0;
+	e->implicit = 1;
+	init_list_head(&e->child);
+	list_add_tail(&e->head, &parent->child);
+	list_add_tail(&e->list, &idx->list);
+	hlist_add_head(&e->node, cpio_hash(idx, parent, name, len));
+
+	return e;
+}
 
-	if(!path || !prefix || !name)
-		return FALSE;
+static void cpio_index_insert(struct cpio_index_t * idx, const char * path, u64_t offset, u32_t size, u32_t mode, u32_t mtime)
+{
+	struct cpio_entry_t * parent = &idx->root;
+	struct cpio_entry_t * e;
+	const char * q;
+	int len;
 
-	if(path[0] == '/')
+	while(*path == '/')
 		path++;
+	if((*path == '\0') || (*path == '.'))
+		return;
 
-	if(prefix[0] == '/')
-		prefix++;
+	while(1)
+	{
+		q = strchr(path, '/');
+		len = q ? (q - path) : strlen(path);
+		if(q && (q[strspn(q, "/")] == '\0'))
+			q = NULL;
 
-	l = strlen(prefix);
-	if(l && (strncmp(path, prefix, l) != 0))
-		return FALSE;
+		e = cpio_index_find(idx, parent, path, len);
+		if(!q)
+			break;
+		if(!e)
+		{
+			e = cpio_index_add(idx, parent, path, len);
+			if(!e)
+				return;
+		}
+		else if((e->mode & 00170000) != 0040000)
+		{
+			return;
+		}
+		parent = e;
+		path = q + strspn(q, "/");
+	}
 
-	path += l;
+	if(!e)
+	{
+		e = cpio_index_add(idx, parent, path, len);
+		if(!e)
+			return;
+	}
+	else if(!e->implicit)
+	{
+		return;
+	}
+	e->offset = offset;
+	e->size = size;
+	e->mode = mode;
+	e->mtime = mtime;
+	e->implicit = 0;
+}
 
-	if(path[0] == '/')
-		path++;
+static void cpio_index_free(struct cpio_index_t * idx)
+{
+	struct cpio_entry_t * pos, * n;
 
-	if(strcmp(path, name) != 0)
-		return FALSE;
+	if(idx)
+	{
+		list_for_each_entry_safe(pos, n, &idx->list, list)
+		{
+			list_del(&pos->list);
+			free(pos);
+		}
+		free(idx->hash);
+		free(idx);
+	}
+}
+
+static struct cpio_index_t * cpio_index_alloc(struct block_t * dev)
+{
+	struct cpio_newc_header_t header;
+	struct cpio_index_t * idx;
+	char path[VFS_MAX_PATH];
+	u32_t size, name_size, mode, mtime;
+	u64_t off;
+	int count, pass, i;
+
+	idx = malloc(sizeof(struct cpio_index_t));
+	if(!idx)
+		return NULL;
+	init_list_head(&idx->list);
+	idx->hash = NULL;
+	idx->hsize = 0;
+	memset(&idx->root, 0, sizeof(struct cpio_entry_t));
+	init_list_head(&idx->root.child);
+	idx->root.mode = 0040755;
+
+	for(pass = 0, count = 0; pass < 2; pass++)
+	{
+		if(pass == 1)
+		{
+			idx->hsize = count * 2 + 1;
+			idx->hash = malloc(sizeof(struct hlist_head) * idx->hsize);
+			if(!idx->hash)
+			{
+				cpio_index_free(idx);
+				return NULL;
+			}
+			for(i = 0; i < idx->hsize; i++)
+				init_hlist_head(&idx->hash[i]);
+		}
+
+		off = 0;
+		while(1)
+		{
+			if(block_read(dev, (u8_t *)&header, off, sizeof(struct cpio_newc_header_t)) != sizeof(struct cpio_newc_header_t))
+				break;
+
+			if(strncmp((const char *)header.c_magic, "070701", 6) != 0)
+				break;
+
+			size = cpio_hex(header.c_filesize);
+			name_size = cpio_hex(header.c_namesize);
+			mode = cpio_hex(header.c_mode);
+			mtime = cpio_hex(header.c_mtime);
+			if((name_size == 0) || (name_size > sizeof(path)))
+				break;
+
+			if(block_read(dev, (u8_t *)path, off + sizeof(struct cpio_newc_header_t), name_size) != name_size)
+				break;
+			path[name_size - 1] = '\0';
+
+			if((size == 0) && (mode == 0) && (name_size == 11) && (strncmp(path, "TRAILER!!!", 10) == 0))
+				break;
+
+			off += sizeof(struct cpio_newc_header_t);
+			off += (((name_size + 1) & ~3) + 2);
+			if(pass == 0)
+				count++;
+			else
+				cpio_index_insert(idx, path, off, size, mode, mtime);
+			off += size;
+			off = (off + 3) & ~0x3;
+		}
+	}
 
-	return TRUE;
+	return idx;
 }
 
 static int cpio_mount(struct vfs_mount_t * m, const char * dev)
 {
 	struct cpio_newc_header_t header;
+	struct cpio_index_t * idx;
 	u64_t rd;
 
 	if(dev == NULL)
@@ -135,15 +284,20 @@ static int cpio_mount(struct vfs_mount_t * m, const char * dev)
 	if(strncmp((const char *)header.c_magic, "070701", 6) != 0)
 		return -1;
 
+	idx = cpio_index_alloc(m->m_dev);
+	if(!idx)
+		return -1;
+
 	m->m_flags |= MOUNT_RO;
-	m->m_root->v_data = NULL;
-	m->m_data = NULL;
+	m->m_root->v_data = &idx->root;
+	m->m_data = idx;
 
 	return 0;
 }
 
 static int cpio_unmount(struct vfs_mount_t * m)
 {
+	cpio_index_free(m->m_data);
 	m->m_data = NULL;
 	return 0;
 }
@@ -165,6 +319,7 @@ static int cpio_vput(struct vfs_mount_t * m, struct vfs_node_t * n)
 
 static u64_t cpio_read(struct vfs_node_t * n, s64_t off, void * buf, u64_t len)
 {
+	const void * p;
 	u64_t toff;
 	u64_t sz = 0;
 
@@ -178,12 +333,30 @@ static u64_t cpio_read(struct vfs_node_t * n, s64_t off, void * buf, u64_t len)
 	if((n->v_size - off) < sz)
 		sz = n->v_size - off;
 
-	toff = (u64_t)((unsigned long)(n->v_data));
-	sz = block_read(n->v_mount->m_dev, (u8_t *)buf, (toff + off), sz);
+	toff = ((struct cpio_entry_t *)n->v_data)->offset;
+	p = block_mmap(n->v_mount->m_dev, (toff + off), sz);
+	if(p)
+		memcpy(buf, p, sz);
+	else
+		sz = block_read(n->v_mount->m_dev, (u8_t *)buf, (toff + off), sz);
 
 	return sz;
 }
 
+static const void * cpio_mmap(struct vfs_node_t * n, s64_t off, u64_t len)
+{
+	u64_t toff;
+
+	if(n->v_type != VNT_REG)
+		return NULL;
+
+	if((off < 0) || (off + len > n->v_size))
+		return NULL;
+
+	toff = ((struct cpio_entry_t *)n->v_data)->offset;
+	return block_mmap(n->v_mount->m_dev, (toff + off), len);
+}
+
 static u64_t cpio_write(struct vfs_node_t * n, s64_t off, void * buf, u64_t len)
 {
 	return 0;
@@ -201,57 +374,22 @@ static int cpio_sync(struct vfs_node_t * n)
 
 static int cpio_readdir(struct vfs_node_t * dn, s64_t off, struct vfs_dirent_t * d)
 {
-	struct cpio_newc_header_t header;
-	char path[VFS_MAX_PATH];
-	char name[VFS_MAX_NAME];
-	u32_t size, name_size, mode;
-	u64_t toff = 0, rd;
-	char buf[9];
+	struct cpio_entry_t * de = dn->v_data;
+	struct cpio_entry_t * e;
+	u32_t mode;
 	int i = 0;
 
-	while(1)
-	{
-		rd = block_read(dn->v_mount->m_dev, (u8_t *)&header, toff, sizeof(struct cpio_newc_header_t));
-		if(rd != sizeof(struct cpio_newc_header_t))
-			return -1;
-
-		if(strncmp((const char *)&header.c_magic, "070701", 6) != 0)
-			return -1;
-
-		buf[8] = '\0';
-
-		memcpy(buf, &header.c_filesize, 8);
-		size = strtoul((const char *)buf, NULL, 16);
-
-		memcpy(buf, &header.c_namesize, 8);
-		name_size = strtoul((const char *)buf, NULL, 16);
-
-		memcpy(buf, &header.c_mode, 8);
-		mode = strtoul((const char *)buf, NULL, 16);
-
-		rd = block_read(dn->v_mount->m_dev, (u8_t *)path, toff + sizeof(struct cpio_newc_header_t), name_size);
-		if(!rd)
-			return -1;
-
-		if((size == 0) && (mode == 0) && (name_size == 11) && (strncmp(path, "TRAILER!!!", 10) == 0))
-			return -1;
-
-		toff += sizeof(struct cpio_newc_header_t);
-		toff += (((name_size + 1) & ~3) + 2) + size;
-		toff = (toff + 3) & ~3;
-
-		if(path[0] == '.')
-			continue;
-
-		if(!get_next_token(path, dn->v_path, name))
-			continue;
+	if(!de || (off < 0))
+		return -1;
 
+	list_for_each_entry(e, &de->child, head)
+	{
 		if(i++ == off)
-		{
-			toff = 0;
 			break;
-		}
 	}
+	if(&e->head == &de->child)
+		return -1;
+	mode = e->mode;
 
 	if((mode & 00170000) == 0140000)
 	{
@@ -286,7 +424,7 @@ static int cpio_readdir(struct vfs_node_t * dn, s64_t off, struct vfs_dirent_t *
 		d->d_type = VDT_REG;
 	}
 
-	strlcpy(d->d_name, name, sizeof(d->d_name));
+	strlcpy(d->d_name, e->name, sizeof(d->d_name));
 	d->d_off = off;
 	d->d_reclen = 1;
 
@@ -295,49 +433,17 @@ static int cpio_readdir(struct vfs_node_t * dn, s64_t off, struct vfs_dirent_t *
 
 static int cpio_lookup(struct vfs_node_t * dn, const char * name, struct vfs_node_t * n)
 {
-	struct cpio_newc_header_t header;
-	char path[VFS_MAX_PATH];
-	u64_t off = 0, rd;
-	u32_t size, name_size, mode, mtime;
-	u8_t buf[9];
-
-	while(1)
-	{
-		rd = block_read(dn->v_mount->m_dev, (u8_t *)&header, off, sizeof(struct cpio_newc_header_t));
-		if(rd != sizeof(struct cpio_newc_header_t))
-			return -1;
-
-		if(strncmp((const char *)header.c_magic, "070701", 6) != 0)
-			return -1;
+	struct cpio_entry_t * e;
+	u32_t mode, mtime;
 
-		buf[8] = '\0';
-
-		memcpy(buf, &header.c_filesize, 8);
-		size = strtoul((const char *)buf, NULL, 16);
-
-		memcpy(buf, &header.c_namesize, 8);
-		name_size = strtoul((const char *)buf, NULL, 16);
-
-		memcpy(buf, &header.c_mode, 8);
-		mode = strtoul((const char *)buf, NULL, 16);
-
-		memcpy(buf, &header.c_mtime, 8);
-		mtime = strtoul((const char *)buf, NULL, 16);
-
-		rd = block_read(dn->v_mount->m_dev, (u8_t *)path, off + sizeof(struct cpio_newc_header_t), name_size);
-		if(!rd)
-			return -1;
-
-		if((size == 0) && (mode == 0) && (name_size == 11) && (strncmp(path, "TRAILER!!!", 10) == 0))
-			return -1;
-
-		if((path[0] != '.') && check_path(path, dn->v_path, name))
-			break;
+	if(!dn->v_data)
+		return -1;
 
-		off += sizeof(struct cpio_newc_header_t);
-		off += (((name_size + 1) & ~3) + 2) + size;
-		off = (off + 3) & ~0x3;
-	}
+	e = cpio_index_find(dn->v_mount->m_data, dn->v_data, name, strlen(name));
+	if(!e)
+		return -1;
+	mode = e->mode;
+	mtime = e->mtime;
 
 	n->v_atime = mtime;
 	n->v_mtime = mtime;
@@ -393,11 +499,8 @@ static int cpio_lookup(struct vfs_node_t * dn, const char * name, struct vfs_nod
 	n->v_mode |= (mode & 00004) ? S_IROTH : 0;
 	n->v_mode |= (mode & 00002) ? S_IWOTH : 0;
 	n->v_mode |= (mode & 00001) ? S_IXOTH : 0;
-	n->v_size = size;
-
-	off += sizeof(struct cpio_newc_header_t);
-	off += (((name_size + 1) & ~3) + 2);
-	n->v_data = (void *)((unsigned long)off);
+	n->v_size = e->size;
+	n->v_data = e;
 
 	return 0;
 }
@@ -434,6 +537,7 @@ static int cpio_chmod(struct vfs_node_t * n, u32_t mode)
 
 static struct filesystem_t cpio = {
 	.name		= "cpio",
+	.flags		= FS_SHARED_READ,
 
 	.mount		= cpio_mount,
 	.unmount	= cpio_unmount,
@@ -443,6 +547,7 @@ static struct filesystem_t cpio = {
 
 	.read		= cpio_read,
 	.write		= cpio_write,
+	.mmap		= cpio_mmap,
 	.truncate	= cpio_truncate,
 	.sync		= cpio_sync,
 	.readdir	= cpio_readdir,
@@ -364,7 +364,7 @@ int ext4fs_control_sync(struct ext4fs_control_t * ctrl)
 	/* Unlock sblock */
 	mutex_unlock(&ctrl->sblock_lock);
 
-	desc_per_blk = udiv32(ctrl->block_size, sizeof(struct ext2_block_group_t));
+	desc_per_blk = udiv32(ctrl->block_size, ctrl->group_desc_size);
 	for(g = 0; g < ctrl->group_count; g++)
 	{
 		/* Lock group */
@@ -379,7 +379,7 @@ int ext4fs_control_sync(struct ext4fs_control_t * ctrl)
 
 		/* Write group descriptor to block device */
 		blkno = ctrl->group_table_blkno + udiv32(g, desc_per_blk);
-		blkoff = umod32(g, desc_per_blk) * sizeof(struct ext2_block_group_t);
+		blkoff = umod32(g, desc_per_blk) * ctrl->group_desc_size;
 		rc = ext4fs_devwrite(ctrl, blkno, blkoff, sizeof(struct ext2_block_group_t), (char *)&ctrl->groups[g].grp);
 		if(rc)
 		{
@@ -450,6 +450,27 @@ int ext4fs_control_init(struct ext4fs_control_t * ctrl, struct block_t * bdev)
 		goto fail;
 	}
 
+	/* Refuse what can not be read, fall back to read only for what can not be written */
+	if(le32_to_cpu(ctrl->sblock.feature_incompat) & ~EXT4_FEAT_INCOMPAT_SUPP)
+	{
+		LOG("ext4: unsupported incompat features 0x%x", le32_to_cpu(ctrl->sblock.feature_incompat) & ~EXT4_FEAT_INCOMPAT_SUPP);
+		rc = -1;
+		goto fail;
+	}
+	if((le32_to_cpu(ctrl->sblock.feature_incompat) & EXT4_FEAT_INCOMPAT_64BIT) && le32_to_cpu(ctrl->sblock.total_blocks_hi))
+	{
+		LOG("ext4: block numbers above 32 bits are not supported");
+		rc = -1;
+		goto fail;
+	}
+	ctrl->read_only = FALSE;
+	if((le32_to_cpu(ctrl->sblock.feature_ro_compat) & ~EXT4_FEAT_RO_COMPAT_SUPP) ||
+		(le32_to_cpu(ctrl->sblock.feature_incompat) & EXT3_FEAT_INCOMPAT_RECOVER) || !bdev->write)
+	{
+		LOG("ext4: mounting read only");
+		ctrl->read_only = TRUE;
+	}
+
 	/* Directory indexing not supported so throw warning */
 	if(le32_to_cpu(ctrl->sblock.feature_compatibility) &
 	EXT2_FEAT_COMPAT_DIR_INDEX)
@@ -486,7 +507,12 @@ int ext4fs_control_init(struct ext4fs_control_t * ctrl, struct block_t * bdev)
 		rc = -1;
 		goto fail;
 	}
-	desc_per_blk = udiv32(ctrl->block_size, sizeof(struct ext2_block_group_t));
+	ctrl->group_desc_size = sizeof(struct ext2_block_group_t);
+	if((le32_to_cpu(ctrl->sblock.feature_incompat) & EXT4_FEAT_INCOMPAT_64BIT) && (le16_to_cpu(ctrl->sblock.desc_size) > ctrl->group_desc_size))
+	{
+		ctrl->group_desc_size = le16_to_cpu(ctrl->sblock.desc_size);
+	}
+	desc_per_blk = udiv32(ctrl->block_size, ctrl->group_desc_size);
 	for(g = 0; g < ctrl->group_count; g++)
 	{
 		/* Init group lock */
@@ -494,7 +520,7 @@ int ext4fs_control_init(struct ext4fs_control_t * ctrl, struct block_t * bdev)
 
 		/* Load descriptor */
 		blkno = ctrl->group_table_blkno + udiv32(g, desc_per_blk);
-		blkoff = umod32(g, desc_per_blk) * sizeof(struct ext2_block_group_t);
+		blkoff = umod32(g, desc_per_blk) * ctrl->group_desc_size;
 		rc = ext4fs_devread(ctrl, blkno, blkoff, sizeof(struct ext2_block_group_t), (char *)&ctrl->groups[g].grp);
 		if(rc)
 		{
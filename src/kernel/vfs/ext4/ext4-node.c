@@ -215,13 +215,146 @@ int ext4fs_node_sync(struct ext4fs_node_t * node)
 	return 0;
 }
 
-int ext4fs_node_read_blkno(struct ext4fs_node_t * node, u32_t blkpos, u32_t *blkno)
+static inline bool_t ext4fs_node_has_extents(struct ext4fs_node_t * node)
+{
+	return (le32_to_cpu(node->inode.flags) & EXT4_EXTENTS_FL) ? TRUE : FALSE;
+}
+
+/*
+ * Map blkpos through the extent tree. On return blkcnt logical blocks
+ * starting at blkpos are physically contiguous from blkno, or a hole when
+ * blkno is zero. The mapping found is kept in the node, so sequential
+ * reads only walk the tree once per extent.
+ */
+int ext4fs_node_read_extent(struct ext4fs_node_t * node, u32_t blkpos, u32_t * blkno, u32_t * blkcnt)
+{
+	int rc;
+	u32_t i, lo, hi, leaf, next, len;
+	struct ext4_extent_header_t * hdr;
+	struct ext4_extent_idx_t * idx;
+	struct ext4_extent_t * ext;
+	struct ext4fs_control_t *ctrl = node->ctrl;
+
+	if(node->ext_blkcnt && (blkpos >= node->ext_blkpos) && (blkpos - node->ext_blkpos < node->ext_blkcnt))
+	{
+		i = blkpos - node->ext_blkpos;
+		*blkno = node->ext_blkno ? node->ext_blkno + i : 0;
+		*blkcnt = node->ext_blkcnt - i;
+		return 0;
+	}
+
+	hdr = (struct ext4_extent_header_t *)node->inode.b.symlink;
+	while(1)
+	{
+		if(le16_to_cpu(hdr->magic) != EXT4_EXT_MAGIC)
+		{
+			return -1;
+		}
+		if(le16_to_cpu(hdr->depth) == 0)
+		{
+			break;
+		}
+
+		/* Interior node, follow the last index starting at or before blkpos */
+		idx = (struct ext4_extent_idx_t *)(hdr + 1);
+		lo = 0;
+		hi = le16_to_cpu(hdr->entries);
+		if(hi == 0)
+		{
+			return -1;
+		}
+		while(hi - lo > 1)
+		{
+			i = (lo + hi) / 2;
+			if(le32_to_cpu(idx[i].block) <= blkpos)
+				lo = i;
+			else
+				hi = i;
+		}
+		if(le16_to_cpu(idx[lo].leaf_hi))
+		{
+			return -1;
+		}
+		leaf = le32_to_cpu(idx[lo].leaf_lo);
+
+		if(!node->ext_block)
+		{
+			node->ext_block = malloc(ctrl->block_size);
+			if(!node->ext_block)
+			{
+				return -1;
+			}
+			node->ext_block_blkno = 0;
+		}
+		if(node->ext_block_blkno != leaf)
+		{
+			rc = ext4fs_devread(ctrl, leaf, 0, ctrl->block_size, (char *)node->ext_block);
+			if(rc)
+			{
+				node->ext_block_blkno = 0;
+				return rc;
+			}
+			node->ext_block_blkno = leaf;
+		}
+		hdr = (struct ext4_extent_header_t *)node->ext_block;
+	}
+
+	/* Leaf node, find the extent covering blkpos or the hole before the next one */
+	ext = (struct ext4_extent_t *)(hdr + 1);
+	next = 0xffffffff;
+	for(i = 0; i < le16_to_cpu(hdr->entries); i++)
+	{
+		if(le32_to_cpu(ext[i].block) > blkpos)
+		{
+			next = le32_to_cpu(ext[i].block);
+			break;
+		}
+		len = le16_to_cpu(ext[i].len);
+		if(len > EXT4_EXT_INIT_MAX_LEN)
+		{
+			len -= EXT4_EXT_INIT_MAX_LEN;
+		}
+		if(blkpos - le32_to_cpu(ext[i].block) < len)
+		{
+			if(le16_to_cpu(ext[i].start_hi))
+			{
+				return -1;
+			}
+			node->ext_blkpos = le32_to_cpu(ext[i].block);
+			node->ext_blkcnt = len;
+			if(le16_to_cpu(ext[i].len) > EXT4_EXT_INIT_MAX_LEN)
+				node->ext_blkno = 0;
+			else
+				node->ext_blkno = le32_to_cpu(ext[i].start_lo);
+			i = blkpos - node->ext_blkpos;
+			*blkno = node->ext_blkno ? node->ext_blkno + i : 0;
+			*blkcnt = node->ext_blkcnt - i;
+			return 0;
+		}
+	}
+
+	node->ext_blkpos = blkpos;
+	node->ext_blkcnt = next - blkpos;
+	node->ext_blkno = 0;
+	*blkno = 0;
+	*blkcnt = node->ext_blkcnt;
+
+	return 0;
+}
+
+int ext4fs_node_read_blkno(struct ext4fs_node_t * node, u32_t blkpos, u32_t * blkno)
 {
 	int rc;
 	u32_t dindir2_blkno;
+	u32_t blkcnt;
 	struct ext2_inode_t *inode = &node->inode;
 	struct ext4fs_control_t *ctrl = node->ctrl;
 
+	if(ext4fs_node_has_extents(node))
+	{
+		return ext4fs_node_read_extent(node, blkpos, blkno, &blkcnt);
+	}
+
 	if(blkpos < ctrl->dir_blklast)
 	{
 		/* Direct blocks.  */
@@ -317,6 +450,12 @@ int ext4fs_node_write_blkno(struct ext4fs_node_t * node, u32_t blkpos, u32_t blk
 	struct ext2_inode_t *inode = &node->inode;
 	struct ext4fs_control_t *ctrl = node->ctrl;
 
+	/* Extent tree updates are not supported */
+	if(ext4fs_node_has_extents(node))
+	{
+		return -1;
+	}
+
 	if(blkpos < ctrl->dir_blklast)
 	{
 		/* Direct blocks.  */
@@ -422,14 +561,50 @@ int ext4fs_node_write_blkno(struct ext4fs_node_t * node, u32_t blkpos, u32_t blk
 	return 0;
 }
 
+/*
+ * Map up to maxcnt blocks from blkpos that are contiguous on disk, or that
+ * are all holes when blkno is zero.
+ */
+static int ext4fs_node_map_run(struct ext4fs_node_t * node, u32_t blkpos, u32_t maxcnt, u32_t * blkno, u32_t * blkcnt)
+{
+	int rc;
+	u32_t cnt, next;
+
+	if(ext4fs_node_has_extents(node))
+	{
+		rc = ext4fs_node_read_extent(node, blkpos, blkno, &cnt);
+		if(rc)
+		{
+			return rc;
+		}
+		*blkcnt = (cnt < maxcnt) ? cnt : maxcnt;
+		return 0;
+	}
+
+	rc = ext4fs_node_read_blkno(node, blkpos, blkno);
+	if(rc)
+	{
+		return rc;
+	}
+	for(cnt = 1; cnt < maxcnt; cnt++)
+	{
+		rc = ext4fs_node_read_blkno(node, blkpos + cnt, &next);
+		if(rc || (*blkno ? (next != *blkno + cnt) : (next != 0)))
+		{
+			break;
+		}
+	}
+	*blkcnt = cnt;
+
+	return 0;
+}
+
 /* Note: Node position has to be 64-bit */
 u32_t ext4fs_node_read(struct ext4fs_node_t * node, u64_t pos, u32_t len, char * buf)
 {
 	int rc;
 	u64_t filesize = ext4fs_node_get_size(node);
-	u32_t i, rlen, blkno, blkoff, blklen;
-	u32_t last_blkpos, last_blklen;
-	u32_t first_blkpos, first_blkoff, first_blklen;
+	u32_t rlen, blkpos, blkoff, blklen, blkno, blkcnt;
 	struct ext4fs_control_t *ctrl = node->ctrl;
 
 	if(filesize <= pos)
@@ -442,57 +617,70 @@ u32_t ext4fs_node_read(struct ext4fs_node_t * node, u64_t pos, u32_t len, char *
 	}
 
 	/* Note: div result < 32-bit */
-	first_blkpos = udiv64(pos, ctrl->block_size);
-	first_blkoff = pos - (first_blkpos * ctrl->block_size);
-	first_blklen = ctrl->block_size - first_blkoff;
-	if(len < first_blklen)
-	{
-		first_blklen = len;
-	}
-
-	/* Note: div result < 32-bit */
-	last_blkpos = udiv64((len + pos), ctrl->block_size);
-	last_blklen = (len + pos) - (last_blkpos * ctrl->block_size);
+	blkpos = udiv64(pos, ctrl->block_size);
+	blkoff = pos - (blkpos * ctrl->block_size);
 
 	rlen = len;
-	i = first_blkpos;
 	while(rlen)
 	{
-		rc = ext4fs_node_read_blkno(node, i, &blkno);
-		if(rc)
+		if(blkoff || (rlen < ctrl->block_size))
 		{
-			goto done;
-		}
+			/* Partial block, read through the cached block */
+			blklen = ctrl->block_size - blkoff;
+			if(rlen < blklen)
+			{
+				blklen = rlen;
+			}
+			blkcnt = 1;
 
-		if(i == first_blkpos)
-		{
-			/* First block.  */
-			blkoff = first_blkoff;
-			blklen = first_blklen;
-		}
-		else if(i == last_blkpos)
-		{
-			/* Last block.  */
-			blkoff = 0;
-			blklen = last_blklen;
+			rc = ext4fs_node_read_blkno(node, blkpos, &blkno);
+			if(rc)
+			{
+				goto done;
+			}
+			rc = ext4fs_node_read_blk(node, blkno, blkoff, blklen, buf);
+			if(rc)
+			{
+				goto done;
+			}
 		}
 		else
 		{
-			/* Middle block. */
-			blkoff = 0;
-			blklen = ctrl->block_size;
-		}
+			/* Whole blocks, one device read per contiguous run */
+			rc = ext4fs_node_map_run(node, blkpos, udiv32(rlen, ctrl->block_size), &blkno, &blkcnt);
+			if(rc)
+			{
+				goto done;
+			}
+			blklen = blkcnt * ctrl->block_size;
 
-		/* Read cached block */
-		rc = ext4fs_node_read_blk(node, blkno, blkoff, blklen, buf);
-		if(rc)
-		{
-			goto done;
+			if(!blkno)
+			{
+				memset(buf, 0, blklen);
+			}
+			else
+			{
+				if(node->cached_dirty && (node->cached_blkno >= blkno) && (node->cached_blkno - blkno < blkcnt))
+				{
+					rc = ext4fs_devwrite(ctrl, node->cached_blkno, 0, ctrl->block_size, (char *)node->cached_block);
+					if(rc)
+					{
+						goto done;
+					}
+					node->cached_dirty = FALSE;
+				}
+				rc = ext4fs_devread(ctrl, blkno, 0, blklen, buf);
+				if(rc)
+				{
+					goto done;
+				}
+			}
 		}
 
 		buf += blklen;
 		rlen -= blklen;
-		i++;
+		blkpos += blkcnt;
+		blkoff = 0;
 	}
 
 	done: return len - rlen;
@@ -598,6 +786,12 @@ int ext4fs_node_truncate(struct ext4fs_node_t * node, u64_t pos)
 		return 0;
 	}
 
+	/* Extent tree updates are not supported */
+	if(ext4fs_node_has_extents(node))
+	{
+		return -1;
+	}
+
 	/* Note: div result < 32-bit */
 	first_blkpos = udiv64(pos, ctrl->block_size);
 	first_blkoff = pos - (first_blkpos * ctrl->block_size);
@@ -688,6 +882,12 @@ int ext4fs_node_load(struct ext4fs_control_t * ctrl, u32_t inode_no, struct ext4
 	node->dindir2_blkno = 0;
 	node->dindir2_dirty = FALSE;
 
+	node->ext_blkpos = 0;
+	node->ext_blkcnt = 0;
+	node->ext_blkno = 0;
+	node->ext_block = NULL;
+	node->ext_block_blkno = 0;
+
 	return 0;
 }
 
@@ -714,6 +914,12 @@ int ext4fs_node_init(struct ext4fs_node_t * node)
 	node->dindir2_blkno = 0;
 	node->dindir2_dirty = FALSE;
 
+	node->ext_blkpos = 0;
+	node->ext_blkcnt = 0;
+	node->ext_blkno = 0;
+	node->ext_block = NULL;
+	node->ext_block_blkno = 0;
+
 	node->lookup_victim = 0;
 	for(idx = 0; idx < EXT4_NODE_LOOKUP_SIZE; idx++)
 	{
@@ -745,6 +951,11 @@ int ext4fs_node_exit(struct ext4fs_node_t * node)
 		free(node->dindir2_block);
 	}
 
+	if(node->ext_block)
+	{
+		free(node->ext_block);
+	}
+
 	return 0;
 }
 
@@ -122,6 +122,8 @@ int ext4fs_mount(struct vfs_mount_t * m, const char * dev)
 	m->m_root->v_size = ext4fs_node_get_size(root);
 
 	/* Save control as mount point data */
+	if(ctrl->read_only)
+		m->m_flags |= MOUNT_RO;
 	m->m_data = ctrl;
 	return 0;
 
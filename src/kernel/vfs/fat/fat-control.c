@@ -50,31 +50,53 @@ static int __fatfs_control_flush_fat_cache(struct fatfs_control_t * ctrl, u32_t
 	return 0;
 }
 
+static void __fatfs_control_touch_fat_cache(struct fatfs_control_t * ctrl, int index)
+{
+	int i;
+
+	if(++ctrl->fat_cache_tick == 0)
+	{
+		for(i = 0; i < FAT_TABLE_CACHE_SIZE; i++)
+			ctrl->fat_cache_stamp[i] = 0;
+		ctrl->fat_cache_tick = 1;
+	}
+	ctrl->fat_cache_stamp[index] = ctrl->fat_cache_tick;
+	ctrl->fat_cache_last = index;
+}
+
 static int __fatfs_control_find_fat_cache(struct fatfs_control_t * ctrl, u32_t sect_num)
 {
 	int index;
 
+	if(ctrl->fat_cache_num[ctrl->fat_cache_last] == sect_num)
+		return ctrl->fat_cache_last;
+
 	for(index = 0; index < FAT_TABLE_CACHE_SIZE; index++)
 	{
 		if(ctrl->fat_cache_num[index] == sect_num)
+		{
+			__fatfs_control_touch_fat_cache(ctrl, index);
 			return index;
+		}
 	}
 	return -1;
 }
 
 static int __fatfs_control_load_fat_cache(struct fatfs_control_t * ctrl, u32_t sect_num)
 {
-	int rc;
+	int rc, i;
 	u32_t index;
 	u64_t fat_base, len;
 
 	if(-1 < __fatfs_control_find_fat_cache(ctrl, sect_num))
 		return 0;
 
-	index = ctrl->fat_cache_victim;
-	ctrl->fat_cache_victim++;
-	if(ctrl->fat_cache_victim == FAT_TABLE_CACHE_SIZE)
-		ctrl->fat_cache_victim = 0;
+	index = 0;
+	for(i = 1; i < FAT_TABLE_CACHE_SIZE; i++)
+	{
+		if(ctrl->fat_cache_stamp[i] < ctrl->fat_cache_stamp[index])
+			index = i;
+	}
 
 	rc = __fatfs_control_flush_fat_cache(ctrl, index);
 	if(rc)
@@ -83,8 +105,12 @@ static int __fatfs_control_load_fat_cache(struct fatfs_control_t * ctrl, u32_t s
 	fat_base = (u64_t) ctrl->first_fat_sector * ctrl->bytes_per_sector;
 	len = block_read(ctrl->bdev, &ctrl->fat_cache_buf[index * ctrl->bytes_per_sector], fat_base + sect_num * ctrl->bytes_per_sector, ctrl->bytes_per_sector);
 	if(len != ctrl->bytes_per_sector)
+	{
+		ctrl->fat_cache_num[index] = ~0;
 		return -1;
+	}
 	ctrl->fat_cache_num[index] = sect_num;
+	__fatfs_control_touch_fat_cache(ctrl, index);
 
 	return 0;
 }
@@ -341,6 +367,14 @@ static int __fatfs_control_set_next_cluster(struct fatfs_control_t * ctrl, u32_t
 	if(len != fat_len)
 		return -1;
 
+	if(ctrl->free_map && (clust <= ctrl->free_last))
+	{
+		if(next == 0x0)
+			ctrl->free_map[clust >> 5] &= ~(1U << (clust & 0x1f));
+		else
+			ctrl->free_map[clust >> 5] |= (1U << (clust & 0x1f));
+	}
+
 	return 0;
 }
 
@@ -396,12 +430,94 @@ static int __fatfs_control_nth_cluster(struct fatfs_control_t * ctrl, u32_t clus
 	return 0;
 }
 
+/*
+ * One bit per cluster, set for clusters in use, the whole table is scanned
+ * once and then kept in step by __fatfs_control_set_next_cluster
+ */
+static void __fatfs_control_build_free_map(struct fatfs_control_t * ctrl)
+{
+	u32_t * map;
+	u32_t first, last, current, next;
+
+	first = __fatfs_control_first_valid_cluster(ctrl);
+	last = __fatfs_control_last_valid_cluster(ctrl);
+	if(last > ctrl->data_clusters + 1)
+		last = ctrl->data_clusters + 1;
+	if(last < first)
+		return;
+
+	map = calloc((last >> 5) + 1, sizeof(u32_t));
+	if(!map)
+		return;
+
+	for(current = 0; current < first; current++)
+		map[current >> 5] |= (1U << (current & 0x1f));
+	for(current = first; current <= last; current++)
+	{
+		if(__fatfs_control_get_next_cluster(ctrl, current, &next))
+		{
+			free(map);
+			return;
+		}
+		if(next != 0x0)
+			map[current >> 5] |= (1U << (current & 0x1f));
+	}
+	for(current = last + 1; current & 0x1f; current++)
+		map[current >> 5] |= (1U << (current & 0x1f));
+
+	ctrl->free_map = map;
+	ctrl->free_last = last;
+	ctrl->free_hint = first;
+}
+
+static bool_t __fatfs_control_find_free_cluster(struct fatfs_control_t * ctrl, u32_t from, u32_t * clust)
+{
+	u32_t words = (ctrl->free_last >> 5) + 1;
+	u32_t w, i, bits;
+
+	if(from > ctrl->free_last)
+		from = 0;
+	w = from >> 5;
+	bits = ctrl->free_map[w] | ((1U << (from & 0x1f)) - 1);
+	for(i = 0; i <= words; i++)
+	{
+		if(bits != 0xffffffff)
+		{
+			*clust = (w << 5) + __builtin_ctz(~bits);
+			return TRUE;
+		}
+		if(++w >= words)
+			w = 0;
+		bits = ctrl->free_map[w];
+	}
+	return FALSE;
+}
+
 static int __fatfs_control_alloc_cluster(struct fatfs_control_t * ctrl, u32_t clust, u32_t * newclust)
 {
 	int rc;
 	bool_t found;
 	u32_t current, next, first, last;
 
+	if(!ctrl->free_map)
+		__fatfs_control_build_free_map(ctrl);
+
+	if(ctrl->free_map)
+	{
+		if(!__fatfs_control_find_free_cluster(ctrl, __fatfs_control_valid_cluster(ctrl, clust) ? clust : ctrl->free_hint, &current))
+			return -1;
+
+		rc = __fatfs_control_set_last_cluster(ctrl, current);
+		if(rc)
+			return rc;
+
+		ctrl->free_hint = current + 1;
+		if(newclust)
+			*newclust = current;
+
+		return 0;
+	}
+
 	found = FALSE;
 
 	if(__fatfs_control_valid_cluster(ctrl, clust))
@@ -720,12 +836,17 @@ int fatfs_control_init(struct fatfs_control_t * ctrl, struct block_t * bdev)
 
 	/* Initialize fat cache */
 	mutex_init(&ctrl->fat_cache_lock);
-	ctrl->fat_cache_victim = 0;
+	ctrl->fat_cache_tick = 0;
+	ctrl->fat_cache_last = 0;
 	for(i = 0; i < FAT_TABLE_CACHE_SIZE; i++)
 	{
 		ctrl->fat_cache_dirty[i] = FALSE;
 		ctrl->fat_cache_num[i] = i;
+		ctrl->fat_cache_stamp[i] = 0;
 	}
+	ctrl->free_map = NULL;
+	ctrl->free_last = 0;
+	ctrl->free_hint = 0;
 	ctrl->fat_cache_buf = calloc(1, FAT_TABLE_CACHE_SIZE * ctrl->bytes_per_sector);
 	if(!ctrl->fat_cache_buf)
 		return -1;
@@ -744,6 +865,7 @@ int fatfs_control_init(struct fatfs_control_t * ctrl, struct block_t * bdev)
 
 int fatfs_control_exit(struct fatfs_control_t * ctrl)
 {
+	free(ctrl->free_map);
 	free(ctrl->fat_cache_buf);
 	return 0;
 }
@@ -212,31 +212,103 @@ static int fatfs_node_auto_alloc_next_cluster(struct fatfs_node_t * node, u32_t
 	return 0;
 }
 
-static void fatfs_node_fast_jump_cluster(struct fatfs_node_t * node, u32_t pos, u32_t * cl_pos, u32_t * cl_num)
+static void fatfs_node_reset_runs(struct fatfs_node_t * node)
 {
-	struct fatfs_control_t *ctrl = node->ctrl;
+	node->runs_count = 0;
+	node->runs_first = node->first_cluster;
+	node->runs_mapped = 0;
+}
 
-	node->cur_pos = ctrl->bytes_per_cluster * udiv32(node->cur_pos, ctrl->bytes_per_cluster);
+static int fatfs_node_push_run(struct fatfs_node_t * node, u32_t clust)
+{
+	struct fatfs_run_t * r;
+	u32_t size;
 
-	/* Jump to current pos if pos >= cur_cluster*/
-	if(pos >= node->cur_pos)
+	if(node->runs_count > 0)
 	{
-		*cl_pos = udiv32(pos - node->cur_pos, ctrl->bytes_per_cluster);
-		*cl_num = node->cur_cluster;
+		r = &node->runs[node->runs_count - 1];
+		if(r->cluster + r->count == clust)
+		{
+			r->count++;
+			node->runs_mapped++;
+			return 0;
+		}
 	}
-	else
+
+	if(node->runs_count >= node->runs_size)
 	{
-		*cl_pos = udiv32(pos, ctrl->bytes_per_cluster);
-		*cl_num = node->first_cluster;
-		node->cur_cluster = node->first_cluster;
-		node->cur_pos = 0;
+		size = node->runs_size ? node->runs_size * 2 : 8;
+		r = realloc(node->runs, sizeof(struct fatfs_run_t) * size);
+		if(!r)
+			return -1;
+		node->runs = r;
+		node->runs_size = size;
 	}
+
+	r = &node->runs[node->runs_count++];
+	r->index = node->runs_mapped;
+	r->cluster = clust;
+	r->count = 1;
+	node->runs_mapped++;
+
+	return 0;
+}
+
+/*
+ * Find the cluster holding file cluster index, the chain is only walked
+ * past the clusters already mapped. If the chain is shorter the last
+ * cluster is returned along with its index
+ */
+static int fatfs_node_map_cluster(struct fatfs_node_t * node, u32_t index, u32_t * cl_idx, u32_t * cl_num)
+{
+	struct fatfs_control_t * ctrl = node->ctrl;
+	struct fatfs_run_t * r;
+	u32_t clust, lo, hi, mid;
+
+	if(node->runs_first != node->first_cluster)
+		fatfs_node_reset_runs(node);
+
+	if(!fatfs_control_valid_cluster(ctrl, node->first_cluster))
+		return -1;
+
+	if((node->runs_mapped == 0) && fatfs_node_push_run(node, node->first_cluster))
+		return -1;
+
+	while(node->runs_mapped <= index)
+	{
+		r = &node->runs[node->runs_count - 1];
+		if((node->runs_mapped > ctrl->data_clusters)
+			|| fatfs_control_nth_cluster(ctrl, r->cluster + r->count - 1, 1, &clust)
+			|| fatfs_node_push_run(node, clust))
+		{
+			r = &node->runs[node->runs_count - 1];
+			*cl_idx = node->runs_mapped - 1;
+			*cl_num = r->cluster + r->count - 1;
+			return -1;
+		}
+	}
+
+	lo = 0;
+	hi = node->runs_count - 1;
+	while(lo < hi)
+	{
+		mid = (lo + hi + 1) >> 1;
+		if(node->runs[mid].index <= index)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	r = &node->runs[lo];
+	*cl_idx = index;
+	*cl_num = r->cluster + (index - r->index);
+
+	return 0;
 }
 
 u32_t fatfs_node_read(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t * buf)
 {
 	u64_t roff, rlen;
-	u32_t r, rstartcl;
+	u32_t r, cl_idx;
 	u32_t cl_off, cl_num, cl_len;
 	struct fatfs_control_t *ctrl = node->ctrl;
 
@@ -254,9 +326,7 @@ u32_t fatfs_node_read(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t * b
 		return block_read(ctrl->bdev, (u8_t *) buf, roff, rlen);
 	}
 
-	fatfs_node_fast_jump_cluster(node, pos, &rstartcl, &cl_num);
-
-	if(fatfs_node_nth_cluster(node, cl_num, rstartcl, &cl_num))
+	if(fatfs_node_map_cluster(node, udiv32(pos, ctrl->bytes_per_cluster), &cl_idx, &cl_num))
 		return 0;
 
 	r = 0;
@@ -267,10 +337,6 @@ u32_t fatfs_node_read(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t * b
 		cl_len = ctrl->bytes_per_cluster - cl_off;
 		cl_len = (len - r < cl_len) ? len - r : cl_len;
 
-		/* Update current cluster */
-		node->cur_cluster = cl_num;
-		node->cur_pos = pos + r;
-
 		/* Read from cached cluster */
 		rlen = fatfs_node_read_cluster(node, cl_num, buf, cl_off, cl_len);
 
@@ -283,7 +349,7 @@ u32_t fatfs_node_read(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t * b
 		r += cl_len;
 		buf += cl_len;
 		cl_off -= cl_off;
-	} while(r < len && !fatfs_node_next_cluster(node, cl_num, &cl_num));
+	} while(r < len && !fatfs_node_map_cluster(node, cl_idx + 1, &cl_idx, &cl_num));
 
 	return r;
 }
@@ -293,7 +359,7 @@ u32_t fatfs_node_write(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t *
 	int rc;
 	u64_t woff, wlen;
 	u32_t w = 0, wstartcl;
-	u32_t cl_off, cl_num, cl_len;
+	u32_t cl_off, cl_idx, cl_num, cl_len;
 	struct fatfs_control_t *ctrl = node->ctrl;
 
 	if(!node->parent && ctrl->type != FAT_TYPE_32)
@@ -316,17 +382,18 @@ u32_t fatfs_node_write(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t *
 			return 0;
 
 		node->first_cluster = cl_num;
-		node->cur_cluster = node->first_cluster;
-		node->cur_pos = 0;
 
 		/* Mark node directory entry as dirty */
 		node->parent_dent_dirty = TRUE;
 	}
 
-	fatfs_node_fast_jump_cluster(node, pos, &wstartcl, &cl_num);
+	wstartcl = udiv32(pos, ctrl->bytes_per_cluster);
+	cl_idx = 0;
+	cl_num = node->first_cluster;
+	fatfs_node_map_cluster(node, wstartcl, &cl_idx, &cl_num);
 
 	/* Make room for new data by appending free clusters */
-	for(int i = 0; i < wstartcl; i++)
+	for(; cl_idx < wstartcl; cl_idx++)
 	{
 		rc = fatfs_node_auto_alloc_next_cluster(node, cl_num, &cl_num);
 		if(rc)
@@ -341,10 +408,6 @@ u32_t fatfs_node_write(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t *
 		cl_len = ctrl->bytes_per_cluster - cl_off;
 		cl_len = (len - w < cl_len) ? len - w : cl_len;
 
-		/* Update current cluster */
-		node->cur_cluster = cl_num;
-		node->cur_pos = pos + w;
-
 		/* Write next cluster */
 		wlen = fatfs_node_write_cluster(node, cl_num, buf, cl_off, cl_len);
 
@@ -368,7 +431,7 @@ u32_t fatfs_node_write(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t *
 int fatfs_node_truncate(struct fatfs_node_t * node, u32_t pos)
 {
 	int rc;
-	u32_t cl_pos, cl_num, t_pos;
+	u32_t cl_keep, cl_idx, cl_num, next;
 	struct fatfs_control_t * ctrl = node->ctrl;
 
 	if(!node->parent && ctrl->type != FAT_TYPE_32)
@@ -377,43 +440,46 @@ int fatfs_node_truncate(struct fatfs_node_t * node, u32_t pos)
 		return 0;
 	}
 
-	/* Determine last cluster after truncation */
-	t_pos = udiv32(pos + ctrl->bytes_per_cluster - 1, ctrl->bytes_per_cluster);
-	fatfs_node_fast_jump_cluster(node, t_pos + ctrl->bytes_per_cluster - 1, &cl_pos, &cl_num);
+	if(!fatfs_control_valid_cluster(ctrl, node->first_cluster))
+		return 0;
 
-	rc = fatfs_control_nth_cluster(ctrl, cl_num, cl_pos, &cl_num);
-	if(rc)
-		return rc;
+	/* Number of clusters still needed after truncation */
+	cl_keep = udiv32(pos + ctrl->bytes_per_cluster - 1, ctrl->bytes_per_cluster);
 
-	/* Remove all clusters after last cluster */
-	rc = fatfs_control_truncate_clusters(ctrl, cl_num);
+	/* Cached cluster may be freed below, flush it while still owned */
+	rc = fatfs_node_sync_cached_cluster(node);
 	if(rc)
 		return rc;
+	node->cached_clust = 0;
 
 	/* If we are removing first cluster then set it to zero
-	 * else set previous cluster as last cluster
+	 * else set last kept cluster as last cluster
 	 */
-	if(cl_pos == 0)
+	if(cl_keep == 0)
 	{
+		rc = fatfs_control_truncate_clusters(ctrl, node->first_cluster);
+		if(rc)
+			return rc;
 		node->first_cluster = 0;
 	}
 	else
 	{
-		/* if go here, t_pos >= node->first_cluster */
-		t_pos -= ctrl->bytes_per_cluster;
-		fatfs_node_fast_jump_cluster(node, t_pos, &cl_pos, &cl_num);
-		rc = fatfs_control_nth_cluster(ctrl, cl_num, cl_pos, &cl_num);
-		if(rc)
-			return rc;
-		rc = fatfs_control_set_last_cluster(ctrl, cl_num);
-		if(rc)
-			return rc;
+		if(fatfs_node_map_cluster(node, cl_keep - 1, &cl_idx, &cl_num))
+			return 0;
+		if(!fatfs_control_nth_cluster(ctrl, cl_num, 1, &next))
+		{
+			rc = fatfs_control_truncate_clusters(ctrl, next);
+			if(rc)
+				return rc;
+			rc = fatfs_control_set_last_cluster(ctrl, cl_num);
+			if(rc)
+				return rc;
+		}
 	}
 
 	/* Mark node directory entry as dirty */
 	node->parent_dent_dirty = TRUE;
-	node->cur_cluster = node->first_cluster;
-	node->cur_pos = 0;
+	fatfs_node_reset_runs(node);
 	return 0;
 }
 
@@ -441,8 +507,9 @@ int fatfs_node_init(struct fatfs_control_t * ctrl, struct fatfs_node_t * node)
 	memset(&node->parent_dent, 0, sizeof(struct fat_dirent_t));
 	node->parent_dent_dirty = FALSE;
 	node->first_cluster = 0;
-	node->cur_cluster = 0;
-	node->cur_pos = 0;
+	node->runs = NULL;
+	node->runs_size = 0;
+	fatfs_node_reset_runs(node);
 
 	node->cached_clust = 0;
 	node->cached_data = NULL;
@@ -461,6 +528,13 @@ int fatfs_node_exit(struct fatfs_node_t * node)
 		node->cached_data = NULL;
 		node->cached_dirty = FALSE;
 	}
+	if(node->runs)
+	{
+		free(node->runs);
+		node->runs = NULL;
+		node->runs_size = 0;
+	}
+	fatfs_node_reset_runs(node);
 
 	return 0;
 }
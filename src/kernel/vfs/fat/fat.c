@@ -68,8 +68,6 @@ static int fatfs_mount(struct vfs_mount_t * m, const char * dev)
 	{
 		root->first_cluster = 0x0;
 	}
-	root->cur_cluster = root->first_cluster;
-	root->cur_pos = 0;
 	root->parent_dent_dirty = FALSE;
 
 	/* Handcraft the root vfs node */
@@ -291,8 +289,6 @@ static int fatfs_lookup(struct vfs_node_t * dn, const char * name, struct vfs_no
 		node->first_cluster = 0;
 	}
 	node->first_cluster |= le16_to_cpu(dent.first_cluster_lo);
-	node->cur_cluster = node->first_cluster;
-	node->cur_pos = 0;
 
 	n->v_mode = 0;
 
@@ -383,6 +383,7 @@ static int ram_chmod(struct vfs_node_t * n, u32_t mode)
 
 static struct filesystem_t ram = {
 	.name		= "ram",
+	.flags		= FS_SHARED_READ,
 
 	.mount		= ram_mount,
 	.unmount	= ram_unmount,
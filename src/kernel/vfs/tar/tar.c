@@ -221,6 +221,7 @@ static int tar_vput(struct vfs_mount_t * m, struct vfs_node_t * n)
 
 static u64_t tar_read(struct vfs_node_t * n, s64_t off, void * buf, u64_t len)
 {
+	const void * p;
 	u64_t toff;
 	u64_t sz = 0;
 
@@ -235,11 +236,29 @@ static u64_t tar_read(struct vfs_node_t * n, s64_t off, void * buf, u64_t len)
 		sz = n->v_size - off;
 
 	toff = (u64_t)((unsigned long)(n->v_data));
-	sz = block_read(n->v_mount->m_dev, (u8_t *)buf, (toff + off), sz);
+	p = block_mmap(n->v_mount->m_dev, (toff + off), sz);
+	if(p)
+		memcpy(buf, p, sz);
+	else
+		sz = block_read(n->v_mount->m_dev, (u8_t *)buf, (toff + off), sz);
 
 	return sz;
 }
 
+static const void * tar_mmap(struct vfs_node_t * n, s64_t off, u64_t len)
+{
+	u64_t toff;
+
+	if(n->v_type != VNT_REG)
+		return NULL;
+
+	if((off < 0) || (off + len > n->v_size))
+		return NULL;
+
+	toff = (u64_t)((unsigned long)(n->v_data));
+	return block_mmap(n->v_mount->m_dev, (toff + off), len);
+}
+
 static u64_t tar_write(struct vfs_node_t * n, s64_t off, void * buf, u64_t len)
 {
 	return 0;
@@ -464,6 +483,7 @@ static int tar_chmod(struct vfs_node_t * n, u32_t mode)
 
 static struct filesystem_t tar = {
 	.name		= "tar",
+	.flags		= FS_SHARED_READ,
 
 	.mount		= tar_mount,
 	.unmount	= tar_unmount,
@@ -473,6 +493,7 @@ static struct filesystem_t tar = {
 
 	.read		= tar_read,
 	.write		= tar_write,
+	.mmap		= tar_mmap,
 	.truncate	= tar_truncate,
 	.sync		= tar_sync,
 	.readdir	= tar_readdir,
@@ -103,8 +103,11 @@ static struct list_head mnt_list;
 static struct mutex_t mnt_list_lock;
 static struct vfs_file_t fd_file[VFS_MAX_FD];
 static struct mutex_t fd_file_lock;
-struct list_head node_list[VFS_NODE_HASH_SIZE];
+static struct list_head node_list[VFS_NODE_HASH_SIZE];
 static struct mutex_t node_list_lock[VFS_NODE_HASH_SIZE];
+static struct list_head node_lru;
+static struct mutex_t node_lru_lock;
+static int node_lru_count;
 
 static int count_match(const char * path, char * mount_root)
 {
@@ -204,36 +207,47 @@ static struct vfs_file_t * vfs_fd_to_file(int fd)
 	return ((fd >= 0) && (fd < VFS_MAX_FD)) ? &fd_file[fd] : NULL;
 }
 
-static u32_t vfs_node_hash(struct vfs_mount_t * m, const char * path)
+static u32_t vfs_node_hash(struct vfs_node_t * parent, const char * name, int len)
 {
 	u32_t val = 0;
 
-	if(path)
-	{
-		while(*path)
-			val = ((val << 5) + val) + *path++;
-	}
-	return (val ^ (u32_t)((unsigned long)m)) & (VFS_NODE_HASH_SIZE - 1);
+	while(len-- > 0)
+		val = ((val << 5) + val) + *name++;
+	return val ^ (u32_t)((unsigned long)parent);
 }
 
-static struct vfs_node_t * vfs_node_get(struct vfs_mount_t * m, const char * path)
+/*
+ * Nodes are keyed by their parent and the name of the last path component.
+ * A node holds a reference to its parent, so a cached path keeps every
+ * directory above it alive.
+ */
+static struct vfs_node_t * vfs_node_get(struct vfs_mount_t * m, struct vfs_node_t * parent, const char * name, int len)
 {
 	struct vfs_node_t * n;
-	u32_t hash = vfs_node_hash(m, path);
-	int err;
+	int plen, err;
 
-	if(!(n = calloc(1, sizeof(struct vfs_node_t))))
+	plen = parent ? strlen(parent->v_path) : 0;
+	if(plen == 1)
+		plen = 0;
+	if(plen + 1 + len >= VFS_MAX_PATH)
+		return NULL;
+	if(!(n = calloc(1, sizeof(struct vfs_node_t) + plen + len + 2)))
 		return NULL;
 
 	init_list_head(&n->v_link);
+	init_list_head(&n->v_lru);
 	mutex_init(&n->v_lock);
 	n->v_mount = m;
+	n->v_parent = parent;
 	atomic_set(&n->v_refcnt, 1);
-	if(strlcpy(n->v_path, path, sizeof(n->v_path)) >= sizeof(n->v_path))
-	{
-		free(n);
-		return NULL;
-	}
+	atomic_set(&n->v_readers, 0);
+	n->v_hash = vfs_node_hash(parent, name, len);
+	if(plen > 0)
+		memcpy(n->v_path, parent->v_path, plen);
+	n->v_path[plen] = '/';
+	memcpy(&n->v_path[plen + 1], name, len);
+	n->v_path[plen + 1 + len] = '\0';
+	n->v_name = &n->v_path[plen + 1];
 
 	mutex_lock(&m->m_lock);
 	err = m->m_fs->vget(m, n);
@@ -245,60 +259,258 @@ static struct vfs_node_t * vfs_node_get(struct vfs_mount_t * m, const char * pat
 	}
 
 	atomic_add(&m->m_refcnt, 1);
-	mutex_lock(&node_list_lock[hash]);
-	list_add(&n->v_link, &node_list[hash]);
-	mutex_unlock(&node_list_lock[hash]);
+	if(parent)
+		atomic_add(&parent->v_refcnt, 1);
 
 	return n;
 }
 
-static struct vfs_node_t * vfs_node_lookup(struct vfs_mount_t * m, const char * path)
+static struct vfs_node_t * __vfs_node_find(struct vfs_node_t * parent, const char * name, int len, u32_t hash)
 {
 	struct vfs_node_t * n;
-	u32_t hash = vfs_node_hash(m, path);
+
+	list_for_each_entry(n, &node_list[hash & (VFS_NODE_HASH_SIZE - 1)], v_link)
+	{
+		if((n->v_hash == hash) && (n->v_parent == parent) && !strncmp(n->v_name, name, len) && (n->v_name[len] == '\0'))
+			return n;
+	}
+	return NULL;
+}
+
+static void __vfs_node_grab(struct vfs_node_t * n)
+{
+	if(atomic_add_return(&n->v_refcnt, 1) == 1)
+	{
+		mutex_lock(&node_lru_lock);
+		list_del_init(&n->v_lru);
+		node_lru_count--;
+		mutex_unlock(&node_lru_lock);
+	}
+}
+
+static struct vfs_node_t * vfs_node_lookup(struct vfs_node_t * parent, const char * name, int len)
+{
+	struct vfs_node_t * n;
+	u32_t hash = vfs_node_hash(parent, name, len);
+
+	mutex_lock(&node_list_lock[hash & (VFS_NODE_HASH_SIZE - 1)]);
+	n = __vfs_node_find(parent, name, len, hash);
+	if(n)
+		__vfs_node_grab(n);
+	mutex_unlock(&node_list_lock[hash & (VFS_NODE_HASH_SIZE - 1)]);
+
+	return n;
+}
+
+static void vfs_node_ref(struct vfs_node_t * n)
+{
+	atomic_add(&n->v_refcnt, 1);
+}
+
+/*
+ * Shared read side of the node lock, readers of filesystems which
+ * support concurrent reads only hold the mutex to register themselves
+ */
+static void vfs_node_read_lock(struct vfs_node_t * n)
+{
+	mutex_lock(&n->v_lock);
+	if(n->v_mount->m_fs->flags & FS_SHARED_READ)
+	{
+		atomic_add(&n->v_readers, 1);
+		mutex_unlock(&n->v_lock);
+	}
+}
+
+static void vfs_node_read_unlock(struct vfs_node_t * n)
+{
+	if(n->v_mount->m_fs->flags & FS_SHARED_READ)
+		atomic_sub(&n->v_readers, 1);
+	else
+		mutex_unlock(&n->v_lock);
+}
+
+/*
+ * Exclusive side, new readers are held off by the mutex while the
+ * active ones drain
+ */
+static void vfs_node_lock(struct vfs_node_t * n)
+{
+	mutex_lock(&n->v_lock);
+	while(atomic_get(&n->v_readers) > 0)
+		task_yield();
+}
+
+static void vfs_node_put(struct vfs_node_t * n);
+
+static void vfs_node_free(struct vfs_node_t * n)
+{
+	struct vfs_node_t * parent = n->v_parent;
+
+	if(n->v_flags != VNF_NEGATIVE)
+	{
+		mutex_lock(&n->v_mount->m_lock);
+		n->v_mount->m_fs->vput(n->v_mount, n);
+		mutex_unlock(&n->v_mount->m_lock);
+	}
+	atomic_sub(&n->v_mount->m_refcnt, 1);
+	free(n);
+	if(parent)
+		vfs_node_put(parent);
+}
+
+static int vfs_node_below(struct vfs_node_t * n, struct vfs_node_t * dn)
+{
+	while((n = n->v_parent))
+	{
+		if(n == dn)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Evict the least recently used unreferenced node, restricted to the mount m
+ * or the nodes below dn when they are given.
+ */
+static int vfs_node_evict(struct vfs_mount_t * m, struct vfs_node_t * dn)
+{
+	struct vfs_node_t * n, * pos;
+	u32_t hash;
 	int found = 0;
 
+	mutex_lock(&node_lru_lock);
+	list_for_each_entry(n, &node_lru, v_lru)
+	{
+		if((!m || (n->v_mount == m)) && (!dn || vfs_node_below(n, dn)))
+		{
+			found = 1;
+			break;
+		}
+	}
+	if(!found)
+	{
+		mutex_unlock(&node_lru_lock);
+		return 0;
+	}
+	hash = n->v_hash & (VFS_NODE_HASH_SIZE - 1);
+	mutex_unlock(&node_lru_lock);
+
+	found = 0;
 	mutex_lock(&node_list_lock[hash]);
-	list_for_each_entry(n, &node_list[hash], v_link)
+	mutex_lock(&node_lru_lock);
+	list_for_each_entry(pos, &node_lru, v_lru)
 	{
-		if((n->v_mount == m) && (!strncmp(n->v_path, path, VFS_MAX_PATH)))
+		if((pos == n) && ((n->v_hash & (VFS_NODE_HASH_SIZE - 1)) == hash))
 		{
+			list_del_init(&n->v_lru);
+			list_del_init(&n->v_link);
+			node_lru_count--;
 			found = 1;
 			break;
 		}
 	}
+	mutex_unlock(&node_lru_lock);
 	mutex_unlock(&node_list_lock[hash]);
 
-	if(!found)
-		return NULL;
-	atomic_add(&n->v_refcnt, 1);
-
-	return n;
+	if(found)
+		vfs_node_free(n);
+	return 1;
 }
 
-static void vfs_node_ref(struct vfs_node_t * n)
+static void vfs_node_prune(struct vfs_mount_t * m, struct vfs_node_t * dn)
 {
-	atomic_add(&n->v_refcnt, 1);
+	while(vfs_node_evict(m, dn));
 }
 
+/*
+ * Dropping the last reference keeps a hashed node on the lru list, so the next
+ * lookup of the same path, found or not, does not reach the filesystem.
+ */
 static void vfs_node_put(struct vfs_node_t * n)
 {
-	u32_t hash;
+	u32_t hash = n->v_hash & (VFS_NODE_HASH_SIZE - 1);
+	int cached = 0;
 
+	mutex_lock(&node_list_lock[hash]);
 	if(atomic_sub_return(&n->v_refcnt, 1))
+	{
+		mutex_unlock(&node_list_lock[hash]);
 		return;
-
-	hash = vfs_node_hash(n->v_mount, n->v_path);
-	mutex_lock(&node_list_lock[hash]);
-	list_del(&n->v_link);
+	}
+	if(!list_empty(&n->v_link))
+	{
+		if(n->v_mount->m_fs->flags & FS_NOCACHE)
+		{
+			list_del_init(&n->v_link);
+		}
+		else
+		{
+			mutex_lock(&node_lru_lock);
+			list_add_tail(&n->v_lru, &node_lru);
+			cached = ++node_lru_count;
+			mutex_unlock(&node_lru_lock);
+		}
+	}
 	mutex_unlock(&node_list_lock[hash]);
 
-	mutex_lock(&n->v_mount->m_lock);
-	n->v_mount->m_fs->vput(n->v_mount, n);
-	mutex_unlock(&n->v_mount->m_lock);
+	if(!cached)
+		vfs_node_free(n);
+	else if(cached > CONFIG_VFS_NODE_CACHE_SIZE)
+		vfs_node_evict(NULL, NULL);
+}
 
-	atomic_sub(&n->v_mount->m_refcnt, 1);
-	free(n);
+/*
+ * Publish a node after its lookup, a node hashed by a racing lookup of the
+ * same name wins and is returned instead.
+ */
+static struct vfs_node_t * vfs_node_insert(struct vfs_node_t * n)
+{
+	struct vfs_node_t * o;
+	u32_t hash = n->v_hash;
+
+	mutex_lock(&node_list_lock[hash & (VFS_NODE_HASH_SIZE - 1)]);
+	o = __vfs_node_find(n->v_parent, n->v_name, strlen(n->v_name), hash);
+	if(o)
+		__vfs_node_grab(o);
+	else
+		list_add(&n->v_link, &node_list[hash & (VFS_NODE_HASH_SIZE - 1)]);
+	mutex_unlock(&node_list_lock[hash & (VFS_NODE_HASH_SIZE - 1)]);
+
+	if(!o)
+		return n;
+	vfs_node_put(n);
+	return o;
+}
+
+/*
+ * Unhash the cached node for name in the directory dn after the filesystem
+ * changed it, a node still in use is freed on its last release.
+ */
+static void vfs_node_forget(struct vfs_node_t * dn, const char * name)
+{
+	struct vfs_node_t * n;
+	int len = strlen(name);
+	u32_t hash = vfs_node_hash(dn, name, len);
+	int unused = 0;
+
+	mutex_lock(&node_list_lock[hash & (VFS_NODE_HASH_SIZE - 1)]);
+	n = __vfs_node_find(dn, name, len, hash);
+	if(n)
+	{
+		list_del_init(&n->v_link);
+		if(!list_empty(&n->v_lru))
+		{
+			mutex_lock(&node_lru_lock);
+			list_del_init(&n->v_lru);
+			node_lru_count--;
+			mutex_unlock(&node_lru_lock);
+			unused = 1;
+		}
+	}
+	mutex_unlock(&node_list_lock[hash & (VFS_NODE_HASH_SIZE - 1)]);
+
+	if(unused)
+		vfs_node_free(n);
 }
 
 static int vfs_node_stat(struct vfs_node_t * n, struct vfs_stat_t * st)
@@ -380,53 +592,17 @@ static int vfs_node_access(struct vfs_node_t * n, u32_t mode)
 
 static void vfs_node_release(struct vfs_node_t * n)
 {
-	struct vfs_mount_t * m;
-	char path[VFS_MAX_PATH];
-	char * p;
-
-	if(!n)
-		return;
-
-	m = n->v_mount;
-
-	if(m->m_root == n)
-	{
-		vfs_node_put(n);
-		return;
-	}
-
-	if(strlcpy(path, n->v_path, sizeof(path)) >= sizeof(path))
-		return;
-
-	vfs_node_put(n);
-
-	while(1)
-	{
-		p = strrchr(path, '/');
-		if(!p)
-			break;
-		*p = '\0';
-
-		if(path[0] == '\0')
-			break;
-
-		n = vfs_node_lookup(m, path);
-		if(!n)
-			continue;
-
+	if(n)
 		vfs_node_put(n);
-		vfs_node_put(n);
-	}
-	vfs_node_put(m->m_root);
 }
 
 static int vfs_node_acquire(const char * path, struct vfs_node_t ** np)
 {
 	struct vfs_mount_t * m;
 	struct vfs_node_t * dn, * n;
-	char node[VFS_MAX_PATH];
+	const char * name;
 	char * p;
-	int err, i, j;
+	int err, len;
 
 	if(vfs_findroot(path, &m, &p))
 		return -1;
@@ -434,11 +610,10 @@ static int vfs_node_acquire(const char * path, struct vfs_node_t ** np)
 	if(!m->m_root)
 		return -1;
 
-	dn = n = m->m_root;
+	dn = m->m_root;
 	vfs_node_ref(dn);
 
-	i = 0;
-	while(*p != '\0')
+	while(1)
 	{
 		while(*p == '/')
 			p++;
@@ -446,41 +621,51 @@ static int vfs_node_acquire(const char * path, struct vfs_node_t ** np)
 		if(*p == '\0')
 			break;
 
-		node[i] = '/';
-		i++;
-		j = i;
+		name = p;
 		while(*p != '\0' && *p != '/')
-		{
-			node[i] = *p;
 			p++;
-			i++;
+		len = p - name;
+
+		if(dn->v_type != VNT_DIR)
+		{
+			vfs_node_put(dn);
+			return -1;
 		}
-		node[i] = '\0';
 
-		n = vfs_node_lookup(m, node);
+		n = vfs_node_lookup(dn, name, len);
 		if(n == NULL)
 		{
-			n = vfs_node_get(m, node);
+			n = vfs_node_get(m, dn, name, len);
 			if(n == NULL)
 			{
 				vfs_node_put(dn);
 				return -1;
 			}
 
-			mutex_lock(&n->v_lock);
-			mutex_lock(&dn->v_lock);
-			err = dn->v_mount->m_fs->lookup(dn, &node[j], n);
+			vfs_node_lock(n);
+			vfs_node_lock(dn);
+			err = dn->v_mount->m_fs->lookup(dn, n->v_name, n);
 			mutex_unlock(&dn->v_lock);
 			mutex_unlock(&n->v_lock);
-			if(err || (*p == '/' && n->v_type != VNT_DIR))
+			if(err)
 			{
-				vfs_node_release(n);
-				return err;
+				mutex_lock(&m->m_lock);
+				m->m_fs->vput(m, n);
+				mutex_unlock(&m->m_lock);
+				n->v_flags = VNF_NEGATIVE;
 			}
+			n = vfs_node_insert(n);
+		}
+		vfs_node_put(dn);
+
+		if(n->v_flags == VNF_NEGATIVE)
+		{
+			vfs_node_put(n);
+			return -1;
 		}
 		dn = n;
 	}
-	*np = n;
+	*np = dn;
 
 	return 0;
 }
@@ -540,14 +725,31 @@ void vfs_force_unmount(struct vfs_mount_t * m)
 			if(!found)
 				break;
 
-			list_del(&n->v_link);
-			mutex_lock(&n->v_mount->m_lock);
-			n->v_mount->m_fs->vput(n->v_mount, n);
-			mutex_unlock(&n->v_mount->m_lock);
+			list_del_init(&n->v_link);
+			if(!list_empty(&n->v_lru))
+			{
+				mutex_lock(&node_lru_lock);
+				list_del_init(&n->v_lru);
+				node_lru_count--;
+				mutex_unlock(&node_lru_lock);
+			}
+			if(n->v_flags != VNF_NEGATIVE)
+			{
+				mutex_lock(&n->v_mount->m_lock);
+				n->v_mount->m_fs->vput(n->v_mount, n);
+				mutex_unlock(&n->v_mount->m_lock);
+			}
 			free(n);
 		}
 		mutex_unlock(&node_list_lock[i]);
 	}
+	if(m->m_root)
+	{
+		mutex_lock(&m->m_lock);
+		m->m_fs->vput(m, m->m_root);
+		mutex_unlock(&m->m_lock);
+		free(m->m_root);
+	}
 
 	mutex_lock(&m->m_lock);
 	m->m_fs->unmount(m);
@@ -617,7 +819,7 @@ int vfs_mount(const char * dev, const char * dir, const char * fsname, u32_t fla
 	}
 	m->m_covered = n_covered;
 
-	if(!(n = vfs_node_get(m, "/")))
+	if(!(n = vfs_node_get(m, NULL, "", 0)))
 	{
 		if(m->m_covered)
 			vfs_node_release(m->m_covered);
@@ -687,6 +889,7 @@ int vfs_unmount(const char * path)
 		mutex_unlock(&mnt_list_lock);
 		return -1;
 	}
+	vfs_node_prune(m, NULL);
 	if(atomic_get(&m->m_refcnt) > 1)
 	{
 		mutex_unlock(&mnt_list_lock);
@@ -833,11 +1036,12 @@ int vfs_open(const char * path, u32_t flags, u32_t mode)
 			}
 			mode &= ~S_IFMT;
 			mode |= S_IFREG;
-			mutex_lock(&dn->v_lock);
+			vfs_node_lock(dn);
 			err = dn->v_mount->m_fs->create(dn, filename, mode);
 			if(!err)
 				err = dn->v_mount->m_fs->sync(dn);
 			mutex_unlock(&dn->v_lock);
+			vfs_node_forget(dn, filename);
 			vfs_node_release(dn);
 			if(err)
 				return err;
@@ -883,7 +1087,7 @@ int vfs_open(const char * path, u32_t flags, u32_t mode)
 			vfs_node_release(n);
 			return -1;
 		}
-		mutex_lock(&n->v_lock);
+		vfs_node_lock(n);
 		err = n->v_mount->m_fs->truncate(n, 0);
 		mutex_unlock(&n->v_lock);
 		if(err)
@@ -928,7 +1132,7 @@ int vfs_close(int fd)
 		return -1;
 	}
 
-	mutex_lock(&n->v_lock);
+	vfs_node_lock(n);
 	err = n->v_mount->m_fs->sync(n);
 	mutex_unlock(&n->v_lock);
 	if(err)
@@ -952,6 +1156,8 @@ u64_t vfs_read(int fd, void * buf, u64_t len)
 	if(!buf || !len)
 		return 0;
 
+	task_preempt();
+
 	f = vfs_fd_to_file(fd);
 	if(!f)
 		return 0;
@@ -975,9 +1181,9 @@ u64_t vfs_read(int fd, void * buf, u64_t len)
 		return 0;
 	}
 
-	mutex_lock(&n->v_lock);
+	vfs_node_read_lock(n);
 	ret = n->v_mount->m_fs->read(n, f->f_offset, buf, len);
-	mutex_unlock(&n->v_lock);
+	vfs_node_read_unlock(n);
 
 	f->f_offset += ret;
 	mutex_unlock(&f->f_lock);
@@ -994,6 +1200,8 @@ u64_t vfs_write(int fd, void * buf, u64_t len)
 	if(!buf || !len)
 		return 0;
 
+	task_preempt();
+
 	f = vfs_fd_to_file(fd);
 	if(!f)
 		return 0;
@@ -1017,7 +1225,7 @@ u64_t vfs_write(int fd, void * buf, u64_t len)
 		return 0;
 	}
 
-	mutex_lock(&n->v_lock);
+	vfs_node_lock(n);
 	ret = n->v_mount->m_fs->write(n, f->f_offset, buf, len);
 	mutex_unlock(&n->v_lock);
 
@@ -1027,6 +1235,145 @@ u64_t vfs_write(int fd, void * buf, u64_t len)
 	return ret;
 }
 
+/*
+ * Pin the node of an open file, the file lock is only held while
+ * checking the descriptor
+ */
+static struct vfs_node_t * vfs_fd_node(int fd, u32_t flags)
+{
+	struct vfs_node_t * n;
+	struct vfs_file_t * f;
+
+	f = vfs_fd_to_file(fd);
+	if(!f)
+		return NULL;
+
+	mutex_lock(&f->f_lock);
+	n = f->f_node;
+	if(!n || (n->v_type != VNT_REG) || !(f->f_flags & flags))
+	{
+		mutex_unlock(&f->f_lock);
+		return NULL;
+	}
+	vfs_node_ref(n);
+	mutex_unlock(&f->f_lock);
+
+	return n;
+}
+
+u64_t vfs_pread(int fd, void * buf, u64_t len, s64_t off)
+{
+	struct vfs_node_t * n;
+	u64_t ret;
+
+	if(!buf || !len || (off < 0))
+		return 0;
+
+	task_preempt();
+
+	n = vfs_fd_node(fd, O_RDONLY);
+	if(!n)
+		return 0;
+
+	vfs_node_read_lock(n);
+	ret = n->v_mount->m_fs->read(n, off, buf, len);
+	vfs_node_read_unlock(n);
+	vfs_node_put(n);
+
+	return ret;
+}
+
+u64_t vfs_pwrite(int fd, void * buf, u64_t len, s64_t off)
+{
+	struct vfs_node_t * n;
+	u64_t ret;
+
+	if(!buf || !len || (off < 0))
+		return 0;
+
+	task_preempt();
+
+	n = vfs_fd_node(fd, O_WRONLY);
+	if(!n)
+		return 0;
+
+	vfs_node_lock(n);
+	ret = n->v_mount->m_fs->write(n, off, buf, len);
+	mutex_unlock(&n->v_lock);
+	vfs_node_put(n);
+
+	return ret;
+}
+
+u64_t vfs_readv(int fd, struct vfs_iovec_t * iov, int iovcnt)
+{
+	struct vfs_node_t * n;
+	struct vfs_file_t * f;
+	u64_t ret = 0, len;
+	int i;
+
+	if(!iov || (iovcnt <= 0))
+		return 0;
+
+	task_preempt();
+
+	f = vfs_fd_to_file(fd);
+	if(!f)
+		return 0;
+
+	mutex_lock(&f->f_lock);
+	n = f->f_node;
+	if(!n || (n->v_type != VNT_REG) || !(f->f_flags & O_RDONLY))
+	{
+		mutex_unlock(&f->f_lock);
+		return 0;
+	}
+
+	vfs_node_read_lock(n);
+	for(i = 0; i < iovcnt; i++)
+	{
+		if(!iov[i].iov_base || !iov[i].iov_len)
+			continue;
+		len = n->v_mount->m_fs->read(n, f->f_offset + ret, iov[i].iov_base, iov[i].iov_len);
+		ret += len;
+		if(len < iov[i].iov_len)
+			break;
+	}
+	vfs_node_read_unlock(n);
+
+	f->f_offset += ret;
+	mutex_unlock(&f->f_lock);
+
+	return ret;
+}
+
+/*
+ * Read only view of the file contents, only for filesystems backed by
+ * addressable memory, the pointer stays valid until the file is closed
+ */
+const void * vfs_mmap(int fd, s64_t off, u64_t len)
+{
+	struct vfs_node_t * n;
+	const void * p = NULL;
+
+	if(!len || (off < 0))
+		return NULL;
+
+	n = vfs_fd_node(fd, O_RDONLY);
+	if(!n)
+		return NULL;
+
+	if(n->v_mount->m_fs->mmap)
+	{
+		vfs_node_read_lock(n);
+		p = n->v_mount->m_fs->mmap(n, off, len);
+		vfs_node_read_unlock(n);
+	}
+	vfs_node_put(n);
+
+	return p;
+}
+
 s64_t vfs_lseek(int fd, s64_t off, int whence)
 {
 	struct vfs_node_t * n;
@@ -1045,7 +1392,7 @@ s64_t vfs_lseek(int fd, s64_t off, int whence)
 		return 0;
 	}
 
-	mutex_lock(&n->v_lock);
+	vfs_node_read_lock(n);
 	switch(whence)
 	{
 	case VFS_SEEK_SET:
@@ -1074,7 +1421,7 @@ s64_t vfs_lseek(int fd, s64_t off, int whence)
 		break;
 
 	default:
-		mutex_unlock(&n->v_lock);
+		vfs_node_read_unlock(n);
 		ret = f->f_offset;
 		mutex_unlock(&f->f_lock);
 		return ret;
@@ -1082,7 +1429,7 @@ s64_t vfs_lseek(int fd, s64_t off, int whence)
 
 	if(off <= n->v_size)
 		f->f_offset = off;
-	mutex_unlock(&n->v_lock);
+	vfs_node_read_unlock(n);
 
 	ret = f->f_offset;
 	mutex_unlock(&f->f_lock);
@@ -1112,7 +1459,7 @@ int vfs_fsync(int fd)
 		mutex_unlock(&f->f_lock);
 		return -1;
 	}
-	mutex_lock(&n->v_lock);
+	vfs_node_lock(n);
 	err = n->v_mount->m_fs->sync(n);
 	mutex_unlock(&n->v_lock);
 	mutex_unlock(&f->f_lock);
@@ -1138,7 +1485,7 @@ int vfs_fchmod(int fd, u32_t mode)
 		return -1;
 	}
 	mode &= (S_IRWXU | S_IRWXG | S_IRWXO);
-	mutex_lock(&n->v_lock);
+	vfs_node_lock(n);
 	err = n->v_mount->m_fs->chmod(n, mode);
 	mutex_unlock(&n->v_lock);
 	mutex_unlock(&f->f_lock);
@@ -1243,6 +1590,8 @@ int vfs_readdir(int fd, struct vfs_dirent_t * dir)
 	if(!dir)
 		return -1;
 
+	task_preempt();
+
 	f = vfs_fd_to_file(fd);
 	if(!f)
 		return -1;
@@ -1259,7 +1608,7 @@ int vfs_readdir(int fd, struct vfs_dirent_t * dir)
 		mutex_unlock(&f->f_lock);
 		return -1;
 	}
-	mutex_lock(&n->v_lock);
+	vfs_node_lock(n);
 	err = n->v_mount->m_fs->readdir(n, f->f_offset, dir);
 	mutex_unlock(&n->v_lock);
 	if(!err)
@@ -1323,7 +1672,7 @@ int vfs_mkdir(const char * path, u32_t mode)
 	mode &= ~S_IFMT;
 	mode |= S_IFDIR;
 
-	mutex_lock(&dn->v_lock);
+	vfs_node_lock(dn);
 
 	err = dn->v_mount->m_fs->mkdir(dn, name, mode);
 	if(err)
@@ -1332,6 +1681,7 @@ int vfs_mkdir(const char * path, u32_t mode)
 
 fail:
 	mutex_unlock(&dn->v_lock);
+	vfs_node_forget(dn, name);
 	vfs_node_release(dn);
 
 	return err;
@@ -1379,6 +1729,7 @@ int vfs_rmdir(const char * path)
 	if((err = vfs_node_acquire(path, &n)))
 		return err;
 
+	vfs_node_prune(NULL, n);
 	if((n->v_flags == VNF_ROOT) || (atomic_get(&n->v_refcnt) >= 2))
 	{
 		vfs_node_release(n);
@@ -1397,8 +1748,8 @@ int vfs_rmdir(const char * path)
 		return err;
 	}
 
-	mutex_lock(&dn->v_lock);
-	mutex_lock(&n->v_lock);
+	vfs_node_lock(dn);
+	vfs_node_lock(n);
 
 	err = dn->v_mount->m_fs->rmdir(dn, n, name);
 	if(err)
@@ -1412,6 +1763,7 @@ int vfs_rmdir(const char * path)
 fail:
 	mutex_unlock(&n->v_lock);
 	mutex_unlock(&dn->v_lock);
+	vfs_node_forget(dn, name);
 	vfs_node_release(n);
 	vfs_node_release(dn);
 
@@ -1440,6 +1792,7 @@ int vfs_rename(const char * src, const char * dst)
 	if((err = vfs_node_access(n1, W_OK)))
 		goto fail1;
 
+	vfs_node_prune(NULL, n1);
 	if(atomic_get(&n1->v_refcnt) >= 2)
 	{
 		err = -1;
@@ -1466,11 +1819,11 @@ int vfs_rename(const char * src, const char * dst)
 		goto fail3;
 	}
 
-	mutex_lock(&n1->v_lock);
-	mutex_lock(&sn->v_lock);
+	vfs_node_lock(n1);
+	vfs_node_lock(sn);
 
 	if(dn != sn)
-		mutex_lock(&dn->v_lock);
+		vfs_node_lock(dn);
 
 	err = sn->v_mount->m_fs->rename(sn, sname, n1, dn, dname);
 	if(err)
@@ -1488,6 +1841,8 @@ fail4:
 		mutex_unlock(&dn->v_lock);
 	mutex_unlock(&sn->v_lock);
 	mutex_unlock(&n1->v_lock);
+	vfs_node_forget(sn, sname);
+	vfs_node_forget(dn, dname);
 fail3:
 	vfs_node_release(dn);
 fail2:
@@ -1534,7 +1889,7 @@ int vfs_unlink(const char * path)
 		return err;
 	}
 
-	mutex_lock(&n->v_lock);
+	vfs_node_lock(n);
 	err = n->v_mount->m_fs->truncate(n, 0);
 	if(err)
 		goto fail1;
@@ -1543,7 +1898,7 @@ int vfs_unlink(const char * path)
 	if(err)
 		goto fail1;
 
-	mutex_lock(&dn->v_lock);
+	vfs_node_lock(dn);
 	err = dn->v_mount->m_fs->remove(dn, n, name);
 	if(err)
 		goto fail2;
@@ -1551,6 +1906,7 @@ int vfs_unlink(const char * path)
 
 fail2:
 	mutex_unlock(&dn->v_lock);
+	vfs_node_forget(dn, name);
 fail1:
 	mutex_unlock(&n->v_lock);
 	vfs_node_release(dn);
@@ -1589,7 +1945,7 @@ int vfs_chmod(const char * path, u32_t mode)
 
 	mode &= (S_IRWXU | S_IRWXG | S_IRWXO);
 
-	mutex_lock(&n->v_lock);
+	vfs_node_lock(n);
 	err = n->v_mount->m_fs->chmod(n, mode);
 	if(err)
 		goto fail;
@@ -1634,6 +1990,9 @@ void do_init_vfs(void)
 	}
 	mutex_init(&fd_file_lock);
 
+	init_list_head(&node_lru);
+	mutex_init(&node_lru_lock);
+	node_lru_count = 0;
 	for(i = 0; i < VFS_NODE_HASH_SIZE; i++)
 	{
 		init_list_head(&node_list[i]);
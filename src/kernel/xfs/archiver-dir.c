@@ -223,6 +223,24 @@ static s64_t dir_write(void * f, void * buf, s64_t size)
 	return vfs_write(fh->fd, buf, size);
 }
 
+static s64_t dir_pread(void * f, void * buf, s64_t size, s64_t offset)
+{
+	struct fhandle_dir_t * fh = (struct fhandle_dir_t *)f;
+	return vfs_pread(fh->fd, buf, size, offset);
+}
+
+static s64_t dir_pwrite(void * f, void * buf, s64_t size, s64_t offset)
+{
+	struct fhandle_dir_t * fh = (struct fhandle_dir_t *)f;
+	return vfs_pwrite(fh->fd, buf, size, offset);
+}
+
+static const void * dir_mmap(void * f, s64_t offset, s64_t size)
+{
+	struct fhandle_dir_t * fh = (struct fhandle_dir_t *)f;
+	return vfs_mmap(fh->fd, offset, size);
+}
+
 static s64_t dir_seek(void * f, s64_t offset)
 {
 	struct fhandle_dir_t * fh = (struct fhandle_dir_t *)f;
@@ -267,6 +285,9 @@ static struct xfs_archiver_t archiver_dir = {
 	.open		= dir_open,
 	.read		= dir_read,
 	.write		= dir_write,
+	.pread		= dir_pread,
+	.pwrite		= dir_pwrite,
+	.mmap		= dir_mmap,
 	.seek		= dir_seek,
 	.tell		= dir_tell,
 	.length		= dir_length,
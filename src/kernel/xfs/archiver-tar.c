@@ -372,12 +372,29 @@ static s64_t tar_read(void * f, void * buf, s64_t size)
 	s64_t len;
 	if(size > fh->size - fh->offset)
 		size = fh->size - fh->offset;
-	vfs_lseek(fh->fd, fh->start + fh->offset, VFS_SEEK_SET);
-	len = vfs_read(fh->fd, buf, size);
+	len = vfs_pread(fh->fd, buf, size, fh->start + fh->offset);
 	fh->offset += len;
 	return len;
 }
 
+static s64_t tar_pread(void * f, void * buf, s64_t size, s64_t offset)
+{
+	struct fhandle_tar_t * fh = (struct fhandle_tar_t *)f;
+	if((offset < 0) || (offset >= fh->size))
+		return 0;
+	if(size > fh->size - offset)
+		size = fh->size - offset;
+	return vfs_pread(fh->fd, buf, size, fh->start + offset);
+}
+
+static const void * tar_mmap(void * f, s64_t offset, s64_t size)
+{
+	struct fhandle_tar_t * fh = (struct fhandle_tar_t *)f;
+	if((offset < 0) || (size <= 0) || (offset + size > fh->size))
+		return NULL;
+	return vfs_mmap(fh->fd, fh->start + offset, size);
+}
+
 static s64_t tar_write(void * f, void * buf, s64_t size)
 {
 	return 0;
@@ -392,7 +409,6 @@ static s64_t tar_seek(void * f, s64_t offset)
 		fh->offset = fh->size;
 	else
 		fh->offset = offset;
-	vfs_lseek(fh->fd, fh->start + fh->offset, VFS_SEEK_SET);
 	return fh->offset;
 }
 
@@ -426,6 +442,8 @@ static struct xfs_archiver_t archiver_tar = {
 	.open		= tar_open,
 	.read		= tar_read,
 	.write		= tar_write,
+	.pread		= tar_pread,
+	.mmap		= tar_mmap,
 	.seek		= tar_seek,
 	.tell		= tar_tell,
 	.length		= tar_length,
@@ -322,6 +322,41 @@ s64_t xfs_write(struct xfs_file_t * file, void * buf, s64_t size)
 	return 0;
 }
 
+s64_t xfs_pread(struct xfs_file_t * file, void * buf, s64_t size, s64_t offset)
+{
+	if(file)
+	{
+		if(file->path->archiver->pread)
+			return file->path->archiver->pread(file->fhandle, buf, size, offset);
+		if(file->path->archiver->seek(file->fhandle, offset) == offset)
+			return file->path->archiver->read(file->fhandle, buf, size);
+	}
+	return 0;
+}
+
+s64_t xfs_pwrite(struct xfs_file_t * file, void * buf, s64_t size, s64_t offset)
+{
+	if(file && file->path->writable)
+	{
+		if(file->path->archiver->pwrite)
+			return file->path->archiver->pwrite(file->fhandle, buf, size, offset);
+		if(file->path->archiver->seek(file->fhandle, offset) == offset)
+			return file->path->archiver->write(file->fhandle, buf, size);
+	}
+	return 0;
+}
+
+/*
+ * Direct read only pointer into the backing store, or NULL if the archiver
+ * can't provide one, valid until the file is closed
+ */
+const void * xfs_mmap(struct xfs_file_t * file, s64_t offset, s64_t size)
+{
+	if(file && file->path->archiver->mmap)
+		return file->path->archiver->mmap(file->fhandle, offset, size);
+	return NULL;
+}
+
 s64_t xfs_seek(struct xfs_file_t * file, s64_t offset)
 {
 	if(file)
@@ -3,16 +3,83 @@
  */
 
 #include <xconfigs.h>
+#include <stdint.h>
 #include <assert.h>
 #include <spinlock.h>
+#include <atomic.h>
+#include <smp.h>
 #include <string.h>
 #include <stdio.h>
+#include <list.h>
 #include <malloc.h>
 #include <xboot/kobj.h>
 #include <xboot/module.h>
 
-static void * __heap_pool = NULL;
-static spinlock_t __heap_lock = SPIN_LOCK_INIT();
+/*
+ * Slab layer for small objects
+ */
+#define SLAB_SIZE				(16384)
+#define SLAB_HEADER_SIZE		(64)
+#define SLAB_OBJECT_MAX			(512)
+#define SLAB_CLASS_COUNT		(16)
+#define SLAB_MAGAZINE_SIZE		(32)
+
+/*
+ * Heap layout. With more than one cpu, a small slice of memory is split
+ * into per-cpu heaps and the rest stays in one shared global heap, so the
+ * largest allocation is not limited to a single cpu slice.
+ */
+#if (CONFIG_MAX_SMP_CPUS > 1)
+#define HEAP_COUNT				(CONFIG_MAX_SMP_CPUS + 1)
+#else
+#define HEAP_COUNT				(1)
+#endif
+#define HEAP_PERCPU_SHIFT		(3)
+#define HEAP_LOCAL_MAX			(65536)
+
+struct slab_t {
+	struct list_head list;
+	struct heap_t * heap;
+	void * free;
+	int sclass;
+	int inuse;
+	int total;
+};
+
+struct slab_cache_t {
+	struct list_head partial;
+	int nslab;
+	int nempty;
+	int inuse;
+};
+
+struct magazine_t {
+	void * objs[SLAB_MAGAZINE_SIZE];
+	int count;
+	uint64_t hit;
+	uint64_t miss;
+};
+
+struct heap_t {
+	void * pool;
+	void * start;
+	void * end;
+	spinlock_t lock;
+	atomic_t rfree;
+	atomic_t nrfree;
+	struct slab_cache_t slab[SLAB_CLASS_COUNT];
+};
+
+static const int slab_class_size[SLAB_CLASS_COUNT] = {
+	16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512,
+};
+static unsigned char slab_size_to_class[(SLAB_OBJECT_MAX >> 4) + 1];
+
+static struct heap_t __heap[HEAP_COUNT];
+static struct magazine_t __magazine[CONFIG_MAX_SMP_CPUS][SLAB_CLASS_COUNT];
+static unsigned char * __slab_map = NULL;
+static char * __slab_base = NULL;
+static size_t __slab_count = 0;
 
 /*
  * Some macros.
@@ -816,35 +883,317 @@ void mm_info(void * mm, size_t * mused, size_t * mfree)
 		tlsf_info(mm, mused, mfree);
 }
 
-void * malloc(size_t size)
+/*
+ * Per-cpu heaps. Each cpu owns one small tlsf pool for local allocations,
+ * large requests and overflow go to the shared global heap. Frees from
+ * other cpus are pushed onto the owner's lock-free return list and drained
+ * under the heap lock. The list head keeps an offset in units of ALIGN_SIZE
+ * plus one, so the existing atomic_t helpers can be used on every architecture.
+ */
+static inline struct heap_t * heap_self(void)
+{
+	return &__heap[smp_processor_id()];
+}
+
+static inline struct heap_t * heap_global(void)
+{
+	return &__heap[HEAP_COUNT - 1];
+}
+
+static inline struct heap_t * heap_of(void * ptr)
+{
+	struct heap_t * h;
+	int i;
+
+	for(i = 0; i < HEAP_COUNT; i++)
+	{
+		h = &__heap[i];
+		if((ptr >= h->start) && (ptr < h->end))
+			return h;
+	}
+	return NULL;
+}
+
+static inline void heap_remote_free(struct heap_t * h, void * ptr)
+{
+	int * next = (int *)ptr;
+	int o, n;
+
+	n = (int)(((char *)ptr - (char *)h->start) >> ALIGN_SIZE_LOG2) + 1;
+	do {
+		o = atomic_get(&h->rfree);
+		*next = o;
+		smp_wmb();
+	} while(atomic_cmpxchg(&h->rfree, o, n) != o);
+	atomic_inc(&h->nrfree);
+}
+
+static inline void heap_drain(struct heap_t * h)
+{
+	void * ptr;
+	int o;
+
+	if(atomic_get(&h->rfree) == 0)
+		return;
+	do {
+		o = atomic_get(&h->rfree);
+	} while(atomic_cmpxchg(&h->rfree, o, 0) != o);
+	while(o)
+	{
+		ptr = (char *)h->start + ((size_t)(o - 1) << ALIGN_SIZE_LOG2);
+		o = *((int *)ptr);
+		tlsf_free(h->pool, ptr);
+		atomic_dec(&h->nrfree);
+	}
+}
+
+static void * heap_alloc(struct heap_t * h, size_t align, size_t size)
 {
 	void * m;
 
-	spin_lock(&__heap_lock);
-	m = tlsf_malloc(__heap_pool, size);
-	spin_unlock(&__heap_lock);
+	spin_lock(&h->lock);
+	heap_drain(h);
+	m = align ? tlsf_memalign(h->pool, align, size) : tlsf_malloc(h->pool, size);
+	spin_unlock(&h->lock);
 	return m;
 }
-EXPORT_SYMBOL(malloc);
 
-void * memalign(size_t align, size_t size)
+static void * heap_alloc_any(size_t align, size_t size)
 {
-	void * m;
+	struct heap_t * self = heap_self();
+	struct heap_t * g = heap_global();
+	void * m = NULL;
+	int i;
 
-	spin_lock(&__heap_lock);
-	m = tlsf_memalign(__heap_pool, align, size);
-	spin_unlock(&__heap_lock);
+	if((size <= HEAP_LOCAL_MAX) || (self == g))
+		m = heap_alloc(self, align, size);
+	if(!m && (self != g))
+		m = heap_alloc(g, align, size);
+	for(i = 0; !m && (i < HEAP_COUNT - 1); i++)
+	{
+		if(&__heap[i] != self)
+			m = heap_alloc(&__heap[i], align, size);
+	}
+	if(!m && (size > HEAP_LOCAL_MAX) && (self != g))
+		m = heap_alloc(self, align, size);
 	return m;
 }
+
+static inline struct slab_t * slab_lookup(void * ptr)
+{
+	size_t idx;
+
+	if((char *)ptr < __slab_base)
+		return NULL;
+	idx = ((char *)ptr - __slab_base) / SLAB_SIZE;
+	if((idx >= __slab_count) || !__slab_map[idx])
+		return NULL;
+	return (struct slab_t *)(__slab_base + idx * SLAB_SIZE);
+}
+
+static struct slab_t * slab_new(struct heap_t * h, int c)
+{
+	struct slab_t * s;
+	char * obj;
+	int size = slab_class_size[c];
+	int i;
+
+	if(!__slab_map)
+		return NULL;
+	s = tlsf_memalign(h->pool, SLAB_SIZE, SLAB_SIZE);
+	if(!s)
+		return NULL;
+	s->heap = h;
+	s->free = NULL;
+	s->sclass = c;
+	s->inuse = 0;
+	s->total = (SLAB_SIZE - SLAB_HEADER_SIZE) / size;
+	obj = (char *)s + SLAB_HEADER_SIZE + (s->total - 1) * size;
+	for(i = 0; i < s->total; i++, obj -= size)
+	{
+		*((void **)obj) = s->free;
+		s->free = obj;
+	}
+	__slab_map[((char *)s - __slab_base) / SLAB_SIZE] = c + 1;
+	list_add(&s->list, &h->slab[c].partial);
+	h->slab[c].nslab++;
+	h->slab[c].nempty++;
+	return s;
+}
+
+static void slab_put(void * obj)
+{
+	struct slab_t * s = slab_lookup(obj);
+	struct heap_t * h = s->heap;
+	struct slab_cache_t * sc = &h->slab[s->sclass];
+
+	spin_lock(&h->lock);
+	if(!s->free)
+		list_add_tail(&s->list, &sc->partial);
+	*((void **)obj) = s->free;
+	s->free = obj;
+	s->inuse--;
+	sc->inuse--;
+	if(s->inuse == 0)
+	{
+		if(sc->nempty > 0)
+		{
+			list_del(&s->list);
+			__slab_map[((char *)s - __slab_base) / SLAB_SIZE] = 0;
+			sc->nslab--;
+			tlsf_free(h->pool, s);
+		}
+		else
+		{
+			sc->nempty++;
+		}
+	}
+	spin_unlock(&h->lock);
+}
+
+static void slab_refill(struct heap_t * h, struct magazine_t * m, int c)
+{
+	struct slab_cache_t * sc = &h->slab[c];
+	struct slab_t * s;
+
+	spin_lock(&h->lock);
+	heap_drain(h);
+	while(m->count < SLAB_MAGAZINE_SIZE / 2)
+	{
+		if(list_empty(&sc->partial))
+		{
+			if(!slab_new(h, c))
+				break;
+		}
+		s = list_first_entry(&sc->partial, struct slab_t, list);
+		if(s->inuse == 0)
+			sc->nempty--;
+		while(s->free && (m->count < SLAB_MAGAZINE_SIZE / 2))
+		{
+			m->objs[m->count++] = s->free;
+			s->free = *((void **)s->free);
+			s->inuse++;
+			sc->inuse++;
+		}
+		if(!s->free)
+			list_del_init(&s->list);
+	}
+	spin_unlock(&h->lock);
+}
+
+static void slab_flush(struct magazine_t * m)
+{
+	while(m->count > SLAB_MAGAZINE_SIZE / 2)
+		slab_put(m->objs[--m->count]);
+}
+
+/*
+ * The magazines are per-cpu but not locked, local interrupts stay disabled
+ * while one is touched so an allocation from irq context can not interleave
+ * with it. Task switches only happen at task_preempt() points, never here.
+ */
+static inline void * slab_malloc(size_t size)
+{
+	int c = slab_size_to_class[(size + 15) >> 4];
+	struct magazine_t * m;
+	irq_flags_t flags;
+	void * obj = NULL;
+	int cpu;
+
+	local_irq_save(flags);
+	cpu = smp_processor_id();
+	m = &__magazine[cpu][c];
+	if(m->count > 0)
+	{
+		m->hit++;
+		obj = m->objs[--m->count];
+	}
+	else
+	{
+		m->miss++;
+		slab_refill(&__heap[cpu], m, c);
+		if(m->count > 0)
+			obj = m->objs[--m->count];
+	}
+	local_irq_restore(flags);
+	return obj;
+}
+
+static inline void slab_free(struct slab_t * s, void * ptr)
+{
+	struct magazine_t * m;
+	irq_flags_t flags;
+
+	local_irq_save(flags);
+	m = &__magazine[smp_processor_id()][s->sclass];
+	if(m->count >= SLAB_MAGAZINE_SIZE)
+		slab_flush(m);
+	m->objs[m->count++] = ptr;
+	local_irq_restore(flags);
+}
+
+void * malloc(size_t size)
+{
+	void * m;
+
+	if((size > 0) && (size <= SLAB_OBJECT_MAX) && (m = slab_malloc(size)))
+		return m;
+	return heap_alloc_any(0, size);
+}
+EXPORT_SYMBOL(malloc);
+
+void * memalign(size_t align, size_t size)
+{
+	return heap_alloc_any(align, size);
+}
 EXPORT_SYMBOL(memalign);
 
 void * realloc(void * ptr, size_t size)
 {
+	struct heap_t * self = heap_self();
+	struct heap_t * h;
+	struct slab_t * s;
 	void * m;
 
-	spin_lock(&__heap_lock);
-	m = tlsf_realloc(__heap_pool, ptr, size);
-	spin_unlock(&__heap_lock);
+	if(!ptr)
+		return malloc(size);
+	if((s = slab_lookup(ptr)))
+	{
+		if(size == 0)
+		{
+			slab_free(s, ptr);
+			return NULL;
+		}
+		if(size <= slab_class_size[s->sclass])
+			return ptr;
+		if((m = malloc(size)))
+		{
+			memcpy(m, ptr, slab_class_size[s->sclass]);
+			slab_free(s, ptr);
+		}
+		return m;
+	}
+	h = heap_of(ptr);
+	if(!h)
+		return NULL;
+	if((h == self) || (h == heap_global()))
+	{
+		spin_lock(&h->lock);
+		m = tlsf_realloc(h->pool, ptr, size);
+		spin_unlock(&h->lock);
+		if(m || (size == 0))
+			return m;
+	}
+	else if(size == 0)
+	{
+		heap_remote_free(h, ptr);
+		return NULL;
+	}
+	if((m = malloc(size)))
+	{
+		memcpy(m, ptr, tlsf_min(block_get_size(block_from_ptr(ptr)), size));
+		free(ptr);
+	}
 	return m;
 }
 EXPORT_SYMBOL(realloc);
@@ -861,9 +1210,29 @@ EXPORT_SYMBOL(calloc);
 
 void free(void * ptr)
 {
-	spin_lock(&__heap_lock);
-	tlsf_free(__heap_pool, ptr);
-	spin_unlock(&__heap_lock);
+	struct heap_t * self = heap_self();
+	struct heap_t * h;
+	struct slab_t * s;
+
+	if(!ptr)
+		return;
+	if((s = slab_lookup(ptr)))
+	{
+		slab_free(s, ptr);
+	}
+	else if((h = heap_of(ptr)))
+	{
+		if((h == self) || (h == heap_global()))
+		{
+			spin_lock(&h->lock);
+			tlsf_free(h->pool, ptr);
+			spin_unlock(&h->lock);
+		}
+		else
+		{
+			heap_remote_free(h, ptr);
+		}
+	}
 }
 EXPORT_SYMBOL(free);
 
@@ -875,21 +1244,74 @@ static struct kobj_t * search_class_memory_kobj(void)
 
 static ssize_t memory_read_meminfo(struct kobj_t * kobj, void * buf, size_t size)
 {
-	void * mm = (void *)kobj->priv;
-	size_t mused, mfree;
+	struct heap_t * h;
+	size_t mused[HEAP_COUNT], mfree[HEAP_COUNT];
+	size_t tused = 0, tfree = 0;
 	char * p = buf;
 	int len = 0;
+	int i;
 
-	mm_info(mm, &mused, &mfree);
-	len += sprintf((char *)(p + len), " memory used: %ld\r\n", mused);
-	len += sprintf((char *)(p + len), " memory free: %ld\r\n", mfree);
+	for(i = 0; i < HEAP_COUNT; i++)
+	{
+		h = &__heap[i];
+		spin_lock(&h->lock);
+		mm_info(mm_get(h->pool), &mused[i], &mfree[i]);
+		spin_unlock(&h->lock);
+		tused += mused[i];
+		tfree += mfree[i];
+	}
+	len += sprintf((char *)(p + len), " memory used: %ld\r\n", tused);
+	len += sprintf((char *)(p + len), " memory free: %ld\r\n", tfree);
+	for(i = 0; i < HEAP_COUNT; i++)
+	{
+		h = &__heap[i];
+		len += sprintf((char *)(p + len), " heap%d used: %ld\r\n", i, mused[i]);
+		len += sprintf((char *)(p + len), " heap%d free: %ld\r\n", i, mfree[i]);
+		len += sprintf((char *)(p + len), " heap%d remote: %d\r\n", i, atomic_get(&h->nrfree));
+	}
+	return len;
+}
+
+static ssize_t memory_read_slabinfo(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct slab_cache_t * sc;
+	struct magazine_t * m;
+	uint64_t hit, miss;
+	int nslab, inuse, cached;
+	long waste;
+	char * p = buf;
+	int len = 0;
+	int c, i;
+
+	for(c = 0; c < SLAB_CLASS_COUNT; c++)
+	{
+		hit = miss = 0;
+		nslab = inuse = cached = 0;
+		for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+		{
+			sc = &__heap[i].slab[c];
+			spin_lock(&__heap[i].lock);
+			nslab += sc->nslab;
+			inuse += sc->inuse;
+			spin_unlock(&__heap[i].lock);
+			m = &__magazine[i][c];
+			hit += m->hit;
+			miss += m->miss;
+			cached += m->count;
+		}
+		waste = (long)nslab * SLAB_SIZE - (long)(inuse - cached) * slab_class_size[c];
+		len += sprintf((char *)(p + len), " slab%-4d slabs: %-6d objs: %-8d cached: %-4d hit: %-10lld miss: %-8lld waste: %ld\r\n",
+			slab_class_size[c], nslab, inuse - cached, cached, (long long)hit, (long long)miss, waste);
+	}
 	return len;
 }
 
 void do_init_mem(void)
 {
+	struct heap_t * h;
 	void * heap;
-	size_t size;
+	size_t size, len;
+	int i, c;
 
 #ifdef __SANDBOX__
 	static char __heap_buf[CONFIG_HEAP_MEMORY_SIZE];
@@ -902,7 +1324,39 @@ void do_init_mem(void)
 	size = (size_t)(&__heap_end - &__heap_start);
 #endif
 
-	spin_lock_init(&__heap_lock);
-	__heap_pool = mm_create(heap, size);
-	kobj_add_regular(search_class_memory_kobj(), "meminfo", memory_read_meminfo, NULL, mm_get(__heap_pool));
+	len = (HEAP_COUNT > 1) ? align_down((size >> HEAP_PERCPU_SHIFT) / (HEAP_COUNT - 1), ALIGN_SIZE) : 0;
+	for(i = 0; i < HEAP_COUNT; i++)
+	{
+		h = &__heap[i];
+		h->start = (char *)heap + len * i;
+		h->end = (i == HEAP_COUNT - 1) ? (char *)heap + size : (char *)h->start + len;
+		spin_lock_init(&h->lock);
+		atomic_set(&h->rfree, 0);
+		atomic_set(&h->nrfree, 0);
+		h->pool = mm_create(h->start, (char *)h->end - (char *)h->start);
+		for(c = 0; c < SLAB_CLASS_COUNT; c++)
+		{
+			init_list_head(&h->slab[c].partial);
+			h->slab[c].nslab = 0;
+			h->slab[c].nempty = 0;
+			h->slab[c].inuse = 0;
+		}
+	}
+
+	for(i = 0, c = 0; i <= (SLAB_OBJECT_MAX >> 4); i++)
+	{
+		while(slab_class_size[c] < (i << 4))
+			c++;
+		slab_size_to_class[i] = c;
+	}
+	__slab_base = (char *)align_down((size_t)heap, SLAB_SIZE);
+	__slab_count = ((char *)heap + size - __slab_base + SLAB_SIZE - 1) / SLAB_SIZE;
+	__slab_map = mm_malloc(heap_global()->pool, __slab_count);
+	if(__slab_map)
+		memset(__slab_map, 0, __slab_count);
+	else
+		__slab_count = 0;
+
+	kobj_add_regular(search_class_memory_kobj(), "meminfo", memory_read_meminfo, NULL, NULL);
+	kobj_add_regular(search_class_memory_kobj(), "slabinfo", memory_read_slabinfo, NULL, NULL);
 }
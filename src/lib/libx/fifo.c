@@ -4,6 +4,8 @@
 
 #include <stddef.h>
 #include <barrier.h>
+#include <atomic.h>
+#include <irqflags.h>
 #include <spinlock.h>
 #include <log2.h>
 #include <string.h>
@@ -51,14 +53,113 @@ unsigned int __fifo_get(struct fifo_t * f, unsigned char * buf, unsigned int len
 	return len;
 }
 
-struct fifo_t * fifo_alloc(unsigned int size)
+static inline unsigned int fifo_index_load(unsigned int * idx)
+{
+	return *((volatile unsigned int *)idx);
+}
+
+static inline void fifo_index_store(unsigned int * idx, unsigned int v)
+{
+	*((volatile unsigned int *)idx) = v;
+}
+
+static inline void fifo_ring_copy_in(struct fifo_t * f, unsigned int in, unsigned char * buf, unsigned int len)
+{
+	unsigned int l;
+
+	l = min(len, f->size - (in & (f->size - 1)));
+	memcpy(f->buffer + (in & (f->size - 1)), buf, l);
+	memcpy(f->buffer, buf + l, len - l);
+}
+
+static inline void fifo_ring_copy_out(struct fifo_t * f, unsigned int out, unsigned char * buf, unsigned int len)
+{
+	unsigned int l;
+
+	l = min(len, f->size - (out & (f->size - 1)));
+	memcpy(buf, f->buffer + (out & (f->size - 1)), l);
+	memcpy(buf + l, f->buffer, len - l);
+}
+
+/*
+ * Single producer, the consumer is only ever observed through out
+ */
+static unsigned int fifo_spsc_put(struct fifo_t * f, unsigned char * buf, unsigned int len)
+{
+	unsigned int in = f->in;
+	unsigned int out = fifo_index_load(&f->out);
+
+	smp_mb();
+	len = min(len, f->size - in + out);
+	if(len > 0)
+	{
+		fifo_ring_copy_in(f, in, buf, len);
+		smp_wmb();
+		fifo_index_store(&f->in, in + len);
+	}
+	return len;
+}
+
+/*
+ * Producers claim a slice by advancing head, fill it, and then wait for
+ * every earlier claim to be published before advancing in. Interrupts stay
+ * off between claim and publish so that an interrupt handler producing on
+ * the same cpu can never spin on a slice its own cpu is holding.
+ */
+static unsigned int fifo_mpsc_put(struct fifo_t * f, unsigned char * buf, unsigned int len)
+{
+	irq_flags_t flags;
+	unsigned int head, out, l;
+
+	local_irq_save(flags);
+	do {
+		head = (unsigned int)atomic_get(&f->head);
+		out = fifo_index_load(&f->out);
+		smp_mb();
+		l = min(len, f->size - head + out);
+		if(l == 0)
+		{
+			local_irq_restore(flags);
+			return 0;
+		}
+	} while(atomic_cmpxchg(&f->head, (int)head, (int)(head + l)) != (int)head);
+	fifo_ring_copy_in(f, head, buf, l);
+	smp_wmb();
+	while(fifo_index_load(&f->in) != head);
+	fifo_index_store(&f->in, head + l);
+	local_irq_restore(flags);
+
+	return l;
+}
+
+/*
+ * Single consumer for both lock free modes, mpsc readers are serialized by
+ * fifo_get so that a fifo with several readers stays consistent
+ */
+static unsigned int fifo_sc_get(struct fifo_t * f, unsigned char * buf, unsigned int len)
+{
+	unsigned int out = f->out;
+	unsigned int in = fifo_index_load(&f->in);
+
+	smp_rmb();
+	len = min(len, in - out);
+	if(len > 0)
+	{
+		fifo_ring_copy_out(f, out, buf, len);
+		smp_mb();
+		fifo_index_store(&f->out, out + len);
+	}
+	return len;
+}
+
+struct fifo_t * fifo_alloc_mode(unsigned int size, enum fifo_mode_t mode)
 {
 	struct fifo_t * f;
 
 	if(size & (size - 1))
 		size = roundup_pow_of_two(size);
 
-	f = malloc(sizeof(struct fifo_t));
+	f = memalign(FIFO_CACHE_LINE_SIZE, sizeof(struct fifo_t));
 	if(!f)
 		return NULL;
 
@@ -69,12 +170,20 @@ struct fifo_t * fifo_alloc(unsigned int size)
 		return NULL;
 	}
 	f->size = size;
+	f->mode = mode;
 	f->in = 0;
 	f->out = 0;
+	atomic_set(&f->head, 0);
 	spin_lock_init(&f->lock);
 
 	return f;
 }
+EXPORT_SYMBOL(fifo_alloc_mode);
+
+struct fifo_t * fifo_alloc(unsigned int size)
+{
+	return fifo_alloc_mode(size, FIFO_MODE_LOCKED);
+}
 EXPORT_SYMBOL(fifo_alloc);
 
 void fifo_free(struct fifo_t * f)
@@ -93,6 +202,7 @@ void fifo_reset(struct fifo_t * f)
 
 	spin_lock_irqsave(&f->lock, flags);
 	__fifo_reset(f);
+	atomic_set(&f->head, 0);
 	spin_unlock_irqrestore(&f->lock, flags);
 }
 EXPORT_SYMBOL(fifo_reset);
@@ -102,6 +212,12 @@ unsigned int fifo_len(struct fifo_t * f)
 	irq_flags_t flags;
 	unsigned int ret;
 
+	if(f->mode != FIFO_MODE_LOCKED)
+	{
+		ret = fifo_index_load(&f->in) - fifo_index_load(&f->out);
+		smp_rmb();
+		return ret;
+	}
 	spin_lock_irqsave(&f->lock, flags);
 	ret = __fifo_len(f);
 	spin_unlock_irqrestore(&f->lock, flags);
@@ -115,6 +231,10 @@ unsigned int fifo_put(struct fifo_t * f, unsigned char * buf, unsigned int len)
 	irq_flags_t flags;
 	unsigned int ret;
 
+	if(f->mode == FIFO_MODE_SPSC)
+		return fifo_spsc_put(f, buf, len);
+	else if(f->mode == FIFO_MODE_MPSC)
+		return fifo_mpsc_put(f, buf, len);
 	spin_lock_irqsave(&f->lock, flags);
 	ret = __fifo_put(f, buf, len);
 	spin_unlock_irqrestore(&f->lock, flags);
@@ -127,7 +247,15 @@ unsigned int fifo_get(struct fifo_t * f, unsigned char * buf, unsigned int len)
 	irq_flags_t flags;
 	unsigned int ret;
 
+	if(f->mode == FIFO_MODE_SPSC)
+		return fifo_sc_get(f, buf, len);
 	spin_lock_irqsave(&f->lock, flags);
+	if(f->mode == FIFO_MODE_MPSC)
+	{
+		ret = fifo_sc_get(f, buf, len);
+		spin_unlock_irqrestore(&f->lock, flags);
+		return ret;
+	}
 	ret = __fifo_get(f, buf, len);
 	if(f->in == f->out)
 		f->in = f->out = 0;
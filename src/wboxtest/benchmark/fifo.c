@@ -0,0 +1,232 @@
+/*
+ * wboxtest/benchmark/fifo.c
+ */
+
+#include <wboxtest.h>
+
+struct wbt_fifo_pdata_t
+{
+	unsigned char * src;
+	unsigned char * dst;
+	size_t size;
+	size_t chunk;
+
+	ktime_t t1;
+	ktime_t t2;
+	int calls;
+};
+
+/*
+ * Producer tasks push a fixed number of chunks while the benchmark task
+ * consumes them, so the ring modes run under real contention.
+ */
+struct wbt_fifo_producer_t
+{
+	struct fifo_t * f;
+	struct channel_t * c;
+	unsigned char * src;
+	size_t chunk;
+	int count;
+	atomic_t running;
+};
+
+static const struct {
+	const char * name;
+	enum fifo_mode_t mode;
+} fifo_modes[] = {
+	{ "locked",	FIFO_MODE_LOCKED },
+	{ "spsc",	FIFO_MODE_SPSC },
+	{ "mpsc",	FIFO_MODE_MPSC },
+};
+
+static void fifo_producer_task(struct task_t * task, void * data)
+{
+	struct wbt_fifo_producer_t * p = (struct wbt_fifo_producer_t *)data;
+	unsigned int l;
+	int i;
+
+	for(i = 0; i < p->count; i++)
+	{
+		if(p->c)
+		{
+			channel_send(p->c, p->src, p->chunk);
+		}
+		else
+		{
+			for(l = 0; l < p->chunk;)
+			{
+				l += fifo_put(p->f, p->src + l, p->chunk - l);
+				if(l < p->chunk)
+					task_yield();
+			}
+		}
+	}
+	atomic_dec(&p->running);
+}
+
+static void fifo_contended(struct wbt_fifo_pdata_t * pdat, struct fifo_t * f, struct channel_t * c, int nproducer)
+{
+	struct wbt_fifo_producer_t p;
+	struct task_t * task;
+	size_t total, n = 0;
+	unsigned int l;
+	int i;
+
+	p.f = f;
+	p.c = c;
+	p.src = pdat->src;
+	p.chunk = pdat->chunk;
+	p.count = 16384;
+	atomic_set(&p.running, 0);
+	pdat->t1 = ktime_get();
+	for(i = 0; i < nproducer; i++)
+	{
+		task = task_create(NULL, "fifo-producer", fifo_producer_task, &p, 0, 0);
+		if(!task)
+			break;
+		atomic_inc(&p.running);
+		task_resume(task);
+	}
+	total = (size_t)i * p.count * p.chunk;
+	while(n < total)
+	{
+		if(c)
+		{
+			channel_recv(c, pdat->dst, pdat->chunk);
+			n += pdat->chunk;
+		}
+		else if((l = fifo_get(f, pdat->dst, pdat->chunk)) > 0)
+			n += l;
+		else
+			task_yield();
+	}
+	pdat->t2 = ktime_get();
+	while(atomic_get(&p.running) > 0)
+		task_yield();
+	pdat->calls = total / pdat->chunk;
+}
+
+static void * fifo_setup(struct wboxtest_t * wbt)
+{
+	struct wbt_fifo_pdata_t * pdat;
+	int i;
+
+	pdat = malloc(sizeof(struct wbt_fifo_pdata_t));
+	if(!pdat)
+		return NULL;
+
+	pdat->size = SZ_4K;
+	pdat->chunk = 64;
+	pdat->src = malloc(pdat->chunk);
+	pdat->dst = malloc(pdat->chunk);
+	if(!pdat->src || !pdat->dst)
+	{
+		free(pdat->src);
+		free(pdat->dst);
+		free(pdat);
+		return NULL;
+	}
+	for(i = 0; i < pdat->chunk; i++)
+	{
+		pdat->src[i] = i & 0xff;
+		pdat->dst[i] = 0;
+	}
+
+	return pdat;
+}
+
+static void fifo_clean(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_fifo_pdata_t * pdat = (struct wbt_fifo_pdata_t *)data;
+
+	if(pdat)
+	{
+		free(pdat->dst);
+		free(pdat->src);
+		free(pdat);
+	}
+}
+
+static void fifo_run(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_fifo_pdata_t * pdat = (struct wbt_fifo_pdata_t *)data;
+	struct fifo_t * f;
+	struct channel_t * c;
+	char buf[32];
+	int i;
+
+	if(pdat)
+	{
+		for(i = 0; i < ARRAY_SIZE(fifo_modes); i++)
+		{
+			f = fifo_alloc_mode(pdat->size, fifo_modes[i].mode);
+			if(!f)
+				continue;
+			pdat->calls = 0;
+			pdat->t2 = pdat->t1 = ktime_get();
+			do {
+				pdat->calls++;
+				fifo_put(f, pdat->src, pdat->chunk);
+				fifo_get(f, pdat->dst, pdat->chunk);
+				pdat->t2 = ktime_get();
+			} while(ktime_before(pdat->t2, ktime_add_ms(pdat->t1, 1000)));
+			wboxtest_print(" fifo %-6s: %s/s\r\n", fifo_modes[i].name, ssize(buf, (double)(pdat->calls * pdat->chunk) * 1000.0 / ktime_ms_delta(pdat->t2, pdat->t1)));
+			fifo_free(f);
+		}
+		for(i = 0; i < ARRAY_SIZE(fifo_modes); i++)
+		{
+			f = fifo_alloc_mode(pdat->size, fifo_modes[i].mode);
+			if(!f)
+				continue;
+			fifo_contended(pdat, f, NULL, (fifo_modes[i].mode == FIFO_MODE_MPSC) ? 2 : 1);
+			wboxtest_print(" fifo %-6s contended: %s/s\r\n", fifo_modes[i].name, ssize(buf, (double)(pdat->calls * pdat->chunk) * 1000.0 / ktime_ms_delta(pdat->t2, pdat->t1)));
+			fifo_free(f);
+		}
+		for(i = 0; i < ARRAY_SIZE(fifo_modes); i++)
+		{
+			c = channel_alloc_mode(pdat->size, fifo_modes[i].mode);
+			if(!c)
+				continue;
+			pdat->calls = 0;
+			pdat->t2 = pdat->t1 = ktime_get();
+			do {
+				pdat->calls++;
+				channel_send(c, pdat->src, pdat->chunk);
+				channel_recv(c, pdat->dst, pdat->chunk);
+				pdat->t2 = ktime_get();
+			} while(ktime_before(pdat->t2, ktime_add_ms(pdat->t1, 1000)));
+			wboxtest_print(" channel %-6s: %s/s\r\n", fifo_modes[i].name, ssize(buf, (double)(pdat->calls * pdat->chunk) * 1000.0 / ktime_ms_delta(pdat->t2, pdat->t1)));
+			channel_free(c);
+		}
+		for(i = 0; i < ARRAY_SIZE(fifo_modes); i++)
+		{
+			c = channel_alloc_mode(pdat->size, fifo_modes[i].mode);
+			if(!c)
+				continue;
+			fifo_contended(pdat, c->fifo, c, (fifo_modes[i].mode == FIFO_MODE_MPSC) ? 2 : 1);
+			wboxtest_print(" channel %-6s contended: %s/s\r\n", fifo_modes[i].name, ssize(buf, (double)(pdat->calls * pdat->chunk) * 1000.0 / ktime_ms_delta(pdat->t2, pdat->t1)));
+			channel_free(c);
+		}
+	}
+}
+
+static struct wboxtest_t wbt_fifo = {
+	.group	= "benchmark",
+	.name	= "fifo",
+	.setup	= fifo_setup,
+	.clean	= fifo_clean,
+	.run	= fifo_run,
+};
+
+static __init void fifo_wbt_init(void)
+{
+	register_wboxtest(&wbt_fifo);
+}
+
+static __exit void fifo_wbt_exit(void)
+{
+	unregister_wboxtest(&wbt_fifo);
+}
+
+wboxtest_initcall(fifo_wbt_init);
+wboxtest_exitcall(fifo_wbt_exit);
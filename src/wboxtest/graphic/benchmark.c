@@ -0,0 +1,137 @@
+/*
+ * wboxtest/graphic/benchmark.c
+ */
+
+#include <wboxtest.h>
+
+struct wbt_benchmark_pdata_t
+{
+	struct surface_t * dst;
+	struct surface_t * src;
+};
+
+static void * benchmark_setup(struct wboxtest_t * wbt)
+{
+	struct wbt_benchmark_pdata_t * pdat;
+	uint32_t * p;
+	int i, j, a;
+
+	pdat = malloc(sizeof(struct wbt_benchmark_pdata_t));
+	if(!pdat)
+		return NULL;
+
+	pdat->dst = surface_alloc(640, 480, NULL);
+	pdat->src = surface_alloc(640, 480, NULL);
+	if(!pdat->dst || !pdat->src)
+	{
+		if(pdat->dst)
+			surface_free(pdat->dst);
+		if(pdat->src)
+			surface_free(pdat->src);
+		free(pdat);
+		return NULL;
+	}
+	p = surface_get_pixels(pdat->src);
+	for(j = 0; j < surface_get_height(pdat->src); j++)
+	{
+		for(i = 0; i < surface_get_width(pdat->src); i++)
+		{
+			a = (i + j) & 0xff;
+			*p++ = (a << 24) | ((a >> 1) << 16) | ((a >> 2) << 8) | (a >> 3);
+		}
+	}
+
+	return pdat;
+}
+
+static void benchmark_clean(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_benchmark_pdata_t * pdat = (struct wbt_benchmark_pdata_t *)data;
+
+	if(pdat)
+	{
+		surface_free(pdat->dst);
+		surface_free(pdat->src);
+		free(pdat);
+	}
+}
+
+static double benchmark_mpixels(struct wbt_benchmark_pdata_t * pdat, int blit)
+{
+	struct matrix_t m;
+	struct color_t c;
+	ktime_t t1, t2;
+	int calls = 0;
+
+	matrix_init_identity(&m);
+	color_init(&c, 0x20, 0x40, 0x80, 0x80);
+	t2 = t1 = ktime_get();
+	do {
+		calls++;
+		if(blit)
+			surface_blit(pdat->dst, NULL, &m, pdat->src, RENDER_TYPE_FAST);
+		else
+			surface_fill(pdat->dst, NULL, &m, surface_get_width(pdat->dst), surface_get_height(pdat->dst), &c, RENDER_TYPE_FAST);
+		t2 = ktime_get();
+	} while(ktime_before(t2, ktime_add_ms(t1, 1000)));
+
+	return (double)calls * surface_get_width(pdat->dst) * surface_get_height(pdat->dst) / (ktime_us_delta(t2, t1) + 1);
+}
+
+static double benchmark_kshapes(struct wbt_benchmark_pdata_t * pdat)
+{
+	struct color_t c;
+	ktime_t t1, t2;
+	int calls = 0;
+
+	color_init(&c, 0x20, 0x40, 0x80, 0xc0);
+	t2 = t1 = ktime_get();
+	do {
+		surface_shape_circle(pdat->dst, NULL, 320, 240, 20 + (calls % 200), (calls & 1) ? 8 : 0, &c);
+		calls++;
+		t2 = ktime_get();
+	} while(ktime_before(t2, ktime_add_ms(t1, 1000)));
+
+	return (double)calls * 1000 / (ktime_us_delta(t2, t1) + 1);
+}
+
+static void benchmark_run(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_benchmark_pdata_t * pdat = (struct wbt_benchmark_pdata_t *)data;
+	const char * old, * name;
+	int i;
+
+	if(pdat)
+	{
+		old = render_default_pixops_get();
+		for(i = 0; (name = render_default_pixops_name(i)); i++)
+		{
+			render_default_pixops_set(name);
+			wboxtest_print(" [%s] fill: %.2f Mpixels/s\r\n", name, benchmark_mpixels(pdat, 0));
+			wboxtest_print(" [%s] blend: %.2f Mpixels/s\r\n", name, benchmark_mpixels(pdat, 1));
+			wboxtest_print(" [%s] shape: %.2f Kshapes/s\r\n", name, benchmark_kshapes(pdat));
+		}
+		render_default_pixops_set(old);
+	}
+}
+
+static struct wboxtest_t wbt_benchmark = {
+	.group	= "graphic",
+	.name	= "benchmark",
+	.setup	= benchmark_setup,
+	.clean	= benchmark_clean,
+	.run	= benchmark_run,
+};
+
+static __init void benchmark_wbt_init(void)
+{
+	register_wboxtest(&wbt_benchmark);
+}
+
+static __exit void benchmark_wbt_exit(void)
+{
+	unregister_wboxtest(&wbt_benchmark);
+}
+
+wboxtest_initcall(benchmark_wbt_init);
+wboxtest_exitcall(benchmark_wbt_exit);